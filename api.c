@@ -57,12 +57,9 @@ API_SYM x86emu_t *x86emu_new(unsigned def_mem_perm, unsigned def_io_perm)
 {
   x86emu_t *emu = calloc(1, sizeof *emu);
 
+  emu->priv = calloc(1, sizeof *emu->priv);
   emu->mem = emu_mem_new(def_mem_perm);
 
-  emu->io.map =  calloc(X86EMU_IO_PORTS, sizeof *emu->io.map);
-  emu->io.stats_i =  calloc(X86EMU_IO_PORTS, sizeof *emu->io.stats_i);
-  emu->io.stats_o =  calloc(X86EMU_IO_PORTS, sizeof *emu->io.stats_o);
-
   if(def_io_perm) x86emu_set_io_perm(emu, 0, X86EMU_IO_PORTS - 1, def_io_perm);
 
   x86emu_set_memio_handler(emu, vm_memio);
@@ -77,18 +74,41 @@ API_SYM x86emu_t *x86emu_new(unsigned def_mem_perm, unsigned def_io_perm)
 
 API_SYM x86emu_t *x86emu_done(x86emu_t *emu)
 {
+  unsigned u;
+
   if(emu) {
+    // flushes remaining trace data
+    brtrace_close(emu);
+
     emu_mem_free(emu->mem);
 
+    logq_free(emu);
     free(emu->log.buf);
 
-    free(emu->io.map);
-    free(emu->io.stats_i);
-    free(emu->io.stats_o);
+    for(u = 0; u < X86EMU_IO_PORTS >> IO_CHUNK_BITS; u++) free(emu->priv->io.chunk[u]);
+    free(emu->priv->io.handler);
+    dev_free(emu->priv->dev);
+    journal_free(emu->priv->journal);
+    free(emu->priv->poll);
+    bios_free(emu->priv->bios);
+    free(emu->priv->btrace);
+    recorder_free(emu->priv->recorder);
+    prof_free(emu->priv->prof);
+    cov_free(emu->priv->cov);
+    filter_free(emu->priv->filter);
+    free(emu->priv->icost);
+    cg_free(emu->priv->cg);
+    heat_free(emu->priv->heat);
+    free(emu->priv->perf);
+    free(emu->priv->event);
+    free(emu->priv->rdelta);
+    free(emu->priv->dcache);
+    disasm_free(emu->priv->disasm);
 
     free(emu->x86.msr);
     free(emu->x86.msr_perm);
 
+    free(emu->priv);
     free(emu);
   }
 
@@ -99,13 +119,24 @@ API_SYM x86emu_t *x86emu_done(x86emu_t *emu)
 API_SYM x86emu_t *x86emu_clone(x86emu_t *emu)
 {
   x86emu_t *new_emu = NULL;
+  unsigned u;
 
   if(!emu) return new_emu;
 
   new_emu = mem_dup(emu, sizeof *emu);
+  new_emu->priv = mem_dup(emu->priv, sizeof *emu->priv);
 
   new_emu->mem = emu_mem_clone(emu->mem);
 
+  // log is flushed synchronously in the clone
+  new_emu->priv->logq = NULL;
+
+  // branch trace is a single stream; clone starts without it
+  new_emu->priv->brtrace = NULL;
+
+  // just a cache
+  new_emu->priv->disasm = NULL;
+
   if(emu->log.buf && emu->log.ptr) {
     new_emu->log.buf = malloc(emu->log.size);
     // copy only used log space
@@ -115,9 +146,27 @@ API_SYM x86emu_t *x86emu_clone(x86emu_t *emu)
     }
   }
 
-  new_emu->io.map = mem_dup(emu->io.map, X86EMU_IO_PORTS * sizeof *emu->io.map);
-  new_emu->io.stats_i = mem_dup(emu->io.stats_i, X86EMU_IO_PORTS * sizeof *emu->io.stats_i);
-  new_emu->io.stats_o = mem_dup(emu->io.stats_o, X86EMU_IO_PORTS * sizeof *emu->io.stats_o);
+  for(u = 0; u < X86EMU_IO_PORTS >> IO_CHUNK_BITS; u++) {
+    new_emu->priv->io.chunk[u] = mem_dup(emu->priv->io.chunk[u], sizeof *emu->priv->io.chunk[u]);
+  }
+  new_emu->priv->io.handler = mem_dup(emu->priv->io.handler, emu->priv->io.handlers * sizeof *emu->priv->io.handler);
+  if(emu->priv->dev) new_emu->priv->dev = dev_clone(emu->priv->dev);
+  if(emu->priv->journal) new_emu->priv->journal = journal_clone(emu->priv->journal);
+  new_emu->priv->poll = mem_dup(emu->priv->poll, sizeof *emu->priv->poll);
+  if(emu->priv->bios) new_emu->priv->bios = bios_clone(emu->priv->bios);
+  new_emu->priv->btrace = mem_dup(emu->priv->btrace, sizeof *emu->priv->btrace);
+  if(emu->priv->recorder) new_emu->priv->recorder = recorder_clone(emu->priv->recorder);
+  if(emu->priv->prof) new_emu->priv->prof = prof_clone(emu->priv->prof);
+  if(emu->priv->cov) new_emu->priv->cov = cov_clone(emu->priv->cov);
+  if(emu->priv->filter) new_emu->priv->filter = filter_clone(emu->priv->filter);
+  new_emu->priv->icost = mem_dup(emu->priv->icost, sizeof *emu->priv->icost);
+  if(emu->priv->cg) new_emu->priv->cg = cg_clone(emu->priv->cg);
+  if(emu->priv->heat) new_emu->priv->heat = heat_clone(emu->priv->heat);
+  new_emu->priv->perf = mem_dup(emu->priv->perf, sizeof *emu->priv->perf);
+  new_emu->priv->event = mem_dup(emu->priv->event, sizeof *emu->priv->event);
+  new_emu->priv->rdelta = mem_dup(emu->priv->rdelta, sizeof *emu->priv->rdelta);
+  new_emu->priv->dcache = mem_dup(emu->priv->dcache, sizeof *emu->priv->dcache);
+  if(new_emu->mem) new_emu->mem->perf = PERF_ON(new_emu, X86EMU_PERF_MEM) ? &new_emu->priv->perf->c : NULL;
   new_emu->x86.msr = mem_dup(emu->x86.msr, X86EMU_MSRS * sizeof *emu->x86.msr);
   new_emu->x86.msr_perm = mem_dup(emu->x86.msr_perm, X86EMU_MSRS * sizeof *emu->x86.msr_perm);
 
@@ -129,6 +178,8 @@ API_SYM void x86emu_reset(x86emu_t *emu)
 {
   x86emu_regs_t *x86 = &emu->x86;
 
+  if(emu->priv->dev) dev_reset(emu);
+
   free(x86->msr);
   free(x86->msr_perm);
 
@@ -308,6 +359,7 @@ API_SYM void x86emu_write_dword(x86emu_t *emu, unsigned addr, unsigned val)
 API_SYM void x86emu_set_log(x86emu_t *emu, unsigned buffer_size, x86emu_flush_func_t flush)
 {
   if(emu) {
+    logq_free(emu);
     if(emu->log.buf) free(emu->log.buf);
     emu->log.size = buffer_size;
     emu->log.buf = buffer_size ? calloc(1, buffer_size) : NULL;
@@ -321,11 +373,26 @@ API_SYM unsigned x86emu_clear_log(x86emu_t *emu, int flush)
 {
   if(flush && emu->log.flush) {
     if(emu->log.ptr && emu->log.ptr != emu->log.buf) {
-      emu->log.flush(emu, emu->log.buf, emu->log.ptr - emu->log.buf);
+      if(PERF_ON(emu, X86EMU_PERF_LOG)) {
+        emu->priv->perf->c.log_flushes++;
+        emu->priv->perf->c.log_bytes += emu->log.ptr - emu->log.buf;
+      }
+      if(emu->priv->logq) {
+        logq_put(emu, emu->log.ptr - emu->log.buf);
+      }
+      else {
+        emu->log.flush(emu, emu->log.buf, emu->log.ptr - emu->log.buf);
+      }
     }
   }
   if((emu->log.ptr = emu->log.buf)) *emu->log.ptr = 0;
 
+  // binary trace: next buffer starts without delta base
+  if(emu->priv->btrace) emu->priv->btrace->valid = 0;
+
+  // same for register delta trace: start with full register dump
+  if(emu->priv->rdelta) emu->priv->rdelta->valid = 0;
+
   return emu->log.ptr ? LOG_FREE(emu) : 0;
 }
 
@@ -334,9 +401,29 @@ API_SYM void x86emu_log(x86emu_t *emu, const char *format, ...)
 {
   va_list args;
   int size, log_free;
+  char buf[256], *s = buf;
 
   if(!emu || !emu->log.ptr) return;
 
+  if(emu->log.trace & X86EMU_TRACE_BINARY) {
+    va_start(args, format);
+    size = vsnprintf(buf, sizeof buf, format, args);
+    va_end(args);
+
+    // longer text: try again with a big enough buffer
+    if(size >= (int) sizeof buf && (s = malloc(size + 1))) {
+      va_start(args, format);
+      vsnprintf(s, size + 1, format, args);
+      va_end(args);
+    }
+
+    if(size > 0 && s) btrace_text(emu, s, size);
+
+    if(s != buf) free(s);
+
+    return;
+  }
+
   log_free = LOG_FREE(emu);
 
   va_start(args, format);
@@ -439,6 +526,7 @@ API_SYM void x86emu_dump(x86emu_t *emu, int flags)
   mem2_pdir_t *pdir;
   mem2_ptable_t *ptable;
   mem2_page_t page;
+  struct x86emu_io_chunk_s *io;
   unsigned pdir_idx, u, u1, u2, addr;
   char str_data[LINE_LEN * 8], str_attr[LINE_LEN * 8], fbuf[64];
   unsigned char def_data[LINE_LEN], def_attr[LINE_LEN];
@@ -466,15 +554,10 @@ API_SYM void x86emu_dump(x86emu_t *emu, int flags)
       if(!ptable) continue;
       for(u1 = 0; u1 < (1 << X86EMU_PTABLE_BITS); u1++) {
         page = (*ptable)[u1];
-        if(page.data) {
+        if(page & MEM2_PAGE_ALLOC) {
           for(u2 = 0; u2 < X86EMU_PAGE_SIZE; u2 += LINE_LEN) {
-            memcpy(def_data, page.data + u2, LINE_LEN);
-            if(page.attr) {
-              memcpy(def_attr, page.attr + u2, LINE_LEN);
-            }
-            else {
-              memset(def_attr, page.def_attr, LINE_LEN);
-            }
+            memcpy(def_data, mem2_data(page) + u2, LINE_LEN);
+            memcpy(def_attr, mem2_attr(page) + u2, LINE_LEN);
             dump_data(emu, def_data, def_attr, str_data, str_attr, dump_flags);
             if(*str_data) {
               addr = (((pdir_idx << X86EMU_PTABLE_BITS) + u1) << X86EMU_PAGE_BITS) + u2;
@@ -493,14 +576,20 @@ API_SYM void x86emu_dump(x86emu_t *emu, int flags)
     x86emu_log(emu, "; - - io accesses\n");
 
     for(u = 0; u < X86EMU_IO_PORTS; u++) {
-      if(emu->io.map[u] & (X86EMU_ACC_R | X86EMU_ACC_W | X86EMU_ACC_INVALID)) {
+      // unallocated chunks have not been accessed
+      if(!(io = emu->priv->io.chunk[u >> IO_CHUNK_BITS])) {
+        u |= IO_CHUNK_SIZE - 1;
+        continue;
+      }
+      u1 = u & (IO_CHUNK_SIZE - 1);
+      if(io->map[u1] & (X86EMU_ACC_R | X86EMU_ACC_W | X86EMU_ACC_INVALID)) {
         x86emu_log(emu,
           "%04x: %c%c%c in=%08x out=%08x\n",
           u,
-          (emu->io.map[u] & X86EMU_ACC_INVALID) ? '*' : ' ',
-          (emu->io.map[u] & X86EMU_PERM_R) ? 'r' : ' ',
-          (emu->io.map[u] & X86EMU_PERM_W) ? 'w' : ' ',
-          emu->io.stats_i[u], emu->io.stats_o[u]
+          (io->map[u1] & X86EMU_ACC_INVALID) ? '*' : ' ',
+          (io->map[u1] & X86EMU_PERM_R) ? 'r' : ' ',
+          (io->map[u1] & X86EMU_PERM_W) ? 'w' : ' ',
+          io->stats_i[u1], io->stats_o[u1]
         );
       }
     }
@@ -515,8 +604,19 @@ API_SYM void x86emu_dump(x86emu_t *emu, int flags)
     }
 
     x86emu_log(emu, "\n");
+
+    if(emu->priv->icost) {
+      icost_dump(emu);
+      x86emu_log(emu, "\n");
+    }
   }
 
+  if((flags & X86EMU_DUMP_RECORDER)) recorder_dump(emu);
+
+  if((flags & X86EMU_DUMP_PROFILE)) prof_dump(emu);
+
+  if((flags & X86EMU_DUMP_HEATMAP) && emu->priv->heat) heat_dump(emu);
+
   if((flags & X86EMU_DUMP_REGS)) {
     x86emu_log(emu, "; - - registers\n");
 
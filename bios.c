@@ -0,0 +1,443 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Native implementations of real mode BIOS services. They run instead of
+*   the guest's interrupt handler and work on registers and guest memory
+*   directly.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+#define BIOS_SMAP	0x534d4150
+
+static bios_shim_t *bios_find(struct x86emu_bios_s *bios, u8 intr, unsigned func, unsigned mask);
+static void bios_cf(x86emu_t *emu, int err);
+static int bios_mem(x86emu_t *emu, void *ctx);
+static u64 bios_mem_end(struct x86emu_bios_s *bios, u64 start);
+static int bios_time(x86emu_t *emu, void *ctx);
+static int bios_kbd(x86emu_t *emu, void *ctx);
+static unsigned bios_kbd_next(x86emu_t *emu, unsigned ptr);
+static u32 bios_read(x86emu_t *emu, u32 addr, unsigned bits);
+static void bios_write(x86emu_t *emu, u32 addr, u32 val, unsigned bits);
+
+
+/*
+ * Register handler for int 'intr' with (AX & mask) == func.
+ *
+ * A later registration for the same intr/func/mask replaces the handler,
+ * handler = NULL removes it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_bios_handler(x86emu_t *emu, u8 intr, unsigned func, unsigned mask, x86emu_bios_handler_t handler, void *ctx)
+{
+  struct x86emu_bios_s *bios;
+  bios_shim_t *shim;
+
+  if(!emu) return -1;
+
+  func &= mask &= 0xffff;
+
+  if(!(bios = emu->priv->bios)) {
+    if(!handler) return 0;
+    if(!(bios = emu->priv->bios = calloc(1, sizeof *bios))) return -1;
+  }
+
+  if((shim = bios_find(bios, intr, func, mask))) {
+    if(handler) {
+      shim->handler = handler;
+      shim->ctx = ctx;
+    }
+    else {
+      memmove(shim, shim + 1, (bios->shims - (shim - bios->shim) - 1) * sizeof *shim);
+      bios->shims--;
+    }
+  }
+  else if(handler) {
+    if(!(shim = realloc(bios->shim, (bios->shims + 1) * sizeof *shim))) return -1;
+    bios->shim = shim;
+    shim += bios->shims++;
+    shim->intr = intr;
+    shim->func = func;
+    shim->mask = mask;
+    shim->handler = handler;
+    shim->ctx = ctx;
+  }
+
+  // rebuild vector map
+  memset(bios->map, 0, sizeof bios->map);
+  for(shim = bios->shim; shim < bios->shim + bios->shims; shim++) {
+    bios->map[shim->intr >> 3] |= 1 << (shim->intr & 7);
+  }
+
+  return 0;
+}
+
+
+/*
+ * Enable built-in services (X86EMU_BIOS_* bits).
+ */
+API_SYM void x86emu_set_bios(x86emu_t *emu, unsigned services)
+{
+  if(!emu) return;
+
+  x86emu_set_bios_handler(emu, 0x15, 0xe820, 0xffff, services & X86EMU_BIOS_MEM ? bios_mem : NULL, NULL);
+  x86emu_set_bios_handler(emu, 0x15, 0xe801, 0xffff, services & X86EMU_BIOS_MEM ? bios_mem : NULL, NULL);
+  x86emu_set_bios_handler(emu, 0x15, 0x8800, 0xff00, services & X86EMU_BIOS_MEM ? bios_mem : NULL, NULL);
+  x86emu_set_bios_handler(emu, 0x1a, 0x0000, 0xf800, services & X86EMU_BIOS_TIME ? bios_time : NULL, NULL);
+  x86emu_set_bios_handler(emu, 0x16, 0x0000, 0x0000, services & X86EMU_BIOS_KBD ? bios_kbd : NULL, NULL);
+}
+
+
+/*
+ * Add memory range to the map reported by int 0x15 (X86EMU_BIOS_MEM).
+ *
+ * type: e820 type (1 = usable RAM, 2 = reserved, ...).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_bios_add_mem(x86emu_t *emu, u64 base, u64 size, unsigned type)
+{
+  struct x86emu_bios_s *bios;
+  bios_mem_t *mem;
+
+  if(!emu || !size) return -1;
+
+  if(!(bios = emu->priv->bios) && !(bios = emu->priv->bios = calloc(1, sizeof *bios))) return -1;
+
+  if(!(mem = realloc(bios->mem, (bios->mems + 1) * sizeof *mem))) return -1;
+  bios->mem = mem;
+
+  mem += bios->mems++;
+  mem->base = base;
+  mem->size = size;
+  mem->type = type;
+
+  return 0;
+}
+
+
+/*
+ * Run native handler for software interrupt 'intr', if there is one.
+ *
+ * Returns 1 if the interrupt has been handled.
+ */
+int bios_call(x86emu_t *emu, u8 intr)
+{
+  struct x86emu_bios_s *bios = emu->priv->bios;
+  bios_shim_t *shim;
+  unsigned ax = emu->x86.R_AX;
+
+  if(!(bios->map[intr >> 3] & (1 << (intr & 7)))) return 0;
+
+  for(shim = bios->shim; shim < bios->shim + bios->shims; shim++) {
+    if(shim->intr == intr && (ax & shim->mask) == shim->func && shim->handler(emu, shim->ctx)) return 1;
+  }
+
+  return 0;
+}
+
+
+struct x86emu_bios_s *bios_clone(struct x86emu_bios_s *bios)
+{
+  struct x86emu_bios_s *new_bios;
+
+  if(!bios || !(new_bios = mem_dup(bios, sizeof *bios))) return NULL;
+
+  new_bios->shim = mem_dup(bios->shim, bios->shims * sizeof *bios->shim);
+  new_bios->mem = mem_dup(bios->mem, bios->mems * sizeof *bios->mem);
+
+  return new_bios;
+}
+
+
+struct x86emu_bios_s *bios_free(struct x86emu_bios_s *bios)
+{
+  if(bios) {
+    free(bios->shim);
+    free(bios->mem);
+    free(bios);
+  }
+
+  return NULL;
+}
+
+
+bios_shim_t *bios_find(struct x86emu_bios_s *bios, u8 intr, unsigned func, unsigned mask)
+{
+  bios_shim_t *shim;
+
+  for(shim = bios->shim; shim < bios->shim + bios->shims; shim++) {
+    if(shim->intr == intr && shim->func == func && shim->mask == mask) return shim;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Set carry flag to indicate an error.
+ */
+void bios_cf(x86emu_t *emu, int err)
+{
+  if(err) {
+    SET_FLAG(F_CF);
+  }
+  else {
+    CLEAR_FLAG(F_CF);
+  }
+}
+
+
+/*
+ * int 0x15, ax = 0xe820, 0xe801; ah = 0x88: memory size.
+ */
+int bios_mem(x86emu_t *emu, void *ctx)
+{
+  struct x86emu_bios_s *bios = emu->priv->bios;
+  sel_t *es = emu->x86.seg + R_ES_INDEX;
+  bios_mem_t *mem;
+  unsigned idx;
+  u64 end;
+
+  if(!bios->mems) return 0;
+
+  switch(emu->x86.R_AX) {
+    case 0xe820:
+      idx = emu->x86.R_EBX;
+      if(emu->x86.R_EDX != BIOS_SMAP || emu->x86.R_ECX < 20 || idx >= bios->mems) {
+        emu->x86.R_AH = 0x86;
+        bios_cf(emu, 1);
+        break;
+      }
+      mem = bios->mem + idx;
+      store_data_long_abs(emu, es, emu->x86.R_DI, mem->base);
+      store_data_long_abs(emu, es, emu->x86.R_DI + 4, mem->base >> 32);
+      store_data_long_abs(emu, es, emu->x86.R_DI + 8, mem->size);
+      store_data_long_abs(emu, es, emu->x86.R_DI + 12, mem->size >> 32);
+      store_data_long_abs(emu, es, emu->x86.R_DI + 16, mem->type);
+      emu->x86.R_EAX = BIOS_SMAP;
+      emu->x86.R_ECX = 20;
+      emu->x86.R_EBX = idx + 1 < bios->mems ? idx + 1 : 0;
+      bios_cf(emu, 0);
+      break;
+
+    case 0xe801:
+      // KB between 1 MB and 16 MB, 64 KB blocks above 16 MB
+      end = bios_mem_end(bios, 1 << 20);
+      emu->x86.R_AX = emu->x86.R_CX = ((end < (16 << 20) ? end : (16 << 20)) - (1 << 20)) >> 10;
+      if(end > 1ULL << 32) end = 1ULL << 32;
+      emu->x86.R_BX = emu->x86.R_DX = end > (16 << 20) ? (end - (16 << 20)) >> 16 : 0;
+      bios_cf(emu, 0);
+      break;
+
+    default:
+      // ah = 0x88: KB above 1 MB
+      end = (bios_mem_end(bios, 1 << 20) - (1 << 20)) >> 10;
+      emu->x86.R_AX = end > 0xffff ? 0xffff : end;
+      bios_cf(emu, 0);
+      break;
+  }
+
+  return 1;
+}
+
+
+/*
+ * End of usable RAM contiguous from 'start'.
+ */
+u64 bios_mem_end(struct x86emu_bios_s *bios, u64 start)
+{
+  unsigned u;
+  int found;
+
+  do {
+    for(found = 0, u = 0; u < bios->mems; u++) {
+      if(
+        bios->mem[u].type == 1 &&
+        bios->mem[u].base <= start &&
+        bios->mem[u].base + bios->mem[u].size > start
+      ) {
+        start = bios->mem[u].base + bios->mem[u].size;
+        found = 1;
+      }
+    }
+  } while(found);
+
+  return start;
+}
+
+
+/*
+ * int 0x1a, ah = 0x00 - 0x05: time.
+ *
+ * Tick count is kept in the BIOS data area; RTC functions need the
+ * RTC device model.
+ */
+int bios_time(x86emu_t *emu, void *ctx)
+{
+  switch(emu->x86.R_AH) {
+    case 0x00:
+      emu->x86.R_AL = bios_read(emu, 0x470, X86EMU_MEMIO_8);
+      bios_write(emu, 0x470, 0, X86EMU_MEMIO_8);
+      emu->x86.R_CX = bios_read(emu, 0x46e, X86EMU_MEMIO_16);
+      emu->x86.R_DX = bios_read(emu, 0x46c, X86EMU_MEMIO_16);
+      break;
+
+    case 0x01:
+      bios_write(emu, 0x46e, emu->x86.R_CX, X86EMU_MEMIO_16);
+      bios_write(emu, 0x46c, emu->x86.R_DX, X86EMU_MEMIO_16);
+      bios_write(emu, 0x470, 0, X86EMU_MEMIO_8);
+      break;
+
+    case 0x02:
+      if(!emu->priv->dev || !(emu->priv->dev->devices & X86EMU_DEV_RTC)) return 0;
+      emu->x86.R_CH = dev_rtc_read(emu, 0x04);
+      emu->x86.R_CL = dev_rtc_read(emu, 0x02);
+      emu->x86.R_DH = dev_rtc_read(emu, 0x00);
+      emu->x86.R_DL = dev_rtc_read(emu, 0x0b) & 1;
+      bios_cf(emu, 0);
+      break;
+
+    case 0x04:
+      if(!emu->priv->dev || !(emu->priv->dev->devices & X86EMU_DEV_RTC)) return 0;
+      emu->x86.R_CH = dev_rtc_read(emu, 0x32);
+      emu->x86.R_CL = dev_rtc_read(emu, 0x09);
+      emu->x86.R_DH = dev_rtc_read(emu, 0x08);
+      emu->x86.R_DL = dev_rtc_read(emu, 0x07);
+      bios_cf(emu, 0);
+      break;
+
+    default:
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * int 0x16: keyboard, based on the BIOS data area key buffer.
+ *
+ * If no key is available, reading a key is left to the guest handler.
+ */
+int bios_kbd(x86emu_t *emu, void *ctx)
+{
+  unsigned head = bios_read(emu, 0x41a, X86EMU_MEMIO_16), tail = bios_read(emu, 0x41c, X86EMU_MEMIO_16), key;
+  unsigned ext = emu->x86.R_AH & 0x10;
+
+  switch(emu->x86.R_AH) {
+    case 0x00:
+    case 0x10:
+      if(head == tail) return 0;
+      key = bios_read(emu, 0x400 + head, X86EMU_MEMIO_16);
+      bios_write(emu, 0x41a, bios_kbd_next(emu, head), X86EMU_MEMIO_16);
+      if(!ext && (key & 0xff) == 0xe0 && (key >> 8)) key &= 0xff00;
+      emu->x86.R_AX = key;
+      break;
+
+    case 0x01:
+    case 0x11:
+      if(head == tail) {
+        SET_FLAG(F_ZF);
+        break;
+      }
+      key = bios_read(emu, 0x400 + head, X86EMU_MEMIO_16);
+      if(!ext && (key & 0xff) == 0xe0 && (key >> 8)) key &= 0xff00;
+      emu->x86.R_AX = key;
+      CLEAR_FLAG(F_ZF);
+      break;
+
+    case 0x02:
+      emu->x86.R_AL = bios_read(emu, 0x417, X86EMU_MEMIO_8);
+      break;
+
+    case 0x12:
+      emu->x86.R_AL = bios_read(emu, 0x417, X86EMU_MEMIO_8);
+      emu->x86.R_AH = bios_read(emu, 0x418, X86EMU_MEMIO_8);
+      break;
+
+    case 0x05:
+      if(bios_kbd_next(emu, tail) == head) {
+        emu->x86.R_AL = 1;
+        break;
+      }
+      bios_write(emu, 0x400 + tail, emu->x86.R_CX, X86EMU_MEMIO_16);
+      bios_write(emu, 0x41c, bios_kbd_next(emu, tail), X86EMU_MEMIO_16);
+      emu->x86.R_AL = 0;
+      break;
+
+    default:
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * Advance key buffer pointer.
+ */
+unsigned bios_kbd_next(x86emu_t *emu, unsigned ptr)
+{
+  unsigned start = bios_read(emu, 0x480, X86EMU_MEMIO_16), end = bios_read(emu, 0x482, X86EMU_MEMIO_16);
+
+  if(!start || start >= end) {
+    start = 0x1e;
+    end = 0x3e;
+  }
+
+  ptr += 2;
+
+  return ptr >= end ? start : ptr;
+}
+
+
+/*
+ * BIOS data area access.
+ *
+ * Done on behalf of the guest, so it goes through the same path as guest
+ * accesses (journal, events), unlike x86emu_read_*() and x86emu_write_*().
+ */
+u32 bios_read(x86emu_t *emu, u32 addr, unsigned bits)
+{
+  u32 val = 0;
+
+  emu_memio(emu, addr, &val, X86EMU_MEMIO_R + bits);
+
+  return val;
+}
+
+
+void bios_write(x86emu_t *emu, u32 addr, u32 val, unsigned bits)
+{
+  emu_memio(emu, addr, &val, X86EMU_MEMIO_W + bits);
+}
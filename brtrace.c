@@ -0,0 +1,442 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+* Description:
+*   Branch trace: like hardware branch tracing, record only what cannot be
+*   derived from the code itself - taken/not taken bits for conditional
+*   branches, targets of indirect branches, interrupts, and port input.
+*   Code pages are added to the trace when they are first executed and
+*   again when they change, so tools/x86emu-brtrace can reconstruct the
+*   full instruction trace from it.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static int brtrace_reserve(x86emu_t *emu, unsigned len);
+static void brtrace_num(struct x86emu_brtrace_s *bt, u64 val);
+static void brtrace_bit(x86emu_t *emu, unsigned bit);
+static void brtrace_flush_bits(x86emu_t *emu);
+static int brtrace_pos(x86emu_t *emu, unsigned type, unsigned len);
+static void brtrace_put_state(struct x86emu_brtrace_s *bt, brtrace_state_t *s);
+static void brtrace_get_state(x86emu_t *emu, brtrace_state_t *s);
+static int brtrace_same_state(brtrace_state_t *s1, brtrace_state_t *s2);
+static void brtrace_code(x86emu_t *emu);
+static unsigned char *brtrace_shadow(struct x86emu_brtrace_s *bt, u32 addr, int create);
+
+
+/*
+ * Start branch trace, written in buffer_size chunks to flush.
+ *
+ * Stop it with buffer_size = 0; remaining data are flushed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_branch_trace(x86emu_t *emu, unsigned buffer_size, x86emu_flush_func_t flush)
+{
+  struct x86emu_brtrace_s *bt;
+
+  if(!emu) return -1;
+
+  brtrace_close(emu);
+
+  if(!buffer_size) return 0;
+
+  if(!flush) return -1;
+
+  if(buffer_size < BRTRACE_MIN_BUF) buffer_size = BRTRACE_MIN_BUF;
+
+  if(!(bt = calloc(1, sizeof *bt))) return -1;
+
+  if(!(bt->buf = malloc(buffer_size))) {
+    free(bt);
+
+    return -1;
+  }
+
+  bt->flush = flush;
+  bt->size = buffer_size;
+  bt->tnt = 1;
+
+  memcpy(bt->buf, X86EMU_BRTRACE_MAGIC, X86EMU_BRTRACE_MAGIC_LEN);
+  bt->used = X86EMU_BRTRACE_MAGIC_LEN;
+
+  emu->priv->brtrace = bt;
+
+  return 0;
+}
+
+
+/*
+ * Flush remaining data and stop branch trace.
+ */
+void brtrace_close(x86emu_t *emu)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+  unsigned u, v;
+
+  if(!bt) return;
+
+  brtrace_flush_bits(emu);
+
+  if(bt->used) bt->flush(emu, (char *) bt->buf, bt->used);
+
+  for(u = 0; u < sizeof bt->shadow / sizeof *bt->shadow; u++) {
+    if(!bt->shadow[u]) continue;
+    for(v = 0; v < 1 << 10; v++) free(bt->shadow[u][v]);
+    free(bt->shadow[u]);
+  }
+
+  free(bt->buf);
+  free(bt);
+
+  emu->priv->brtrace = NULL;
+}
+
+
+/*
+ * Called at x86emu_run() start.
+ *
+ * Registers may have been changed since the last run; tell the decoder
+ * where to continue.
+ */
+void brtrace_start(x86emu_t *emu)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+  brtrace_state_t s;
+
+  brtrace_get_state(emu, &s);
+
+  if(bt->started && brtrace_same_state(&s, &bt->cur)) return;
+
+  if(!brtrace_pos(emu, X86EMU_BRTRACE_JUMP, 0)) return;
+
+  brtrace_put_state(bt, &s);
+
+  bt->cur = s;
+  bt->started = 1;
+}
+
+
+/*
+ * Called at x86emu_run() end.
+ */
+void brtrace_stop(x86emu_t *emu, unsigned rs)
+{
+  if(!brtrace_pos(emu, X86EMU_BRTRACE_STOP, 0)) return;
+
+  brtrace_num(emu->priv->brtrace, rs);
+}
+
+
+/*
+ * Port input.
+ */
+void brtrace_input(x86emu_t *emu, u32 port, u32 val, unsigned type, unsigned err)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+
+  if(!brtrace_pos(emu, X86EMU_BRTRACE_INPUT, 0)) return;
+
+  brtrace_num(bt, port);
+  bt->buf[bt->used++] = (type & 0xff) + (err ? 0x80 : 0);
+  brtrace_num(bt, val);
+}
+
+
+/*
+ * Record instruction outcome.
+ *
+ * Called after the instruction (and a pending interrupt) has been handled.
+ * What the decoder derives from the code is compared to the real outcome;
+ * a jump record fixes any difference.
+ */
+void brtrace_instr(x86emu_t *emu, unsigned intr)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+  brtrace_state_t next, pred;
+  unsigned type, taken;
+  u32 target, ret;
+
+  brtrace_code(emu);
+
+  bt->count++;
+
+  brtrace_get_state(emu, &next);
+
+  if(intr) {
+    if(!brtrace_pos(emu, X86EMU_BRTRACE_INTR, 0)) return;
+    brtrace_num(bt, emu->x86.intr_nr & 0xff);
+    brtrace_num(bt, intr & 0xff);
+    brtrace_put_state(bt, &next);
+    bt->cur = next;
+
+    return;
+  }
+
+  pred = bt->cur;
+
+  type = disasm_branch(emu->x86.instr_buf, emu->x86.instr_len, pred.code32, pred.eip, &target, &ret);
+
+  pred.eip += emu->x86.instr_len;
+
+  switch(type) {
+    case X86EMU_BRANCH_COND:
+      brtrace_bit(emu, taken = next.eip == target);
+      if(taken) pred.eip = target;
+      break;
+
+    case X86EMU_BRANCH_CALL:
+      bt->stack[bt->sp++ % BRTRACE_STACK] = ret;
+      if(bt->depth < BRTRACE_STACK) bt->depth++;
+      /* fall through */
+
+    case X86EMU_BRANCH_JUMP:
+      pred.eip = target;
+      break;
+
+    case X86EMU_BRANCH_RET:
+      if(bt->depth) {
+        bt->depth--;
+        ret = bt->stack[--bt->sp % BRTRACE_STACK];
+        brtrace_bit(emu, taken = next.eip == ret);
+        if(taken) {
+          pred.eip = ret;
+          break;
+        }
+      }
+      brtrace_flush_bits(emu);
+      if(!brtrace_reserve(emu, BRTRACE_MAX_REC)) return;
+      bt->buf[bt->used++] = X86EMU_BRTRACE_TARGET;
+      brtrace_num(bt, pred.eip = next.eip);
+      break;
+
+    case X86EMU_BRANCH_ICALL:
+      bt->stack[bt->sp++ % BRTRACE_STACK] = ret;
+      if(bt->depth < BRTRACE_STACK) bt->depth++;
+      /* fall through */
+
+    case X86EMU_BRANCH_IJUMP:
+      brtrace_flush_bits(emu);
+      if(!brtrace_reserve(emu, BRTRACE_MAX_REC)) return;
+      bt->buf[bt->used++] = X86EMU_BRTRACE_TARGET;
+      brtrace_num(bt, pred.eip = next.eip);
+      break;
+
+    case X86EMU_BRANCH_FAR:
+      brtrace_flush_bits(emu);
+      if(!brtrace_reserve(emu, BRTRACE_MAX_REC)) return;
+      bt->buf[bt->used++] = X86EMU_BRTRACE_FAR;
+      brtrace_put_state(bt, &next);
+      pred = next;
+      break;
+  }
+
+  if(!brtrace_same_state(&pred, &next) && brtrace_pos(emu, X86EMU_BRTRACE_JUMP, 0)) {
+    brtrace_put_state(bt, &next);
+  }
+
+  bt->cur = next;
+}
+
+
+/*
+ * Make sure the decoder has the code of the current instruction.
+ *
+ * Pages are sent with the instruction bytes as executed, in case the
+ * instruction has modified itself.
+ */
+void brtrace_code(x86emu_t *emu)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+  unsigned char *page, *ram;
+  unsigned u, v, len = emu->x86.instr_len, avail;
+  u32 addr = bt->cur.base + bt->cur.eip, a;
+
+  for(u = 0; u < len; u++) {
+    a = addr + u;
+    page = brtrace_shadow(bt, a, 0);
+    if(page && page[a & (X86EMU_PAGE_SIZE - 1)] == emu->x86.instr_buf[u]) continue;
+
+    if(!(page = brtrace_shadow(bt, a, 1))) return;
+
+    // send whole page if it can be read directly (not through emu->memio)
+    a &= ~(X86EMU_PAGE_SIZE - 1);
+    ram = x86emu_get_ptr(emu, a, X86EMU_PAGE_SIZE, 0, &avail);
+    if(ram && avail == X86EMU_PAGE_SIZE) {
+      for(v = 0; v < X86EMU_PAGE_SIZE; v++) {
+        page[v] = a + v - addr < len ? emu->x86.instr_buf[a + v - addr] : ram[v];
+      }
+
+      if(!brtrace_pos(emu, X86EMU_BRTRACE_PAGE, X86EMU_PAGE_SIZE)) return;
+      brtrace_num(bt, a >> X86EMU_PAGE_BITS);
+      memcpy(bt->buf + bt->used, page, X86EMU_PAGE_SIZE);
+      bt->used += X86EMU_PAGE_SIZE;
+
+      continue;
+    }
+
+    // else just the remaining instruction bytes
+    for(v = u; v < len; v++) {
+      if(!(page = brtrace_shadow(bt, addr + v, 1))) return;
+      page[(addr + v) & (X86EMU_PAGE_SIZE - 1)] = emu->x86.instr_buf[v];
+    }
+
+    if(!brtrace_pos(emu, X86EMU_BRTRACE_CODE, len - u)) return;
+    brtrace_num(bt, addr + u);
+    brtrace_num(bt, len - u);
+    memcpy(bt->buf + bt->used, emu->x86.instr_buf + u, len - u);
+    bt->used += len - u;
+
+    break;
+  }
+}
+
+
+/*
+ * Get shadow copy of code page with addr, optionally allocate it.
+ *
+ * Bytes not yet in the trace are 0, as in the decoder.
+ */
+unsigned char *brtrace_shadow(struct x86emu_brtrace_s *bt, u32 addr, int create)
+{
+  unsigned char ***dir = bt->shadow + (addr >> (X86EMU_PAGE_BITS + 10));
+  unsigned char **page;
+
+  if(!*dir && (!create || !(*dir = calloc(1 << 10, sizeof **dir)))) return NULL;
+
+  page = *dir + ((addr >> X86EMU_PAGE_BITS) & 0x3ff);
+
+  if(!*page && (!create || !(*page = calloc(1, X86EMU_PAGE_SIZE)))) return NULL;
+
+  return *page;
+}
+
+
+/*
+ * Ensure len bytes of free buffer space.
+ *
+ * Returns 0 if there is not enough space.
+ */
+int brtrace_reserve(x86emu_t *emu, unsigned len)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+
+  if(bt->size - bt->used >= len) return 1;
+
+  if(bt->used) bt->flush(emu, (char *) bt->buf, bt->used);
+  bt->used = 0;
+
+  return bt->size >= len;
+}
+
+
+/*
+ * Add number, LEB128 encoded.
+ */
+void brtrace_num(struct x86emu_brtrace_s *bt, u64 val)
+{
+  while(val >= 0x80) {
+    bt->buf[bt->used++] = (val & 0x7f) | 0x80;
+    val >>= 7;
+  }
+
+  bt->buf[bt->used++] = val;
+}
+
+
+/*
+ * Add taken/not taken bit.
+ */
+void brtrace_bit(x86emu_t *emu, unsigned bit)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+
+  bt->tnt = (bt->tnt << 1) + bit;
+
+  if(bt->tnt >= 0x40) brtrace_flush_bits(emu);
+}
+
+
+/*
+ * Write pending taken/not taken bits.
+ */
+void brtrace_flush_bits(x86emu_t *emu)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+
+  if(bt->tnt <= 1 || !brtrace_reserve(emu, 1)) return;
+
+  bt->buf[bt->used++] = 0x80 + bt->tnt;
+  bt->tnt = 1;
+}
+
+
+/*
+ * Start positioned record; len is the size of additional raw data.
+ *
+ * Returns 0 if there is not enough space.
+ */
+int brtrace_pos(x86emu_t *emu, unsigned type, unsigned len)
+{
+  struct x86emu_brtrace_s *bt = emu->priv->brtrace;
+
+  brtrace_flush_bits(emu);
+
+  if(!brtrace_reserve(emu, BRTRACE_MAX_REC + len)) return 0;
+
+  bt->buf[bt->used++] = type;
+  brtrace_num(bt, bt->count - bt->last_pos);
+  bt->last_pos = bt->count;
+
+  return 1;
+}
+
+
+void brtrace_put_state(struct x86emu_brtrace_s *bt, brtrace_state_t *s)
+{
+  brtrace_num(bt, s->cs);
+  brtrace_num(bt, s->base);
+  brtrace_num(bt, s->code32);
+  brtrace_num(bt, s->eip);
+}
+
+
+void brtrace_get_state(x86emu_t *emu, brtrace_state_t *s)
+{
+  s->cs = emu->x86.R_CS;
+  s->base = emu->x86.R_CS_BASE;
+  s->code32 = ACC_D(emu->x86.R_CS_ACC) ? 1 : 0;
+  s->eip = emu->x86.R_EIP;
+}
+
+
+int brtrace_same_state(brtrace_state_t *s1, brtrace_state_t *s2)
+{
+  return s1->eip == s2->eip && s1->cs == s2->cs && s1->base == s2->base && s1->code32 == s2->code32;
+}
@@ -0,0 +1,272 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Binary trace format (X86EMU_TRACE_BINARY). Instead of formatting text,
+*   trace events are stored as fixed-size records in the log buffer. See
+*   tools/x86emu-btrace.c for a decoder.
+*
+*   Each flushed log buffer starts without delta base, so it can be decoded
+*   on its own.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static int btrace_reserve(x86emu_t *emu);
+static void btrace_put(x86emu_t *emu, unsigned type, unsigned info, unsigned delta, u32 val);
+static void btrace_put_bytes(x86emu_t *emu, unsigned type, const void *buf, unsigned len);
+static unsigned btrace_addr(x86emu_t *emu, unsigned idx, u32 addr);
+
+
+/*
+ * Log the current instruction.
+ */
+void btrace_code(x86emu_t *emu)
+{
+  struct x86emu_btrace_s *bt;
+  unsigned u, len, delta;
+  u32 val;
+#if WITH_TSC
+  u64 t;
+#endif
+
+  if(!btrace_reserve(emu)) return;
+
+  bt = emu->priv->btrace;
+
+  if(!(bt->valid & BTRACE_VALID_CS) || bt->cs != emu->x86.saved_cs) {
+    btrace_put(emu, X86EMU_BTRACE_CS, 0, 0, emu->x86.saved_cs);
+  }
+
+  if(!(bt->valid & BTRACE_VALID_TSC) || emu->x86.R_TSC != bt->tsc + 1) {
+    btrace_put(emu, X86EMU_BTRACE_TSC, 0, emu->x86.R_TSC >> 32, emu->x86.R_TSC);
+  }
+
+  bt->cs = emu->x86.saved_cs;
+  bt->tsc = emu->x86.R_TSC;
+  bt->valid |= BTRACE_VALID_CS | BTRACE_VALID_TSC;
+
+#if WITH_TSC
+  if(emu->log.trace & X86EMU_TRACE_TIME) {
+    t = emu->x86.R_REAL_TSC - emu->x86.R_LAST_REAL_TSC;
+    btrace_put(emu, X86EMU_BTRACE_TIME, 0, t >> 32, t);
+  }
+#endif
+
+  delta = btrace_addr(emu, X86EMU_BTRACE_ADDR_EIP, emu->x86.saved_eip);
+
+  len = emu->x86.instr_len;
+  for(val = u = 0; u < len && u < 4; u++) {
+    val += (u32) emu->x86.instr_buf[u] << (u * 8);
+  }
+
+  btrace_put(emu, X86EMU_BTRACE_CODE, len + (MODE_CODE32 ? 0x80 : 0), delta, val);
+
+  for(u = 4; u < len; u += 6) {
+    btrace_put_bytes(emu, X86EMU_BTRACE_BYTES, emu->x86.instr_buf + u, len - u > 6 ? 6 : len - u);
+  }
+}
+
+
+/*
+ * Log register state; same order as the text log.
+ */
+void btrace_regs(x86emu_t *emu)
+{
+  u32 reg[16];
+  unsigned u;
+
+  if(!btrace_reserve(emu)) return;
+
+  reg[0] = emu->x86.R_EAX;
+  reg[1] = emu->x86.R_EBX;
+  reg[2] = emu->x86.R_ECX;
+  reg[3] = emu->x86.R_EDX;
+  reg[4] = emu->x86.R_ESI;
+  reg[5] = emu->x86.R_EDI;
+  reg[6] = emu->x86.R_EBP;
+  reg[7] = emu->x86.R_ESP;
+  reg[8] = emu->x86.R_CS;
+  reg[9] = emu->x86.R_SS;
+  reg[10] = emu->x86.R_DS;
+  reg[11] = emu->x86.R_ES;
+  reg[12] = emu->x86.R_FS;
+  reg[13] = emu->x86.R_GS;
+  reg[14] = emu->x86.R_EIP;
+  reg[15] = emu->x86.R_EFLG;
+
+  for(u = 0; u < sizeof reg / sizeof *reg; u++) {
+    btrace_put(emu, X86EMU_BTRACE_REG, u, 0, reg[u]);
+  }
+}
+
+
+/*
+ * Log memory or i/o access; type is X86EMU_MEMIO_*.
+ */
+void btrace_memio(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err)
+{
+  unsigned bits = type & 0xff, delta;
+
+  if(!btrace_reserve(emu)) return;
+
+  type &= ~0xff;
+
+  delta = btrace_addr(emu, type >= X86EMU_MEMIO_I ? X86EMU_BTRACE_ADDR_IO : X86EMU_BTRACE_ADDR_MEM, addr);
+
+  btrace_put(emu, X86EMU_BTRACE_MEMIO, (type >> 8) + (bits << 4) + (err ? 0x80 : 0), delta, err ? 0 : val);
+}
+
+
+/*
+ * Log segment access check; seg is the segment register index.
+ */
+void btrace_acc(x86emu_t *emu, unsigned seg, u32 ofs, unsigned size)
+{
+  if(!btrace_reserve(emu)) return;
+
+  btrace_put(emu, X86EMU_BTRACE_ACC, size + (seg << 4), 0, ofs);
+}
+
+
+void btrace_descr(x86emu_t *emu, u32 dl, u32 dh)
+{
+  if(!btrace_reserve(emu)) return;
+
+  btrace_put(emu, X86EMU_BTRACE_DESCR, 0, 0, dl);
+  btrace_put(emu, X86EMU_BTRACE_DESCR, 1, 0, dh);
+}
+
+
+void btrace_intr(x86emu_t *emu, unsigned nr, unsigned type)
+{
+  if(!btrace_reserve(emu)) return;
+
+  btrace_put(emu, X86EMU_BTRACE_INTR, type & 0xff, 0, nr);
+}
+
+
+/*
+ * Log free-form text, in chunks of 6 bytes.
+ */
+void btrace_text(x86emu_t *emu, const char *s, unsigned len)
+{
+  unsigned u;
+
+  for(; len; s += u, len -= u) {
+    if(!btrace_reserve(emu)) return;
+    u = len > 6 ? 6 : len;
+    btrace_put_bytes(emu, X86EMU_BTRACE_TEXT, s, u);
+  }
+}
+
+
+/*
+ * Log x86emu_run() result.
+ */
+void btrace_run(x86emu_t *emu, unsigned rs)
+{
+  if(!btrace_reserve(emu)) return;
+
+  btrace_put(emu, X86EMU_BTRACE_RUN, 0, 0, rs);
+}
+
+
+/*
+ * Ensure there's space for BTRACE_MAX_RECS records, flushing the log if
+ * necessary.
+ *
+ * Returns 1 if ok, else 0.
+ */
+int btrace_reserve(x86emu_t *emu)
+{
+  unsigned lf;
+
+  if(!emu->log.ptr) return 0;
+
+  if(!emu->priv->btrace && !(emu->priv->btrace = calloc(1, sizeof *emu->priv->btrace))) return 0;
+
+  lf = LOG_FREE(emu);
+  if(lf <= BTRACE_MAX_RECS * X86EMU_BTRACE_REC_SIZE) lf = x86emu_clear_log(emu, 1);
+
+  return lf > BTRACE_MAX_RECS * X86EMU_BTRACE_REC_SIZE;
+}
+
+
+void btrace_put(x86emu_t *emu, unsigned type, unsigned info, unsigned delta, u32 val)
+{
+  unsigned char *p = (unsigned char *) emu->log.ptr;
+
+  p[0] = type;
+  p[1] = info;
+  p[2] = delta;
+  p[3] = delta >> 8;
+  p[4] = val;
+  p[5] = val >> 8;
+  p[6] = val >> 16;
+  p[7] = val >> 24;
+
+  emu->log.ptr += X86EMU_BTRACE_REC_SIZE;
+}
+
+
+void btrace_put_bytes(x86emu_t *emu, unsigned type, const void *buf, unsigned len)
+{
+  unsigned char *p = (unsigned char *) emu->log.ptr;
+
+  p[0] = type;
+  p[1] = len;
+  memcpy(p + 2, buf, len);
+  memset(p + 2 + len, 0, X86EMU_BTRACE_REC_SIZE - 2 - len);
+
+  emu->log.ptr += X86EMU_BTRACE_REC_SIZE;
+}
+
+
+/*
+ * Get address delta to previous address of the same kind (idx is
+ * X86EMU_BTRACE_ADDR_*). If it doesn't fit into 16 bits, log a new base
+ * address.
+ */
+unsigned btrace_addr(x86emu_t *emu, unsigned idx, u32 addr)
+{
+  struct x86emu_btrace_s *bt = emu->priv->btrace;
+  u32 delta = addr - bt->addr[idx];
+
+  if(!(bt->valid & (1 << idx)) || delta + 0x8000 > 0xffff) {
+    btrace_put(emu, X86EMU_BTRACE_ADDR, idx, 0, addr);
+    delta = 0;
+  }
+
+  bt->addr[idx] = addr;
+  bt->valid |= 1 << idx;
+
+  return delta & 0xffff;
+}
@@ -0,0 +1,445 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Call-graph profiler. Calls, interrupts, and the matching returns are
+*   tracked in a shadow stack; instructions and host time are accounted
+*   to the nodes of a calling context tree.
+*
+*   A return is matched by the stack address of its return address. Frames
+*   below the current stack pointer are considered left.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static void cg_charge(struct x86emu_cg_s *cg, u64 tsc, u64 ns);
+static void cg_leave(struct x86emu_cg_s *cg, u64 tsc, u64 ns);
+static unsigned cg_child(struct x86emu_cg_s *cg, unsigned parent, u32 addr);
+static u32 cg_sp(x86emu_t *emu);
+static int cg_sym_cmp(const void *a, const void *b);
+static char *cg_name(struct x86emu_cg_s *cg, unsigned node);
+static int cg_write_callgrind(struct x86emu_cg_s *cg, FILE *f);
+static int cg_write_pprof(struct x86emu_cg_s *cg, FILE *f);
+
+
+/*
+ * Turn call-graph profiling on or off. Turning it on again clears all data.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_callgraph(x86emu_t *emu, int on)
+{
+  struct x86emu_cg_s *cg;
+
+  if(!emu) return -1;
+
+  emu->priv->cg = cg_free(emu->priv->cg);
+
+  if(!on) return 0;
+
+  if(!(cg = calloc(1, sizeof *cg))) return -1;
+
+  cg->max = 256;
+  if(!(cg->node = calloc(cg->max, sizeof *cg->node))) {
+    free(cg);
+    return -1;
+  }
+
+  cg->nodes = 1;
+  cg->tsc = emu->x86.R_TSC;
+  cg->ns = cg->stop_ns = host_ns();
+
+  emu->priv->cg = cg;
+
+  return 0;
+}
+
+
+/*
+ * Load function names. Each line is 'addr name', 'addr type name' (nm
+ * output), or 'seg:ofs name'; addresses are hex. Other lines are skipped.
+ *
+ * Returns number of symbols read or -1.
+ */
+API_SYM int x86emu_load_symbols(x86emu_t *emu, const char *file)
+{
+  struct x86emu_cg_s *cg;
+  FILE *f;
+  char buf[512], s1[64], s2[256], s3[256], *name, *start, *end;
+  unsigned long addr;
+  unsigned n = 0;
+  int i;
+  cg_sym_t *sym;
+
+  if(!emu || !(cg = emu->priv->cg) || !file) return -1;
+
+  if(!(f = fopen(file, "r"))) return -1;
+
+  while(fgets(buf, sizeof buf, f)) {
+    if((i = sscanf(buf, "%63s %255s %255s", s1, s2, s3)) < 2) continue;
+
+    name = i == 3 && !s2[1] ? s3 : s2;
+
+    addr = strtoul(start = s1, &end, 16);
+    if(*end == ':' && end != start) {
+      addr = (addr << 4) + strtoul(start = end + 1, &end, 16);
+    }
+    if(*end || end == start) continue;
+
+    if(!(sym = realloc(cg->sym, (cg->syms + 1) * sizeof *sym))) break;
+    cg->sym = sym;
+    sym += cg->syms;
+    if(!(sym->name = strdup(name))) break;
+    sym->addr = addr;
+    cg->syms++;
+    n++;
+  }
+
+  fclose(f);
+
+  qsort(cg->sym, cg->syms, sizeof *cg->sym, cg_sym_cmp);
+
+  return n;
+}
+
+
+/*
+ * Write call graph; format is X86EMU_CG_CALLGRIND or X86EMU_CG_PPROF.
+ *
+ * Functions still active are accounted up to now.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_write_callgraph(x86emu_t *emu, const char *file, unsigned format)
+{
+  struct x86emu_cg_s *cg;
+  FILE *f;
+  int err;
+
+  if(!emu || !emu->priv->cg || !file || format > X86EMU_CG_PPROF) return -1;
+
+  if(!(cg = cg_clone(emu->priv->cg))) return -1;
+
+  cg_charge(cg, emu->x86.R_TSC, cg->stop_ns - cg->ns_ofs);
+  while(cg->depth) cg_leave(cg, emu->x86.R_TSC, cg->stop_ns - cg->ns_ofs);
+
+  if((f = fopen(file, "w"))) {
+    err = format == X86EMU_CG_PPROF ? cg_write_pprof(cg, f) : cg_write_callgrind(cg, f);
+    if(fclose(f)) err = -1;
+  }
+  else {
+    err = -1;
+  }
+
+  cg_free(cg);
+
+  return err;
+}
+
+
+/*
+ * Called at start of x86emu_run(): don't account time spent outside.
+ */
+void cg_start(x86emu_t *emu)
+{
+  emu->priv->cg->ns_ofs += host_ns() - emu->priv->cg->stop_ns;
+}
+
+
+/*
+ * Called at end of x86emu_run().
+ */
+void cg_stop(x86emu_t *emu)
+{
+  emu->priv->cg->stop_ns = host_ns();
+}
+
+
+/*
+ * Called after a call instruction or interrupt has been executed.
+ */
+void cg_call(x86emu_t *emu)
+{
+  struct x86emu_cg_s *cg = emu->priv->cg;
+  u64 tsc = emu->x86.R_TSC + 1, ns = host_ns() - cg->ns_ofs;
+  u32 sp = cg_sp(emu);
+  unsigned n;
+
+  cg_charge(cg, tsc, ns);
+
+  while(cg->depth && cg->frame[cg->depth - 1].sp <= sp) cg_leave(cg, tsc, ns);
+
+  if(cg->depth >= CG_DEPTH) {
+    cg->lost++;
+    return;
+  }
+
+  if(!(n = cg_child(cg, cg->cur, emu->x86.R_CS_BASE + emu->x86.R_EIP))) return;
+
+  cg->node[n].calls++;
+  cg->frame[cg->depth].sp = sp;
+  cg->frame[cg->depth].node = n;
+  cg->frame[cg->depth].tsc = tsc;
+  cg->frame[cg->depth++].ns = ns;
+  cg->cur = n;
+}
+
+
+/*
+ * Called before a ret, retf, or iret instruction pops the return address.
+ */
+void cg_ret(x86emu_t *emu)
+{
+  struct x86emu_cg_s *cg = emu->priv->cg;
+  u64 tsc = emu->x86.R_TSC + 1, ns = host_ns() - cg->ns_ofs;
+  u32 sp = cg_sp(emu);
+
+  cg_charge(cg, tsc, ns);
+
+  while(cg->depth && cg->frame[cg->depth - 1].sp < sp) cg_leave(cg, tsc, ns);
+
+  if(cg->depth && cg->frame[cg->depth - 1].sp == sp) cg_leave(cg, tsc, ns);
+}
+
+
+/*
+ * Account time since last call or return to current node.
+ */
+void cg_charge(struct x86emu_cg_s *cg, u64 tsc, u64 ns)
+{
+  cg->node[cg->cur].self_instrs += tsc - cg->tsc;
+  cg->node[cg->cur].self_ns += ns - cg->ns;
+  cg->tsc = tsc;
+  cg->ns = ns;
+}
+
+
+/*
+ * Leave topmost frame.
+ */
+void cg_leave(struct x86emu_cg_s *cg, u64 tsc, u64 ns)
+{
+  cg_frame_t *f = cg->frame + --cg->depth;
+
+  cg->node[f->node].instrs += tsc - f->tsc;
+  cg->node[f->node].ns += ns - f->ns;
+  cg->cur = cg->node[f->node].parent;
+}
+
+
+/*
+ * Find (or add) child node for function at addr.
+ *
+ * Returns node index or 0 if out of memory.
+ */
+unsigned cg_child(struct x86emu_cg_s *cg, unsigned parent, u32 addr)
+{
+  cg_node_t *node;
+  unsigned n;
+
+  for(n = cg->node[parent].child; n; n = cg->node[n].next) {
+    if(cg->node[n].addr == addr) return n;
+  }
+
+  if(cg->nodes == cg->max) {
+    if(!(node = realloc(cg->node, 2 * cg->max * sizeof *node))) return 0;
+    cg->node = node;
+    cg->max *= 2;
+  }
+
+  n = cg->nodes++;
+  node = cg->node + n;
+  memset(node, 0, sizeof *node);
+  node->addr = addr;
+  node->parent = parent;
+  node->next = cg->node[parent].child;
+  cg->node[parent].child = n;
+
+  return n;
+}
+
+
+/*
+ * Linear stack address.
+ */
+u32 cg_sp(x86emu_t *emu)
+{
+  return emu->x86.R_SS_BASE + (MODE_STACK32 ? emu->x86.R_ESP : emu->x86.R_SP);
+}
+
+
+int cg_sym_cmp(const void *a, const void *b)
+{
+  const cg_sym_t *s1 = a, *s2 = b;
+
+  return s1->addr < s2->addr ? -1 : s1->addr > s2->addr;
+}
+
+
+/*
+ * Function name of node; 'sym+ofs' if there's no exact match.
+ *
+ * Returns pointer to static buffer.
+ */
+char *cg_name(struct x86emu_cg_s *cg, unsigned node)
+{
+  static char buf[300];
+  u32 addr = cg->node[node].addr;
+  unsigned lo = 0, hi = cg->syms, mid;
+
+  if(!node) return "[root]";
+
+  /* find last symbol <= addr */
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(cg->sym[mid].addr <= addr) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if(!lo) {
+    snprintf(buf, sizeof buf, "0x%05x", addr);
+  }
+  else if(cg->sym[lo - 1].addr == addr) {
+    snprintf(buf, sizeof buf, "%s", cg->sym[lo - 1].name);
+  }
+  else {
+    snprintf(buf, sizeof buf, "%s+0x%x", cg->sym[lo - 1].name, addr - cg->sym[lo - 1].addr);
+  }
+
+  return buf;
+}
+
+
+/*
+ * Callgrind format; positions are instruction addresses.
+ */
+int cg_write_callgrind(struct x86emu_cg_s *cg, FILE *f)
+{
+  cg_node_t *node;
+  unsigned u, n;
+  u64 instrs = 0, ns = 0;
+
+  for(u = 0; u < cg->nodes; u++) {
+    instrs += cg->node[u].self_instrs;
+    ns += cg->node[u].self_ns;
+  }
+
+  fprintf(f,
+    "# callgrind format\nversion: 1\ncreator: libx86emu\npositions: instr\nevents: Instr ns\n"
+    "totals: %llu %llu\n",
+    (unsigned long long) instrs, (unsigned long long) ns
+  );
+
+  for(u = 0; u < cg->nodes; u++) {
+    node = cg->node + u;
+    fprintf(f, "\nfn=%s\n", cg_name(cg, u));
+    fprintf(f, "0x%x %llu %llu\n", node->addr, (unsigned long long) node->self_instrs, (unsigned long long) node->self_ns);
+    for(n = node->child; n; n = cg->node[n].next) {
+      fprintf(f, "cfn=%s\n", cg_name(cg, n));
+      fprintf(f, "calls=%llu 0x%x\n", (unsigned long long) cg->node[n].calls, cg->node[n].addr);
+      fprintf(f,
+        "0x%x %llu %llu\n",
+        node->addr, (unsigned long long) cg->node[n].instrs, (unsigned long long) cg->node[n].ns
+      );
+    }
+  }
+
+  return ferror(f) ? -1 : 0;
+}
+
+
+/*
+ * Legacy pprof CPU profile (see x86emu_write_profile()): one sample per
+ * node with the instruction count as weight; the stack consists of the
+ * function entry addresses (0 for the root node).
+ */
+int cg_write_pprof(struct x86emu_cg_s *cg, FILE *f)
+{
+  u64 pc[CG_DEPTH];
+  unsigned u, n, depth;
+  int err;
+
+  /* one 'sample' per instruction, see prof_pprof_header() */
+  err = prof_pprof_header(f, 1);
+
+  for(u = 0; u < cg->nodes && !err; u++) {
+    if(!cg->node[u].self_instrs) continue;
+    for(depth = 0, n = u; n && depth < CG_DEPTH; n = cg->node[n].parent) pc[depth++] = cg->node[n].addr;
+    /* root */
+    if(!depth) pc[depth++] = 0;
+    err = prof_pprof_sample(f, cg->node[u].self_instrs, depth, pc);
+  }
+
+  if(!err) err = prof_pprof_trailer(f);
+
+  return err;
+}
+
+
+struct x86emu_cg_s *cg_clone(struct x86emu_cg_s *cg)
+{
+  struct x86emu_cg_s *new_cg;
+  unsigned u;
+
+  if(!(new_cg = mem_dup(cg, sizeof *cg))) return NULL;
+
+  new_cg->node = mem_dup(cg->node, cg->max * sizeof *cg->node);
+  new_cg->sym = mem_dup(cg->sym, cg->syms * sizeof *cg->sym);
+
+  if(!new_cg->node || (cg->syms && !new_cg->sym)) {
+    free(new_cg->node);
+    free(new_cg->sym);
+    free(new_cg);
+    return NULL;
+  }
+
+  for(u = 0; u < cg->syms; u++) new_cg->sym[u].name = strdup(cg->sym[u].name);
+
+  return new_cg;
+}
+
+
+struct x86emu_cg_s *cg_free(struct x86emu_cg_s *cg)
+{
+  unsigned u;
+
+  if(cg) {
+    for(u = 0; u < cg->syms; u++) free(cg->sym[u].name);
+    free(cg->sym);
+    free(cg->node);
+    free(cg);
+  }
+
+  return NULL;
+}
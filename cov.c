@@ -0,0 +1,228 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Code coverage: hit counters per basic block (or instruction) and an
+*   AFL-style edge bitmap.
+*
+*   A basic block starts wherever the code flow is not sequential (jumps,
+*   calls, returns, interrupts, repeated string instructions). Locations
+*   are counted when they are entered.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+#define COV_HASH(a)	((a) * 0x9e3779b1u)
+
+static void cov_count(struct x86emu_cov_s *cov, u32 addr);
+
+
+/*
+ * Enable coverage counters; flags is a combination of X86EMU_COV_*, 0 turns
+ * coverage off.
+ *
+ * bitmap_size is the size of the edge bitmap (X86EMU_COV_EDGES), rounded up
+ * to a power of 2; 0 means 64k.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_coverage(x86emu_t *emu, unsigned flags, unsigned bitmap_size)
+{
+  struct x86emu_cov_s *cov;
+  unsigned u;
+
+  if(!emu) return -1;
+
+  emu->priv->cov = cov_free(emu->priv->cov);
+
+  if(!flags) return 0;
+
+  if(!(cov = calloc(1, sizeof *cov))) return -1;
+
+  cov->flags = flags;
+
+  if((flags & (X86EMU_COV_BLOCKS | X86EMU_COV_INSTRS))) {
+    cov->size = 1024;
+    if(!(cov->entry = calloc(cov->size, sizeof *cov->entry))) {
+      cov_free(cov);
+
+      return -1;
+    }
+  }
+
+  if((flags & X86EMU_COV_EDGES)) {
+    if(!bitmap_size) bitmap_size = 1 << 16;
+    for(u = 1; u < bitmap_size && u < (1u << 28); u <<= 1);
+    cov->bitmap_size = u;
+    if(!(cov->bitmap = calloc(1, u))) {
+      cov_free(cov);
+
+      return -1;
+    }
+  }
+
+  emu->priv->cov = cov;
+
+  return 0;
+}
+
+
+/*
+ * Get coverage data: hash table of counters (size entries) and edge bitmap.
+ *
+ * The data are valid until the next x86emu_run() or x86emu_set_coverage()
+ * call.
+ */
+API_SYM const x86emu_cov_entry_t *x86emu_get_coverage(x86emu_t *emu, unsigned *size, const u8 **bitmap, unsigned *bitmap_size)
+{
+  struct x86emu_cov_s *cov = emu ? emu->priv->cov : NULL;
+
+  if(size) *size = cov ? cov->size : 0;
+  if(bitmap) *bitmap = cov ? cov->bitmap : NULL;
+  if(bitmap_size) *bitmap_size = cov ? cov->bitmap_size : 0;
+
+  return cov ? cov->entry : NULL;
+}
+
+
+/*
+ * Clear counters and edge bitmap.
+ */
+API_SYM void x86emu_reset_coverage(x86emu_t *emu)
+{
+  struct x86emu_cov_s *cov;
+
+  if(!emu || !(cov = emu->priv->cov)) return;
+
+  if(cov->entry) memset(cov->entry, 0, cov->size * sizeof *cov->entry);
+  if(cov->bitmap) memset(cov->bitmap, 0, cov->bitmap_size);
+
+  cov->entries = 0;
+  cov->prev = 0;
+  cov->started = 0;
+}
+
+
+/*
+ * Count block at current cs:eip when the emulation is started for the first
+ * time.
+ */
+void cov_start(x86emu_t *emu)
+{
+  if(!emu->priv->cov->started) {
+    emu->priv->cov->started = 1;
+    cov_update(emu);
+  }
+}
+
+
+/*
+ * Called after an instruction with non-sequential code flow (or after every
+ * instruction with X86EMU_COV_INSTRS).
+ */
+void cov_update(x86emu_t *emu)
+{
+  struct x86emu_cov_s *cov = emu->priv->cov;
+  u32 addr = emu->x86.R_CS_BASE + emu->x86.R_EIP, cur;
+
+  if(cov->entry) cov_count(cov, addr);
+
+  if(
+    cov->bitmap && (
+      !(cov->flags & X86EMU_COV_INSTRS) ||
+      emu->x86.R_EIP != emu->x86.saved_eip + emu->x86.instr_len ||
+      emu->x86.R_CS != emu->x86.saved_cs
+    )
+  ) {
+    cur = (COV_HASH(addr) >> 8) & (cov->bitmap_size - 1);
+    cov->bitmap[cur ^ cov->prev]++;
+    cov->prev = cur >> 1;
+  }
+}
+
+
+struct x86emu_cov_s *cov_clone(struct x86emu_cov_s *cov)
+{
+  struct x86emu_cov_s *new_cov;
+
+  new_cov = mem_dup(cov, sizeof *cov);
+  new_cov->entry = mem_dup(cov->entry, cov->size * sizeof *cov->entry);
+  new_cov->bitmap = mem_dup(cov->bitmap, cov->bitmap_size);
+
+  return new_cov;
+}
+
+
+struct x86emu_cov_s *cov_free(struct x86emu_cov_s *cov)
+{
+  if(cov) {
+    free(cov->entry);
+    free(cov->bitmap);
+    free(cov);
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Increment counter for addr; grow hash table if it gets more than half
+ * full.
+ */
+void cov_count(struct x86emu_cov_s *cov, u32 addr)
+{
+  x86emu_cov_entry_t *entry, *e;
+  unsigned u, mask = cov->size - 1, idx;
+
+  for(idx = COV_HASH(addr) & mask; (e = cov->entry + idx)->count; idx = (idx + 1) & mask) {
+    if(e->addr == addr) {
+      if(e->count != ~0u) e->count++;
+      return;
+    }
+  }
+
+  if(2 * (cov->entries + 1) > cov->size) {
+    if(!(entry = calloc(2 * cov->size, sizeof *entry))) return;
+    mask = 2 * cov->size - 1;
+    for(u = 0; u < cov->size; u++) {
+      if(!cov->entry[u].count) continue;
+      for(idx = COV_HASH(cov->entry[u].addr) & mask; entry[idx].count; idx = (idx + 1) & mask);
+      entry[idx] = cov->entry[u];
+    }
+    free(cov->entry);
+    cov->entry = entry;
+    cov->size *= 2;
+    for(idx = COV_HASH(addr) & mask; (e = cov->entry + idx)->count; idx = (idx + 1) & mask);
+  }
+
+  e->addr = addr;
+  e->count = 1;
+  cov->entries++;
+}
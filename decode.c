@@ -44,11 +44,16 @@
 static void handle_interrupt(x86emu_t *emu);
 static void generate_int(x86emu_t *emu, u8 nr, unsigned type, unsigned errcode);
 static void log_regs(x86emu_t *emu);
-static void log_code(x86emu_t *emu);
+static int log_regs_delta(x86emu_t *emu);
+static void log_flags(x86emu_t *emu);
+static void log_code(x86emu_t *emu, unsigned intr);
 static void check_data_access(x86emu_t *emu, sel_t *seg, u32 ofs, u32 size);
 static unsigned decode_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
-static unsigned emu_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
 static void idt_lookup(x86emu_t *emu, u8 nr, u32 *new_cs, u32 *new_eip);
+static void poll_start(x86emu_t *emu, unsigned flags);
+static void poll_check(x86emu_t *emu);
+static void poll_access(x86emu_t *emu, u32 addr, u32 val, unsigned type);
+static int poll_observed(x86emu_t *emu);
 
 
 /****************************************************************************
@@ -61,7 +66,7 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
   u8 op1, u_m1;
   s32 ofs32;
   char **p;
-  unsigned u, rs = 0;
+  unsigned u, intr, rs = 0;
   time_t t0;
   int has_prefix;
 #if WITH_TSC
@@ -82,6 +87,18 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
   emu->io.iopl_ok = 1;
 #endif
 
+  emu->priv->trace = emu->log.trace;
+
+  if(emu->priv->poll || (flags & X86EMU_RUN_POLL)) poll_start(emu, flags);
+
+  if(emu->priv->cov) cov_start(emu);
+
+  if(emu->priv->cg) cg_start(emu);
+
+  if(emu->priv->event) event_start(emu);
+
+  if(emu->priv->brtrace) brtrace_start(emu);
+
   for(;;) {
     *(emu->x86.disasm_ptr = emu->x86.disasm_buf) = 0;
 
@@ -96,14 +113,26 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
       emu->x86.mode |= _MODE_STACK32;
     }
 
+    if(EVENT_ON(emu, X86EMU_EVENT_MODE)) event_mode(emu);
+
     emu->x86.default_seg = NULL;
 
     /* save EIP and CS values */
     emu->x86.saved_cs = emu->x86.R_CS;
     emu->x86.saved_eip = emu->x86.R_EIP;
 
+    emu->priv->trace = emu->log.trace;
+    if(emu->priv->filter) filter_update(emu);
+
     log_regs(emu);
 
+    if(
+      emu->priv->prof &&
+      ((emu->priv->prof->flags & X86EMU_PROF_REAL_TIME) ? emu->x86.R_REAL_TSC : emu->x86.R_TSC) >= emu->priv->prof->next
+    ) {
+      prof_sample(emu);
+    }
+
     if(
       (flags & X86EMU_RUN_MAX_INSTR) &&
       emu->max_instr &&
@@ -124,12 +153,14 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
     }
 
     if(emu->code_check) {
-      if((*emu->code_check)(emu) || MODE_HALTED) {
+      if((emu->priv->perf ? perf_code_check(emu) : (*emu->code_check)(emu)) || MODE_HALTED) {
         rs |= X86EMU_RUN_NO_CODE;
         break;
       }
     }
 
+    if(emu->priv->journal && emu->priv->journal->mode == X86EMU_JOURNAL_REPLAY) journal_replay_intr(emu);
+
     memcpy(emu->x86.decode_seg, "[", 1);
 
     /* handle prefixes here */
@@ -189,6 +220,11 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
       break;
     }
 
+    if(PERF_ON(emu, X86EMU_PERF_INSTR)) {
+      emu->priv->perf->c.instrs++;
+      emu->priv->perf->c.prefixes += emu->x86.R_EIP - emu->x86.saved_eip - 1;
+    }
+
     if(flags & X86EMU_RUN_LOOP) {
       u = emu->x86.R_CS_BASE + emu->x86.R_EIP;
 
@@ -238,14 +274,36 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
 
     *emu->x86.disasm_ptr = 0;
 
+    if(emu->priv->recorder) recorder_instr(emu);
+
+    if(EVENT_ON(emu, X86EMU_EVENT_INSTR)) event_instr(emu);
+
+    if(emu->priv->poll && emu->priv->poll->active) poll_check(emu);
+
+    if(emu->priv->dev && emu->x86.R_TSC >= emu->priv->dev->next_event) dev_update(emu);
+
+    intr = emu->x86.intr_type;
+
     handle_interrupt(emu);
 
+    if(emu->priv->brtrace) brtrace_instr(emu, intr);
+
+    if(
+      emu->priv->cov && (
+        (emu->priv->cov->flags & X86EMU_COV_INSTRS) ||
+        emu->x86.R_EIP != emu->x86.saved_eip + emu->x86.instr_len ||
+        emu->x86.R_CS != emu->x86.saved_cs
+      )
+    ) {
+      cov_update(emu);
+    }
+
 #if WITH_TSC
     emu->x86.R_LAST_REAL_TSC = emu->x86.R_REAL_TSC;
     emu->x86.R_REAL_TSC = tsc() - tsc_ofs;
 #endif
 
-    log_code(emu);
+    log_code(emu, intr);
 
     if(emu->x86.debug_len) {
       emu_process_debug(emu, emu->x86.debug_start, emu->x86.debug_len);
@@ -257,7 +315,22 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
     if(MODE_HALTED) break;
   }
 
-  if(*p) {
+  if(emu->priv->poll) emu->priv->poll->active = 0;
+
+  if(emu->priv->cg) cg_stop(emu);
+
+  if(emu->priv->event) emu->priv->event->active = 0;
+
+  if(emu->priv->journal && emu->priv->journal->error) rs |= X86EMU_RUN_JOURNAL;
+
+  if(emu->priv->brtrace) brtrace_stop(emu, rs);
+
+  if(rs && emu->priv->recorder && (emu->priv->recorder->flags & X86EMU_RECORDER_DUMP_ERROR)) recorder_dump(emu);
+
+  if(*p && (emu->priv->trace & X86EMU_TRACE_BINARY)) {
+    if(rs) btrace_run(emu, rs);
+  }
+  else if(*p) {
     if((rs & X86EMU_RUN_TIMEOUT)) {
       LOG_STR("* timeout\n");
     }
@@ -273,6 +346,9 @@ API_SYM unsigned x86emu_run(x86emu_t *emu, unsigned flags)
     if((rs & X86EMU_RUN_LOOP)) {
       LOG_STR("* infinite loop\n");
     }
+    if((rs & X86EMU_RUN_JOURNAL)) {
+      LOG_STR("* journal mismatch\n");
+    }
     **p = 0;
   }
 
@@ -302,13 +378,19 @@ void handle_interrupt(x86emu_t *emu)
   unsigned lf;
 
   if(emu->x86.intr_type) {
-    if((emu->log.trace & X86EMU_TRACE_INTS) && *p) {
+    if((emu->priv->trace & X86EMU_TRACE_INTS) && *p && (emu->priv->trace & X86EMU_TRACE_BINARY)) {
+      btrace_intr(emu, emu->x86.intr_nr, emu->x86.intr_type);
+    }
+    else if((emu->priv->trace & X86EMU_TRACE_INTS) && *p) {
       lf = LOG_FREE(emu);
       if(lf < 128) lf = x86emu_clear_log(emu, 1);
       if(lf >= 128) {
         if((emu->x86.intr_type & 0xff) == INTR_TYPE_FAULT) {
           LOG_STR("* fault ");
         }
+        else if((emu->x86.intr_type & 0xff) == INTR_TYPE_HW) {
+          LOG_STR("* irq ");
+        }
         else {
           LOG_STR("* int ");
         }
@@ -318,6 +400,16 @@ void handle_interrupt(x86emu_t *emu)
       }
     }
 
+    if(EVENT_ON(emu, X86EMU_EVENT_INTR)) event_intr(emu);
+
+    if(
+      emu->priv->recorder &&
+      (emu->priv->recorder->flags & X86EMU_RECORDER_DUMP_FAULT) &&
+      (emu->x86.intr_type & 0xff) == INTR_TYPE_FAULT
+    ) {
+      recorder_dump(emu);
+    }
+
     generate_int(emu, emu->x86.intr_nr, emu->x86.intr_type, emu->x86.intr_errcode);
   }
 
@@ -327,7 +419,24 @@ void handle_interrupt(x86emu_t *emu)
 
 API_SYM void x86emu_intr_raise(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err)
 {
-  if(emu && !emu->x86.intr_type) {
+  if(!emu) return;
+
+  if(emu->priv->journal) {
+    journal_intr(emu, intr_nr, type, err);
+  }
+  else {
+    intr_raise(emu, intr_nr, type, err);
+  }
+}
+
+/****************************************************************************
+REMARKS:
+Raise interrupt from within the emulator. Unlike x86emu_intr_raise() this
+is not recorded in the journal.
+****************************************************************************/
+void intr_raise(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err)
+{
+  if(!emu->x86.intr_type) {
     emu->x86.intr_nr = intr_nr;
     emu->x86.intr_type = type;
     emu->x86.intr_errcode = err;
@@ -482,7 +591,7 @@ cpu-state-varible emu->x86.mode. There are several potential states:
 
 Each of the above 7 items are handled with a bit in the mode field.
 ****************************************************************************/
-static sel_t *get_data_segment(x86emu_t *emu)
+sel_t *get_data_segment(x86emu_t *emu)
 {
   sel_t *seg;
 
@@ -767,6 +876,102 @@ void store_io_long(x86emu_t *emu, u32 port, u32 val)
 }
 
 
+/****************************************************************************
+PARAMETERS:
+port	- Port number
+seg	- Segment of memory buffer
+ofs	- Offset of memory buffer
+count	- Number of elements
+size	- Element size (1, 2, 4)
+type	- X86EMU_MEMIO_I or X86EMU_MEMIO_O
+
+RETURNS:
+Number of elements transferred.
+
+REMARKS:
+Block transfer for rep ins/outs through the block handler of the port (see
+x86emu_set_io_block_handler()). The handler gets a pointer into emulated
+memory if it is plain RAM, else a bounce buffer.
+
+Memory accesses through the pointer are counted in the heat map and the
+performance counters like single element accesses.
+
+Returns 0 if there's no block handler or if single accesses are traced,
+journaled, recorded, or reported as events; the caller has to fall back to
+single element transfers then.
+****************************************************************************/
+u32 block_io(x86emu_t *emu, u32 port, sel_t *seg, u32 ofs, u32 count, unsigned size, unsigned type)
+{
+  struct x86emu_io_handler_s *h;
+  unsigned u, i, bits, perm, avail, n, mtype;
+  u32 done, addr, val;
+  u8 *ptr, buf[1024];
+
+  port &= 0xffff;
+
+  if(!count || !(u = io_handler(emu, port))) return 0;
+
+  h = emu->priv->io.handler + u - 1;
+
+  if(
+    !h->block ||
+    emu->priv->journal ||
+    emu->priv->recorder ||
+    emu->priv->brtrace ||
+    EVENT_ON(emu, X86EMU_EVENT_MEM | X86EMU_EVENT_IO) ||
+    (emu->priv->poll && emu->priv->poll->active) ||
+    (emu->log.ptr && (emu->priv->trace & (X86EMU_TRACE_DATA | X86EMU_TRACE_IO | X86EMU_TRACE_ACC)))
+  ) return 0;
+
+  bits = size == 4 ? X86EMU_MEMIO_32 : size == 2 ? X86EMU_MEMIO_16 : X86EMU_MEMIO_8;
+  perm = type == X86EMU_MEMIO_I ? X86EMU_PERM_W | X86EMU_ACC_W : X86EMU_PERM_R | X86EMU_ACC_R;
+  mtype = type == X86EMU_MEMIO_I ? X86EMU_MEMIO_W : X86EMU_MEMIO_R;
+
+  for(done = 0; done < count; done += n) {
+    addr = seg->base + ofs + done * size;
+    n = count - done;
+    if(n > (1 << 20)) n = 1 << 20;
+    ptr = x86emu_get_ptr(emu, addr, n * size, perm, &avail);
+
+    if(ptr && (n = avail / size)) {
+      h->block(emu, h->block_ctx, port, type + bits, n, ptr);
+
+      // the memory accesses decode_memio() would have seen
+      if(PERF_ON(emu, X86EMU_PERF_MEMIO)) emu->priv->perf->c.memio[mtype >> 8][bits] += n;
+      if(emu->priv->heat) {
+        for(u = 0; u < n; u++) heat_count(emu->priv->heat, addr + u * size, mtype);
+      }
+
+      continue;
+    }
+
+    // not plain RAM: use bounce buffer
+    n = avail ? 1 : count - done;
+    if(n > sizeof buf / size) n = sizeof buf / size;
+
+    if(type == X86EMU_MEMIO_O) {
+      for(u = 0; u < n * size; u += size) {
+        decode_memio(emu, addr + u, &val, bits + X86EMU_MEMIO_R);
+        for(i = 0; i < size; i++) buf[u + i] = val >> (i * 8);
+      }
+    }
+
+    h->block(emu, h->block_ctx, port, type + bits, n, buf);
+
+    if(type == X86EMU_MEMIO_I) {
+      for(u = 0; u < n * size; u += size) {
+        for(val = i = 0; i < size; i++) val += buf[u + i] << (i * 8);
+        decode_memio(emu, addr + u, &val, bits + X86EMU_MEMIO_W);
+      }
+    }
+  }
+
+  io_account(emu, port, size, type, count);
+
+  return count;
+}
+
+
 /****************************************************************************
 PARAMETERS:
 reg	- Register to decode
@@ -1718,12 +1923,33 @@ u32 decode_sib_address(x86emu_t *emu, int sib, int mod)
 }
 
 
-void log_code(x86emu_t *emu)
+/****************************************************************************
+REMARKS:
+Log executed instruction.
+
+Everything after the time stamp depends only on cs:eip, mode, and the
+instruction bytes. It is kept in emu->priv->dcache so instructions run again in
+loops cost a single memcpy. Entries are checked against the bytes actually
+executed, so modified code is never shown with stale text.
+
+Instructions interrupted by an exception (intr is set) may have an
+incomplete disassembly and bypass the cache.
+****************************************************************************/
+void log_code(x86emu_t *emu, unsigned intr)
 {
-  unsigned u, lf;
+  unsigned u, lf, len;
   char **p = &emu->log.ptr;
+  char *start;
+  struct x86emu_dcache_s *dc = emu->priv->dcache;
+  dcache_entry_t *de = NULL;
+
+  if(!(emu->priv->trace & X86EMU_TRACE_CODE) || !*p) return;
+
+  if(emu->priv->trace & X86EMU_TRACE_BINARY) {
+    btrace_code(emu);
+    return;
+  }
 
-  if(!(emu->log.trace & X86EMU_TRACE_CODE) || !*p) return;
   lf = LOG_FREE(emu);
   if(lf < 512) lf = x86emu_clear_log(emu, 1);
   if(lf < 512) return;
@@ -1731,11 +1957,39 @@ void log_code(x86emu_t *emu)
   decode_hex(emu, p, emu->x86.R_TSC);
 
 #if WITH_TSC
-  if(emu->log.trace & X86EMU_TRACE_TIME) {
+  if(emu->priv->trace & X86EMU_TRACE_TIME) {
     LOG_STR(" +");
     decode_hex(emu, p, emu->x86.R_REAL_TSC - emu->x86.R_LAST_REAL_TSC);
   }
 #endif
+
+  len = emu->x86.instr_len;
+
+  if(!intr && len && len <= sizeof de->bytes) {
+    if(!dc) dc = emu->priv->dcache = calloc(1, sizeof *dc);
+    if(dc) {
+      de = dc->entry + (((emu->x86.saved_cs << 4) + emu->x86.saved_eip) & (DCACHE_SIZE - 1));
+      if(
+        de->len == len &&
+        de->eip == emu->x86.saved_eip &&
+        de->cs == emu->x86.saved_cs &&
+        de->mode == (emu->x86.mode & (_MODE_CODE32 | _MODE_STACK32)) &&
+        !memcmp(de->bytes, emu->x86.instr_buf, len)
+      ) {
+        /* fixed size copy is a lot faster; log has at least 512 bytes free */
+        memcpy(*p, de->text, 64);
+        if(de->text_len > 64) memcpy(*p + 64, de->text + 64, de->text_len - 64);
+        *p += de->text_len;
+        LOG_STR("\n");
+        **p = 0;
+
+        return;
+      }
+    }
+  }
+
+  start = *p;
+
   LOG_STR(" ");
   decode_hex4(emu, p, emu->x86.saved_cs);
   LOG_STR(":");
@@ -1756,6 +2010,22 @@ void log_code(x86emu_t *emu)
   memcpy(*p, emu->x86.disasm_buf, u);
   *p += u;
 
+  if(de) {
+    u = *p - start;
+    if(u <= sizeof de->text) {
+      de->eip = emu->x86.saved_eip;
+      de->cs = emu->x86.saved_cs;
+      de->len = len;
+      de->mode = emu->x86.mode & (_MODE_CODE32 | _MODE_STACK32);
+      memcpy(de->bytes, emu->x86.instr_buf, len);
+      de->text_len = u;
+      memcpy(de->text, start, u);
+    }
+    else {
+      de->len = 0;
+    }
+  }
+
   LOG_STR("\n");
 
   **p = 0;
@@ -1767,11 +2037,19 @@ void log_regs(x86emu_t *emu)
   char **p = &emu->log.ptr;
   unsigned lf;
 
-  if(!(emu->log.trace & X86EMU_TRACE_REGS) || !*p) return;
+  if(!(emu->priv->trace & X86EMU_TRACE_REGS) || !*p) return;
+
+  if(emu->priv->trace & X86EMU_TRACE_BINARY) {
+    btrace_regs(emu);
+    return;
+  }
+
   lf = LOG_FREE(emu);
   if(lf < 512) lf = x86emu_clear_log(emu, 1);
   if(lf < 512) return;
 
+  if((emu->priv->trace & X86EMU_TRACE_REGS_DELTA) && log_regs_delta(emu)) return;
+
   LOG_STR("\neax ");
   decode_hex8(emu, p, emu->x86.R_EAX);
   LOG_STR(", ebx ");
@@ -1808,14 +2086,7 @@ void log_regs(x86emu_t *emu)
   LOG_STR(", eflags ");
   decode_hex8(emu, p, emu->x86.R_EFLG);
 
-  if(ACCESS_FLAG(F_OF)) LOG_STR(" of");
-  if(ACCESS_FLAG(F_DF)) LOG_STR(" df");
-  if(ACCESS_FLAG(F_IF)) LOG_STR(" if");
-  if(ACCESS_FLAG(F_SF)) LOG_STR(" sf");
-  if(ACCESS_FLAG(F_ZF)) LOG_STR(" zf");
-  if(ACCESS_FLAG(F_AF)) LOG_STR(" af");
-  if(ACCESS_FLAG(F_PF)) LOG_STR(" pf");
-  if(ACCESS_FLAG(F_CF)) LOG_STR(" cf");
+  log_flags(emu);
 
   if (emu->x86.R_CR4 & CR4_OSFXSR) {
     LOG_STR("\nxmm0 ");
@@ -1842,13 +2113,115 @@ void log_regs(x86emu_t *emu)
 }
 
 
+/*
+ * Log registers that changed since the last call on a single line.
+ *
+ * Returns 0 if a full register dump is due instead.
+ */
+int log_regs_delta(x86emu_t *emu)
+{
+  static const char *names[] = {
+    "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp",
+    "cs", "ss", "ds", "es", "fs", "gs", "eip", "eflags"
+  };
+  char **p = &emu->log.ptr;
+  struct x86emu_rdelta_s *rd;
+  u32 reg[16];
+  unsigned u, xmm, len, n = 0;
+
+  if(!(rd = emu->priv->rdelta) && !(rd = emu->priv->rdelta = calloc(1, sizeof *rd))) return 0;
+
+  reg[0] = emu->x86.R_EAX;
+  reg[1] = emu->x86.R_EBX;
+  reg[2] = emu->x86.R_ECX;
+  reg[3] = emu->x86.R_EDX;
+  reg[4] = emu->x86.R_ESI;
+  reg[5] = emu->x86.R_EDI;
+  reg[6] = emu->x86.R_EBP;
+  reg[7] = emu->x86.R_ESP;
+  reg[8] = emu->x86.R_CS;
+  reg[9] = emu->x86.R_SS;
+  reg[10] = emu->x86.R_DS;
+  reg[11] = emu->x86.R_ES;
+  reg[12] = emu->x86.R_FS;
+  reg[13] = emu->x86.R_GS;
+  reg[14] = emu->x86.R_EIP;
+  reg[15] = emu->x86.R_EFLG;
+
+  xmm = emu->x86.R_CR4 & CR4_OSFXSR ? 1 : 0;
+
+  if(!rd->valid || rd->xmm_valid != xmm || ++rd->count >= RDELTA_KEYFRAME) {
+    memcpy(rd->reg, reg, sizeof rd->reg);
+    memcpy(rd->xmm, emu->x86.sse.XMM, sizeof rd->xmm);
+    rd->valid = 1;
+    rd->xmm_valid = xmm;
+    rd->count = 0;
+
+    return 0;
+  }
+
+  for(u = 0; u < sizeof reg / sizeof *reg; u++) {
+    if(reg[u] == rd->reg[u]) continue;
+    if(n++) LOG_STR(", ");
+    len = strlen(names[u]);
+    memcpy(*p, names[u], len);
+    *p += len;
+    LOG_STR(" ");
+    if(u >= 8 && u < 14) {
+      decode_hex4(emu, p, reg[u]);
+    }
+    else {
+      decode_hex8(emu, p, reg[u]);
+    }
+    if(u == 15) log_flags(emu);
+    rd->reg[u] = reg[u];
+  }
+
+  if(xmm) {
+    for(u = 0; u < 8; u++) {
+      if(!memcmp(rd->xmm + u, emu->x86.sse.XMM + u, sizeof *rd->xmm)) continue;
+      if(n++) LOG_STR(", ");
+      LOG_STR("xmm");
+      *(*p)++ = '0' + u;
+      LOG_STR(" ");
+      decode_hex32(emu, p, emu->x86.sse.XMM[u]);
+      rd->xmm[u] = emu->x86.sse.XMM[u];
+    }
+  }
+
+  if(n) LOG_STR("\n");
+
+  **p = 0;
+
+  return 1;
+}
+
+
+void log_flags(x86emu_t *emu)
+{
+  char **p = &emu->log.ptr;
+
+  if(ACCESS_FLAG(F_OF)) LOG_STR(" of");
+  if(ACCESS_FLAG(F_DF)) LOG_STR(" df");
+  if(ACCESS_FLAG(F_IF)) LOG_STR(" if");
+  if(ACCESS_FLAG(F_SF)) LOG_STR(" sf");
+  if(ACCESS_FLAG(F_ZF)) LOG_STR(" zf");
+  if(ACCESS_FLAG(F_AF)) LOG_STR(" af");
+  if(ACCESS_FLAG(F_PF)) LOG_STR(" pf");
+  if(ACCESS_FLAG(F_CF)) LOG_STR(" cf");
+}
+
+
 void check_data_access(x86emu_t *emu, sel_t *seg, u32 ofs, u32 size)
 {
   char **p = &emu->log.ptr;
   static char seg_name[7] = "ecsdfg?";
   unsigned idx = seg - emu->x86.seg, lf;
 
-  if((emu->log.trace & X86EMU_TRACE_ACC) && *p) {
+  if((emu->priv->trace & X86EMU_TRACE_ACC) && *p && (emu->priv->trace & X86EMU_TRACE_BINARY)) {
+    btrace_acc(emu, idx > 6 ? 6 : idx, ofs, size);
+  }
+  else if((emu->priv->trace & X86EMU_TRACE_ACC) && *p) {
     lf = LOG_FREE(emu);
     if(lf < 512) lf = x86emu_clear_log(emu, 1);
     if(lf >= 512) {
@@ -1957,7 +2330,10 @@ void decode_descriptor(x86emu_t *emu, descr_t *d, u32 dl, u32 dh)
     }
   }
 
-  if((emu->log.trace & X86EMU_TRACE_ACC) && *p) {
+  if((emu->priv->trace & X86EMU_TRACE_ACC) && *p && (emu->priv->trace & X86EMU_TRACE_BINARY)) {
+    btrace_descr(emu, dl, dh);
+  }
+  else if((emu->priv->trace & X86EMU_TRACE_ACC) && *p) {
     lf = LOG_FREE(emu);
     if(lf < 512) lf = x86emu_clear_log(emu, 1);
     if(lf >= 512) {
@@ -2100,11 +2476,22 @@ void idt_lookup(x86emu_t *emu, u8 nr, u32 *new_cs, u32 *new_eip)
 void generate_int(x86emu_t *emu, u8 nr, unsigned type, unsigned errcode)
 {
   u32 cs, eip, new_cs, new_eip;
+  u64 ns = 0;
   int i;
 
   emu->x86.intr_stats[nr]++;
 
-  i = emu->intr ? (*emu->intr)(emu, nr, type) : 0;
+  if(PERF_ON(emu, X86EMU_PERF_INTR)) emu->priv->perf->c.intrs++;
+
+  if(emu->priv->icost) ns = host_ns();
+
+  i = 0;
+  if(emu->intr) i = emu->priv->perf ? perf_intr(emu, nr, type) : (*emu->intr)(emu, nr, type);
+
+  // BIOS services are for int instructions only, not for irqs or faults
+  if(!i && emu->priv->bios && (type & 0xff) == INTR_TYPE_SOFT) i = bios_call(emu, nr);
+
+  if(i && emu->priv->icost) icost_handled(emu, nr, type, host_ns() - ns);
 
   if(!i) {
     if(type & INTR_MODE_RESTART) {
@@ -2132,6 +2519,8 @@ void generate_int(x86emu_t *emu, u8 nr, unsigned type, unsigned errcode)
       push_word(emu, eip);
     }
 
+    if(emu->priv->icost) icost_enter(emu, nr, type);
+
     if(type & INTR_MODE_ERRCODE) push_long(emu, errcode);
 
     CLEAR_FLAG(F_IF);
@@ -2139,6 +2528,8 @@ void generate_int(x86emu_t *emu, u8 nr, unsigned type, unsigned errcode)
 
     x86emu_set_seg_register(emu, emu->x86.R_CS_SEL, new_cs);
     emu->x86.R_EIP = new_eip;
+
+    if(emu->priv->cg) cg_call(emu);
   }
 }
 
@@ -2148,17 +2539,40 @@ unsigned decode_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
   unsigned err, bits = type & 0xff, lf;
   char **p = &emu->log.ptr;
 
-  err = emu->memio(emu, addr, val, type);
+  if(emu->priv->journal) {
+    err = journal_memio(emu, addr, val, type);
+  }
+  else if(type >= X86EMU_MEMIO_I && io_handler(emu, addr)) {
+    err = vm_io(emu, addr, val, type);
+  }
+  else {
+    err = emu->priv->perf ? perf_memio(emu, addr, val, type) : emu->memio(emu, addr, val, type);
+  }
+
+  if(emu->priv->poll && emu->priv->poll->active) poll_access(emu, addr, *val, type);
+
+  if(emu->priv->recorder) recorder_access(emu, addr, *val, type, err);
+
+  if(EVENT_ON(emu, X86EMU_EVENT_MEM | X86EMU_EVENT_IO)) event_access(emu, addr, *val, type, err);
+
+  if(emu->priv->brtrace && (type & ~0xff) == X86EMU_MEMIO_I) brtrace_input(emu, addr, *val, type, err);
 
   type &= ~0xff;
 
-  if(!*p || !((emu->log.trace & X86EMU_TRACE_DATA) || (emu->log.trace & X86EMU_TRACE_IO))) return err;
+  if(!*p || !((emu->priv->trace & X86EMU_TRACE_DATA) || (emu->priv->trace & X86EMU_TRACE_IO))) return err;
 
   if(
-    !((emu->log.trace & X86EMU_TRACE_IO) && (type == X86EMU_MEMIO_I || type == X86EMU_MEMIO_O)) &&
-    !((emu->log.trace & X86EMU_TRACE_DATA) && (type == X86EMU_MEMIO_R || type == X86EMU_MEMIO_W || type == X86EMU_MEMIO_X))
+    !((emu->priv->trace & X86EMU_TRACE_IO) && (type == X86EMU_MEMIO_I || type == X86EMU_MEMIO_O)) &&
+    !((emu->priv->trace & X86EMU_TRACE_DATA) && (type == X86EMU_MEMIO_R || type == X86EMU_MEMIO_W || type == X86EMU_MEMIO_X))
   ) return err;
 
+  if(emu->priv->filter && type <= X86EMU_MEMIO_X && !filter_data(emu, addr)) return err;
+
+  if(emu->priv->trace & X86EMU_TRACE_BINARY) {
+    btrace_memio(emu, addr, *val, type + bits, err);
+    return err;
+  }
+
   lf = LOG_FREE(emu);
   if(lf < 1024) lf = x86emu_clear_log(emu, 1);
   if(lf < 1024) return err;
@@ -2224,17 +2638,33 @@ unsigned emu_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
   unsigned err, bits = type & 0xff, lf;
   char **p = &emu->log.ptr;
 
-  err = emu->memio(emu, addr, val, type);
+  if(emu->priv->journal) {
+    err = journal_memio(emu, addr, val, type);
+  }
+  else {
+    err = emu->priv->perf ? perf_memio(emu, addr, val, type) : emu->memio(emu, addr, val, type);
+  }
+
+  if(EVENT_ON(emu, X86EMU_EVENT_MEM | X86EMU_EVENT_IO)) event_access(emu, addr, *val, type, err);
+
+  if(emu->priv->brtrace && (type & ~0xff) == X86EMU_MEMIO_I) brtrace_input(emu, addr, *val, type, err);
 
   type &= ~0xff;
 
-  if(!*p || !((emu->log.trace & X86EMU_TRACE_DATA) || (emu->log.trace & X86EMU_TRACE_IO))) return err;
+  if(!*p || !((emu->priv->trace & X86EMU_TRACE_DATA) || (emu->priv->trace & X86EMU_TRACE_IO))) return err;
 
   if(
-    !((emu->log.trace & X86EMU_TRACE_IO) && (type == X86EMU_MEMIO_I || type == X86EMU_MEMIO_O)) &&
-    !((emu->log.trace & X86EMU_TRACE_DATA) && (type == X86EMU_MEMIO_R || type == X86EMU_MEMIO_W || type == X86EMU_MEMIO_X))
+    !((emu->priv->trace & X86EMU_TRACE_IO) && (type == X86EMU_MEMIO_I || type == X86EMU_MEMIO_O)) &&
+    !((emu->priv->trace & X86EMU_TRACE_DATA) && (type == X86EMU_MEMIO_R || type == X86EMU_MEMIO_W || type == X86EMU_MEMIO_X))
   ) return err;
 
+  if(emu->priv->filter && type <= X86EMU_MEMIO_X && !filter_data(emu, addr)) return err;
+
+  if(emu->priv->trace & X86EMU_TRACE_BINARY) {
+    btrace_memio(emu, addr, *val, type + bits, err);
+    return err;
+  }
+
   lf = LOG_FREE(emu);
   if(lf < 1024) lf = x86emu_clear_log(emu, 1);
   if(lf < 1024) return err;
@@ -2299,6 +2729,7 @@ void emu_process_debug(x86emu_t *emu, unsigned start, unsigned len)
 {
   unsigned lf, type, u;
   char **p = &emu->log.ptr;
+  char buf[0x102];
 
   if(!*p) return;
 
@@ -2311,6 +2742,15 @@ void emu_process_debug(x86emu_t *emu, unsigned start, unsigned len)
 
   switch(type) {
     case 1:
+      if(emu->priv->trace & X86EMU_TRACE_BINARY) {
+        buf[0] = '\n';
+        for(u = 1; len-- && u < sizeof buf - 1;) {
+          buf[u++] = x86emu_read_byte_noperm(emu, start++);
+        }
+        buf[u++] = '\n';
+        btrace_text(emu, buf, u);
+        break;
+      }
       LOG_STR("\n");
       while(len--) {
         *(*p)++ = x86emu_read_byte_noperm(emu, start++);
@@ -2351,3 +2791,203 @@ void emu_process_debug(x86emu_t *emu, unsigned start, unsigned len)
 }
 
 
+
+
+/****************************************************************************
+REMARKS:
+Set handler to tell how long a port input keeps its value (see
+X86EMU_RUN_POLL). Returns the old handler.
+****************************************************************************/
+API_SYM x86emu_poll_handler_t x86emu_set_poll_handler(x86emu_t *emu, x86emu_poll_handler_t handler)
+{
+  x86emu_poll_handler_t old = NULL;
+
+  if(!emu) return old;
+
+  if(!emu->priv->poll && !(emu->priv->poll = calloc(1, sizeof *emu->priv->poll))) return old;
+
+  old = emu->priv->poll->handler;
+  emu->priv->poll->handler = handler;
+
+  return old;
+}
+
+/****************************************************************************
+PARAMETERS:
+flags	- x86emu_run() flags
+
+REMARKS:
+Prepare polling loop detection for x86emu_run().
+****************************************************************************/
+void poll_start(x86emu_t *emu, unsigned flags)
+{
+  struct x86emu_poll_s *poll;
+
+  if(!(flags & X86EMU_RUN_POLL) || emu->priv->journal) {
+    if(emu->priv->poll) emu->priv->poll->active = 0;
+
+    return;
+  }
+
+  if(!emu->priv->poll && !(emu->priv->poll = calloc(1, sizeof *emu->priv->poll))) return;
+
+  poll = emu->priv->poll;
+
+  poll->active = 1;
+  poll->unsafe = 1;
+  poll->max_instr = (flags & X86EMU_RUN_MAX_INSTR) && emu->max_instr ? emu->max_instr : ~0ULL;
+}
+
+/****************************************************************************
+REMARKS:
+Called after each instruction with X86EMU_RUN_POLL.
+
+A short backward jump ends a loop iteration. If the iteration had no side
+effects (memory writes, interrupts, i/o with side effects), its only input
+came from ports that know how long their value stays (device models or poll
+handler), and the registers are the same as at the start, the next
+iterations will do exactly the same. Skip them by advancing R_TSC.
+
+Nothing is skipped while something watches single instructions or accesses
+(see poll_observed()).
+****************************************************************************/
+void poll_check(x86emu_t *emu)
+{
+  struct x86emu_poll_s *poll = emu->priv->poll;
+  u64 until, n;
+  u32 len;
+  unsigned u;
+
+  if(emu->x86.intr_type) {
+    poll->unsafe = 1;
+
+    return;
+  }
+
+  if(
+    emu->x86.R_CS != emu->x86.saved_cs ||
+    emu->x86.R_EIP >= emu->x86.saved_eip ||
+    emu->x86.saved_eip - emu->x86.R_EIP > POLL_MAX_LOOP
+  ) return;
+
+  if(
+    !poll->unsafe &&
+    poll->inputs &&
+    poll->cs == emu->x86.R_CS &&
+    poll->eip == emu->x86.R_EIP &&
+    !memcmp(&poll->gen, &emu->x86.gen, sizeof poll->gen) &&
+    !memcmp(&poll->spc, &emu->x86.spc, sizeof poll->spc) &&
+    !memcmp(poll->seg, emu->x86.seg, sizeof poll->seg)
+  ) {
+    until = poll->until;
+    // device state catches up later but interrupts must not be delayed
+    if(emu->priv->dev && ACCESS_FLAG(F_IF) && emu->priv->dev->next_event < until) until = emu->priv->dev->next_event;
+    if(poll->max_instr < until) until = poll->max_instr;
+    // don't skip over the timeout check in x86emu_run()
+    if((emu->x86.R_TSC | 0xffff) + 1 < until) until = (emu->x86.R_TSC | 0xffff) + 1;
+
+    // iterations that still end before 'until'
+    len = emu->x86.R_TSC - poll->tsc;
+    n = len && until > emu->x86.R_TSC + 1 ? (until - emu->x86.R_TSC - 1) / len : 0;
+
+    if(n && !poll_observed(emu)) {
+      emu->x86.R_TSC += n * len;
+      for(u = 0; u < poll->inputs; u++) {
+        io_account(emu, poll->input[u].port, poll->input[u].len, X86EMU_MEMIO_I, n);
+      }
+    }
+  }
+
+  // start next iteration
+  poll->cs = emu->x86.R_CS;
+  poll->eip = emu->x86.R_EIP;
+  poll->tsc = emu->x86.R_TSC;
+  poll->until = ~0ULL;
+  poll->gen = emu->x86.gen;
+  poll->spc = emu->x86.spc;
+  memcpy(poll->seg, emu->x86.seg, sizeof poll->seg);
+  poll->inputs = 0;
+  poll->unsafe = 0;
+}
+
+/****************************************************************************
+REMARKS:
+Track memory and i/o accesses of a potential polling loop.
+****************************************************************************/
+void poll_access(x86emu_t *emu, u32 addr, u32 val, unsigned type)
+{
+  struct x86emu_poll_s *poll = emu->priv->poll;
+  unsigned bits = type & 0xff;
+  u64 until = 0;
+
+  if(poll->unsafe) return;
+
+  type &= ~0xff;
+
+  // memory might be changed from outside (memory handler, framebuffer)
+  if(type == X86EMU_MEMIO_R) {
+    poll->unsafe = 1;
+
+    return;
+  }
+
+  if(type == X86EMU_MEMIO_X) {
+    if(emu->memio != vm_memio) poll->unsafe = 1;
+
+    return;
+  }
+
+  if(type == X86EMU_MEMIO_W) {
+    poll->unsafe = 1;
+
+    return;
+  }
+
+  addr &= 0xffff;
+
+  if(dev_port(emu, addr)) {
+    until = dev_poll(emu, addr, bits, type);
+  }
+  else if(type == X86EMU_MEMIO_I && poll->handler) {
+    until = poll->handler(emu, addr, val, bits);
+  }
+
+  if(until <= emu->x86.R_TSC) {
+    poll->unsafe = 1;
+
+    return;
+  }
+
+  if(until < poll->until) poll->until = until;
+
+  if(type == X86EMU_MEMIO_I) {
+    if(poll->inputs >= POLL_MAX_INPUTS) {
+      poll->unsafe = 1;
+
+      return;
+    }
+    poll->input[poll->inputs].port = addr;
+    poll->input[poll->inputs++].len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+  }
+}
+
+/****************************************************************************
+REMARKS:
+Skipped iterations would be missing from anything that looks at single
+instructions or accesses: trace log, recorder, events, coverage, profiles,
+heatmap, branch trace.
+****************************************************************************/
+int poll_observed(x86emu_t *emu)
+{
+  return
+    (emu->log.ptr && (emu->log.trace & ~(X86EMU_TRACE_TIME | X86EMU_TRACE_DEBUG))) ||
+    emu->priv->recorder ||
+    (emu->priv->event && emu->priv->event->active) ||
+    emu->priv->cov ||
+    emu->priv->prof ||
+    emu->priv->cg ||
+    emu->priv->icost ||
+    emu->priv->heat ||
+    emu->priv->perf ||
+    emu->priv->brtrace;
+}
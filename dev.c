@@ -0,0 +1,1320 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Built-in models of the 8254 PIT, the cascaded 8259 PICs and the MC146818
+*   RTC. They are clocked by the emulated instruction counter (R_TSC).
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+#include <time.h>
+
+#define PIT_REFRESH	18
+
+static u64 dev_ticks(x86emu_t *emu, u64 tsc, u32 freq);
+static u64 dev_tsc(x86emu_t *emu, u64 ticks, u32 freq);
+static void dev_init(x86emu_t *emu, u64 tsc);
+static int dev_set_io(x86emu_t *emu, unsigned first, unsigned last, unsigned device, unsigned on);
+static u32 dev_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits);
+static void dev_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits);
+static unsigned dev_in_byte(x86emu_t *emu, unsigned port);
+static void dev_out_byte(x86emu_t *emu, unsigned port, unsigned val);
+static u64 dev_poll_byte(x86emu_t *emu, unsigned port, unsigned type);
+
+static void pit_state(dev_pit_channel_t *c, u64 now, unsigned *count, unsigned *out);
+static u64 pit_edges(dev_pit_channel_t *c, u64 now);
+static u64 pit_out_next(dev_pit_channel_t *c, u64 now);
+static void pit_start(dev_pit_channel_t *c, u64 now);
+static void pit_stop(dev_pit_channel_t *c, u64 now);
+static void pit_latch(dev_pit_channel_t *c, u64 now);
+static void pit_control(x86emu_t *emu, unsigned val, u64 now);
+static void pit_load(x86emu_t *emu, unsigned ch, unsigned val, u64 now);
+static void pit_gate(x86emu_t *emu, unsigned gate, u64 now);
+static unsigned pit_read(x86emu_t *emu, unsigned ch, u64 now);
+static void pit_write(x86emu_t *emu, unsigned ch, unsigned val, u64 now);
+static void pit_update(x86emu_t *emu);
+static u64 pit_next(x86emu_t *emu);
+
+static void pic_irq(x86emu_t *emu, unsigned irq);
+static int pic_pending(dev_pic_t *pic, unsigned irr);
+static int pic_vector(x86emu_t *emu, int ack);
+static unsigned pic_read(x86emu_t *emu, unsigned port);
+static void pic_write(x86emu_t *emu, unsigned port, unsigned val);
+
+static unsigned rtc_period(unsigned rate);
+static s64 rtc_time(x86emu_t *emu);
+static void rtc_set_time(x86emu_t *emu, s64 t);
+static unsigned rtc_encode(x86emu_t *emu, unsigned val);
+static unsigned rtc_decode(x86emu_t *emu, unsigned val);
+static unsigned rtc_time_reg(x86emu_t *emu, s64 t, unsigned idx);
+static unsigned rtc_read(x86emu_t *emu, unsigned idx);
+static void rtc_write(x86emu_t *emu, unsigned idx, unsigned val);
+static void rtc_update(x86emu_t *emu);
+static u64 rtc_next(x86emu_t *emu);
+
+
+/*
+ * Enable device models (X86EMU_DEV_* bits).
+ *
+ * The models take over their i/o ports via x86emu_set_io_handler(). A model
+ * whose ports can't be registered stays in its previous state.
+ *
+ * Returns 0 on success, -1 if some model could not be changed.
+ */
+API_SYM int x86emu_set_devices(x86emu_t *emu, unsigned devices)
+{
+  static const struct {
+    unsigned device, first, last;
+  } ports[] = {
+    { X86EMU_DEV_PIT, 0x40, 0x43 },
+    { X86EMU_DEV_PIT, 0x61, 0x61 },
+    { X86EMU_DEV_PIC, 0x20, 0x21 },
+    { X86EMU_DEV_PIC, 0xa0, 0xa1 },
+    { X86EMU_DEV_RTC, 0x70, 0x71 },
+    { X86EMU_DEV_PCI, 0xcf8, 0xcff },
+  };
+  struct x86emu_dev_s *dev;
+  unsigned changed, failed = 0, u, on;
+
+  if(!emu) return -1;
+
+  devices &= X86EMU_DEV_ALL;
+
+  if(!(dev = emu->priv->dev)) {
+    if(!devices) return 0;
+    if(!(dev = emu->priv->dev = calloc(1, sizeof *dev))) return -1;
+    dev->clock = DEV_DEF_CLOCK;
+    dev_init(emu, emu->x86.R_TSC);
+    dev->rtc.offset = DEV_DEF_RTC_TIME - dev->rtc.last / DEV_RTC_FREQ;
+  }
+
+  changed = devices ^ dev->devices;
+
+  for(u = 0; u < sizeof ports / sizeof *ports; u++) {
+    if(!(changed & ports[u].device)) continue;
+    on = devices & ports[u].device;
+    if(dev_set_io(emu, ports[u].first, ports[u].last, ports[u].device, on)) failed |= ports[u].device;
+  }
+
+  // undo the ranges that were set
+  for(u = 0; u < sizeof ports / sizeof *ports; u++) {
+    if(!(failed & ports[u].device)) continue;
+    on = devices & ports[u].device;
+    dev_set_io(emu, ports[u].first, ports[u].last, ports[u].device, !on);
+  }
+
+  if(changed & X86EMU_DEV_PCI_BIOS) {
+    if(x86emu_set_bios_handler(emu, 0x1a, 0xb100, 0xff00, devices & X86EMU_DEV_PCI_BIOS ? pci_bios : NULL, NULL)) {
+      failed |= X86EMU_DEV_PCI_BIOS;
+    }
+  }
+
+  devices ^= failed;
+
+  dev->devices = devices;
+  dev->next_event = 0;
+
+  if(!devices) emu->priv->dev = dev_free(dev);
+
+  return failed ? -1 : 0;
+}
+
+
+/*
+ * Register (on = 1) or remove (on = 0) the i/o handlers of device for ports
+ * first - last.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int dev_set_io(x86emu_t *emu, unsigned first, unsigned last, unsigned device, unsigned on)
+{
+  if(device == X86EMU_DEV_PCI) {
+    return x86emu_set_io_handler(emu, first, last, on ? pci_in : NULL, on ? pci_out : NULL, NULL);
+  }
+
+  return x86emu_set_io_handler(emu, first, last, on ? dev_in : NULL, on ? dev_out : NULL, NULL);
+}
+
+
+/*
+ * Check whether port is handled by a device model.
+ */
+int dev_port(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_io_handler_s *h;
+  unsigned idx;
+
+  if(!emu->priv->dev || !(idx = io_handler(emu, port))) return 0;
+
+  h = emu->priv->io.handler + idx - 1;
+
+  return h->in == dev_in || h->in == pci_in;
+}
+
+
+/*
+ * Polling loop support (see X86EMU_RUN_POLL).
+ *
+ * For input (type = X86EMU_MEMIO_I): returns R_TSC up to which reading the
+ * port gives the same value and has no side effects. For output: returns
+ * ~0 if writing the same value again has no effect.
+ *
+ * Returns 0 if neither is the case.
+ */
+u64 dev_poll(x86emu_t *emu, unsigned port, unsigned bits, unsigned type)
+{
+  unsigned u, len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+  u64 until = ~0ULL, t;
+
+  // pci config space has no time-dependent registers
+  if(port >= 0xcf8 && port <= 0xcff) return type == X86EMU_MEMIO_I || port == 0xcf8 ? until : 0;
+
+  for(u = 0; u < len; u++) {
+    t = dev_poll_byte(emu, (port + u) & 0xffff, type);
+    if(t < until) until = t;
+  }
+
+  return until;
+}
+
+
+/*
+ * Read RTC register (for the BIOS services).
+ */
+unsigned dev_rtc_read(x86emu_t *emu, unsigned idx)
+{
+  return rtc_read(emu, idx & 0x7f);
+}
+
+
+/*
+ * Set emulated clock (instructions per second) the device timers are based on.
+ */
+API_SYM void x86emu_set_dev_clock(x86emu_t *emu, u32 clock)
+{
+  if(!emu || !emu->priv->dev || !clock) return;
+
+  emu->priv->dev->clock = clock;
+  emu->priv->dev->rtc.last = dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ);
+  emu->priv->dev->next_event = 0;
+}
+
+
+/*
+ * Set RTC time (seconds since 1970-01-01 00:00:00 UTC).
+ */
+API_SYM void x86emu_set_rtc_time(x86emu_t *emu, u64 seconds)
+{
+  if(!emu || !emu->priv->dev) return;
+
+  rtc_set_time(emu, seconds);
+}
+
+
+struct x86emu_dev_s *dev_clone(struct x86emu_dev_s *dev)
+{
+  struct x86emu_dev_s *new_dev;
+
+  if(!(new_dev = mem_dup(dev, sizeof *dev))) return NULL;
+
+  new_dev->pci.dev = mem_dup(dev->pci.dev, dev->pci.devs * sizeof *dev->pci.dev);
+
+  return new_dev;
+}
+
+
+struct x86emu_dev_s *dev_free(struct x86emu_dev_s *dev)
+{
+  if(dev) {
+    free(dev->pci.dev);
+    free(dev);
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Reset PIT and PIC state; called on emulator reset.
+ *
+ * The RTC keeps running.
+ */
+void dev_reset(x86emu_t *emu)
+{
+  s64 t = rtc_time(emu);
+
+  dev_init(emu, 0);
+  emu->priv->dev->rtc.offset = t;
+}
+
+
+/*
+ * Advance device state to R_TSC and deliver pending interrupts.
+ */
+void dev_update(x86emu_t *emu)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u64 next = ~0ULL, u;
+
+  if(dev->devices & X86EMU_DEV_PIT) {
+    pit_update(emu);
+    if((u = pit_next(emu)) < next) next = u;
+  }
+
+  if(dev->devices & X86EMU_DEV_RTC) {
+    rtc_update(emu);
+    if((u = rtc_next(emu)) < next) next = u;
+  }
+
+  if(pic_vector(emu, 0) >= 0) {
+    if(!emu->x86.intr_type && ACCESS_FLAG(F_IF)) {
+      intr_raise(emu, pic_vector(emu, 1), INTR_TYPE_HW, 0);
+    }
+    // not yet delivered - try again after next instruction
+    if(pic_vector(emu, 0) >= 0) next = emu->x86.R_TSC + 1;
+  }
+
+  dev->next_event = next;
+}
+
+
+/*
+ * hlt: skip ahead to the next device interrupt.
+ *
+ * Returns 1 if an interrupt has been raised, 0 if the cpu should stop.
+ */
+int dev_halt(x86emu_t *emu)
+{
+  unsigned u;
+
+  if(!ACCESS_FLAG(F_IF)) return 0;
+
+  // give up if there are only masked interrupt sources
+  for(u = 0; u < 16; u++) {
+    dev_update(emu);
+    if(emu->x86.intr_type) return 1;
+    if(emu->priv->dev->next_event == ~0ULL) break;
+    if(emu->priv->dev->next_event > emu->x86.R_TSC) emu->x86.R_TSC = emu->priv->dev->next_event;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Convert emulated clock to device clock.
+ */
+u64 dev_ticks(x86emu_t *emu, u64 tsc, u32 freq)
+{
+  u32 clock = emu->priv->dev->clock;
+
+  return tsc / clock * freq + tsc % clock * freq / clock;
+}
+
+
+/*
+ * Convert device clock to emulated clock, rounding up.
+ */
+u64 dev_tsc(x86emu_t *emu, u64 ticks, u32 freq)
+{
+  u32 clock = emu->priv->dev->clock;
+
+  return ticks / freq * clock + (ticks % freq * clock + freq - 1) / freq;
+}
+
+
+/*
+ * Initialize device state the way a PC BIOS leaves it.
+ */
+void dev_init(x86emu_t *emu, u64 tsc)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u64 now = dev_ticks(emu, tsc, DEV_PIT_FREQ);
+  dev_pit_channel_t *c;
+
+  memset(&dev->pit, 0, sizeof dev->pit);
+  memset(dev->pic, 0, sizeof dev->pic);
+
+  // system timer, 18.2 Hz
+  c = dev->pit.ch;
+  c->rw = 3;
+  c->mode = 3;
+  c->reload = 0x10000;
+  pit_start(c, now);
+
+  // memory refresh
+  c = dev->pit.ch + 1;
+  c->rw = 1;
+  c->mode = 2;
+  c->reload = PIT_REFRESH;
+  pit_start(c, now);
+
+  // speaker
+  c = dev->pit.ch + 2;
+  c->rw = 3;
+  c->mode = 3;
+  c->out = 1;
+
+  dev->pic[0].base = 0x08;
+  dev->pic[0].imr = 0xfa;
+  dev->pic[1].base = 0x70;
+  dev->pic[1].imr = 0xff;
+
+  dev->rtc.last = dev_ticks(emu, tsc, DEV_RTC_FREQ);
+  dev->rtc.ram[0x0a] = 0x26;
+  dev->rtc.ram[0x0b] = 0x02;
+  dev->rtc.ram[0x0c] = 0;
+
+  dev->next_event = 0;
+}
+
+
+u32 dev_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits)
+{
+  unsigned u, len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+  u32 val = 0;
+
+  for(u = 0; u < len; u++) {
+    val += dev_in_byte(emu, (port + u) & 0xffff) << (u * 8);
+  }
+
+  return val;
+}
+
+
+void dev_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits)
+{
+  unsigned u, len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+
+  for(u = 0; u < len; u++) {
+    dev_out_byte(emu, (port + u) & 0xffff, (val >> (u * 8)) & 0xff);
+  }
+}
+
+
+unsigned dev_in_byte(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u64 now = dev_ticks(emu, emu->x86.R_TSC, DEV_PIT_FREQ);
+  unsigned count, out;
+
+  switch(port) {
+    case 0x20:
+    case 0x21:
+    case 0xa0:
+    case 0xa1:
+      return pic_read(emu, port);
+
+    case 0x40:
+    case 0x41:
+    case 0x42:
+      return pit_read(emu, port - 0x40, now);
+
+    case 0x61:
+      // bit 4: refresh toggle, bit 5: timer 2 output
+      pit_state(dev->pit.ch + 2, now, &count, &out);
+      return (dev->pit.port61 & 0x0f) + (((now / PIT_REFRESH) & 1) << 4) + (out << 5);
+
+    case 0x70:
+      return dev->rtc.index;
+
+    case 0x71:
+      return rtc_read(emu, dev->rtc.index);
+  }
+
+  return 0xff;
+}
+
+
+void dev_out_byte(x86emu_t *emu, unsigned port, unsigned val)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u64 now = dev_ticks(emu, emu->x86.R_TSC, DEV_PIT_FREQ);
+  unsigned old;
+
+  switch(port) {
+    case 0x20:
+    case 0x21:
+    case 0xa0:
+    case 0xa1:
+      pic_write(emu, port, val);
+      break;
+
+    case 0x40:
+    case 0x41:
+    case 0x42:
+      pit_write(emu, port - 0x40, val, now);
+      break;
+
+    case 0x43:
+      pit_control(emu, val, now);
+      break;
+
+    case 0x61:
+      old = dev->pit.port61;
+      dev->pit.port61 = val & 0x0f;
+      if((old ^ val) & 1) pit_gate(emu, val & 1, now);
+      break;
+
+    case 0x70:
+      // bit 7: nmi mask
+      dev->rtc.index = val & 0x7f;
+      break;
+
+    case 0x71:
+      rtc_write(emu, dev->rtc.index, val);
+      break;
+  }
+}
+
+
+u64 dev_poll_byte(x86emu_t *emu, unsigned port, unsigned type)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u64 now, next, u;
+
+  if(type != X86EMU_MEMIO_I) return port == 0x70 ? ~0ULL : 0;
+
+  switch(port) {
+    case 0x20:
+    case 0x21:
+    case 0xa0:
+    case 0xa1:
+      return dev->next_event;
+
+    case 0x61:
+      now = dev_ticks(emu, emu->x86.R_TSC, DEV_PIT_FREQ);
+      next = (now / PIT_REFRESH + 1) * PIT_REFRESH;
+      if((u = pit_out_next(dev->pit.ch + 2, now)) < next) next = u;
+      return dev_tsc(emu, next, DEV_PIT_FREQ);
+
+    case 0x70:
+      return ~0ULL;
+
+    case 0x71:
+      switch(dev->rtc.index) {
+        case 0x00:
+        case 0x02:
+        case 0x04:
+        case 0x06:
+        case 0x07:
+        case 0x08:
+        case 0x09:
+        case 0x32:
+        case 0x0a:
+          // time changes each second, update in progress flag 8 ticks before
+          now = dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ);
+          next = now - now % DEV_RTC_FREQ;
+          next += now % DEV_RTC_FREQ < DEV_RTC_FREQ - 8 ? DEV_RTC_FREQ - 8 : DEV_RTC_FREQ;
+          return dev_tsc(emu, next, DEV_RTC_FREQ);
+
+        case 0x0c:
+          return 0;
+      }
+      return ~0ULL;
+  }
+
+  return 0;
+}
+
+
+/*
+ * PIT counter and output state at 'now' (in pit ticks).
+ *
+ * Note: BCD counting is not emulated.
+ */
+void pit_state(dev_pit_channel_t *c, u64 now, unsigned *count, unsigned *out)
+{
+  u64 e;
+  unsigned pos, high;
+
+  if(!c->running) {
+    *count = c->count;
+    *out = c->out;
+
+    return;
+  }
+
+  e = now - c->start;
+
+  switch(c->mode) {
+    case 2:
+      *count = c->reload - e % c->reload;
+      *out = *count != 1;
+      break;
+
+    case 3:
+      pos = e % c->reload;
+      high = (c->reload + 1) / 2;
+      if(pos < high) {
+        *count = c->reload - 2 * pos;
+        *out = 1;
+      }
+      else {
+        *count = c->reload - 2 * (pos - high);
+        *out = 0;
+      }
+      break;
+
+    default:
+      if(e < c->reload) {
+        *count = c->reload - e;
+        *out = c->mode >= 4;
+      }
+      else {
+        *count = c->reload - e;
+        *out = c->mode < 4 || e != c->reload;
+      }
+      break;
+  }
+
+  *count &= 0xffff;
+}
+
+
+/*
+ * Number of rising output edges since counting started.
+ */
+u64 pit_edges(dev_pit_channel_t *c, u64 now)
+{
+  u64 e = now - c->start;
+
+  switch(c->mode) {
+    case 2:
+    case 3:
+      return e / c->reload;
+
+    case 4:
+    case 5:
+      return e > c->reload;
+
+    default:
+      return e >= c->reload;
+  }
+}
+
+
+/*
+ * Pit ticks of next output change after 'now', ~0 if none.
+ */
+u64 pit_out_next(dev_pit_channel_t *c, u64 now)
+{
+  u64 e, base;
+  unsigned pos;
+
+  if(!c->running) return ~0ULL;
+
+  e = now - c->start;
+
+  switch(c->mode) {
+    case 2:
+      base = c->start + e - e % c->reload;
+      pos = e % c->reload;
+      return base + (pos < c->reload - 1 ? c->reload - 1 : c->reload);
+
+    case 3:
+      base = c->start + e - e % c->reload;
+      pos = e % c->reload;
+      return base + (pos < (c->reload + 1) / 2 ? (c->reload + 1) / 2 : c->reload);
+
+    case 4:
+    case 5:
+      if(e <= c->reload) return c->start + (e < c->reload ? c->reload : c->reload + 1);
+      return ~0ULL;
+
+    default:
+      return e < c->reload ? c->start + c->reload : ~0ULL;
+  }
+}
+
+
+void pit_start(dev_pit_channel_t *c, u64 now)
+{
+  c->start = now;
+  c->edges = 0;
+  c->running = 1;
+}
+
+
+void pit_stop(dev_pit_channel_t *c, u64 now)
+{
+  unsigned count, out;
+
+  pit_state(c, now, &count, &out);
+
+  c->count = count;
+  c->out = out;
+  c->running = 0;
+}
+
+
+void pit_latch(dev_pit_channel_t *c, u64 now)
+{
+  unsigned out;
+
+  if(c->latched) return;
+
+  pit_state(c, now, &c->latch, &out);
+  c->latched = c->rw == 3 ? 2 : 1;
+}
+
+
+void pit_control(x86emu_t *emu, unsigned val, u64 now)
+{
+  dev_pit_channel_t *c;
+  unsigned u, count, out;
+
+  // read-back command
+  if((val >> 6) == 3) {
+    for(u = 0; u < 3; u++) {
+      if(!(val & (2 << u))) continue;
+      c = emu->priv->dev->pit.ch + u;
+      if(!(val & 0x20)) pit_latch(c, now);
+      if(!(val & 0x10) && !c->status_latched) {
+        pit_state(c, now, &count, &out);
+        c->status = (out << 7) + (c->rw << 4) + (c->mode << 1) + c->bcd;
+        c->status_latched = 1;
+      }
+    }
+
+    return;
+  }
+
+  c = emu->priv->dev->pit.ch + (val >> 6);
+
+  // counter latch command
+  if(!(val & 0x30)) {
+    pit_latch(c, now);
+
+    return;
+  }
+
+  pit_stop(c, now);
+
+  c->rw = (val >> 4) & 3;
+  c->mode = (val >> 1) & 7;
+  if(c->mode > 5) c->mode -= 4;
+  c->bcd = val & 1;
+  c->out = c->mode ? 1 : 0;
+  c->reload = 0;
+  c->latched = c->status_latched = 0;
+  c->read_msb = c->write_msb = 0;
+
+  emu->priv->dev->next_event = 0;
+}
+
+
+void pit_load(x86emu_t *emu, unsigned ch, unsigned val, u64 now)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch + ch;
+  unsigned gate = ch != 2 || (emu->priv->dev->pit.port61 & 1);
+
+  c->reload = val ? val : 0x10000;
+
+  // modes 1 and 5 wait for a gate trigger
+  if(gate && c->mode != 1 && c->mode != 5) {
+    pit_start(c, now);
+  }
+  else {
+    c->running = 0;
+    c->count = val;
+  }
+
+  emu->priv->dev->next_event = 0;
+}
+
+
+/*
+ * Channel 2 gate (port 0x61, bit 0) changed.
+ */
+void pit_gate(x86emu_t *emu, unsigned gate, u64 now)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch + 2;
+  u64 e;
+
+  if(!c->reload) return;
+
+  if(!gate) {
+    if(c->running && c->mode != 1 && c->mode != 5) {
+      pit_stop(c, now);
+      if(c->mode == 2 || c->mode == 3) c->out = 1;
+    }
+
+    return;
+  }
+
+  if(c->mode == 0 || c->mode == 4) {
+    // continue counting
+    if(!c->running) {
+      e = c->count && c->count <= c->reload ? c->reload - c->count : c->reload;
+      if(e > now) e = now;
+      pit_start(c, now - e);
+      c->edges = pit_edges(c, now);
+    }
+  }
+  else {
+    pit_start(c, now);
+  }
+}
+
+
+unsigned pit_read(x86emu_t *emu, unsigned ch, u64 now)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch + ch;
+  unsigned count, out, msb;
+
+  if(c->status_latched) {
+    c->status_latched = 0;
+
+    return c->status;
+  }
+
+  if(c->latched) {
+    count = c->latch;
+    msb = c->rw == 2 || (c->rw == 3 && c->latched == 1);
+    c->latched--;
+  }
+  else {
+    pit_state(c, now, &count, &out);
+    msb = c->rw == 2 || (c->rw == 3 && c->read_msb);
+    if(c->rw == 3) c->read_msb ^= 1;
+  }
+
+  return msb ? count >> 8 : count & 0xff;
+}
+
+
+void pit_write(x86emu_t *emu, unsigned ch, unsigned val, u64 now)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch + ch;
+
+  switch(c->rw) {
+    case 1:
+      pit_load(emu, ch, val, now);
+      break;
+
+    case 2:
+      pit_load(emu, ch, val << 8, now);
+      break;
+
+    case 3:
+      if(!c->write_msb) {
+        c->write_lsb = val;
+        c->write_msb = 1;
+        // mode 0 stops counting after the first byte
+        if(c->mode == 0 && c->running) {
+          pit_stop(c, now);
+          c->out = 0;
+        }
+      }
+      else {
+        c->write_msb = 0;
+        pit_load(emu, ch, c->write_lsb + (val << 8), now);
+      }
+      break;
+  }
+}
+
+
+/*
+ * Timer 0 drives irq 0.
+ */
+void pit_update(x86emu_t *emu)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch;
+  u64 edges;
+
+  if(!c->running) return;
+
+  edges = pit_edges(c, dev_ticks(emu, emu->x86.R_TSC, DEV_PIT_FREQ));
+
+  if(edges > c->edges) {
+    c->edges = edges;
+    pic_irq(emu, 0);
+  }
+}
+
+
+/*
+ * R_TSC of next timer 0 irq.
+ */
+u64 pit_next(x86emu_t *emu)
+{
+  dev_pit_channel_t *c = emu->priv->dev->pit.ch;
+  u64 ticks;
+
+  if(!c->running) return ~0ULL;
+
+  switch(c->mode) {
+    case 2:
+    case 3:
+      ticks = (c->edges + 1) * c->reload;
+      break;
+
+    case 4:
+    case 5:
+      if(c->edges) return ~0ULL;
+      ticks = c->reload + 1;
+      break;
+
+    default:
+      if(c->edges) return ~0ULL;
+      ticks = c->reload;
+      break;
+  }
+
+  return dev_tsc(emu, c->start + ticks, DEV_PIT_FREQ);
+}
+
+
+void pic_irq(x86emu_t *emu, unsigned irq)
+{
+  emu->priv->dev->pic[irq >> 3].irr |= 1 << (irq & 7);
+}
+
+
+/*
+ * Highest priority unmasked irq not blocked by one in service, or -1.
+ */
+int pic_pending(dev_pic_t *pic, unsigned irr)
+{
+  unsigned u;
+
+  if(pic->icw) return -1;
+
+  irr &= ~pic->imr;
+
+  for(u = 0; u < 8; u++) {
+    if(pic->isr & (1 << u)) break;
+    if(irr & (1 << u)) return u;
+  }
+
+  return -1;
+}
+
+
+/*
+ * Check for interrupt request; if 'ack' is set, acknowledge it.
+ *
+ * Returns interrupt vector, -1 if there is none.
+ */
+int pic_vector(x86emu_t *emu, int ack)
+{
+  dev_pic_t *master = emu->priv->dev->pic, *slave = emu->priv->dev->pic + 1;
+  int irq, slave_irq;
+
+  if(!(emu->priv->dev->devices & X86EMU_DEV_PIC)) return -1;
+
+  slave_irq = master->single ? -1 : pic_pending(slave, slave->irr);
+  irq = pic_pending(master, master->irr | (slave_irq >= 0 ? 1 << 2 : 0));
+
+  if(irq < 0) return -1;
+
+  if(!ack) return master->base + irq;
+
+  master->irr &= ~(1 << irq);
+  if(!master->auto_eoi) master->isr |= 1 << irq;
+
+  if(irq == 2 && slave_irq >= 0) {
+    slave->irr &= ~(1 << slave_irq);
+    if(!slave->auto_eoi) slave->isr |= 1 << slave_irq;
+
+    return slave->base + slave_irq;
+  }
+
+  return master->base + irq;
+}
+
+
+unsigned pic_read(x86emu_t *emu, unsigned port)
+{
+  dev_pic_t *pic = emu->priv->dev->pic + (port >> 7);
+
+  if(port & 1) return pic->imr;
+
+  return pic->read_isr ? pic->isr : pic->irr;
+}
+
+
+void pic_write(x86emu_t *emu, unsigned port, unsigned val)
+{
+  dev_pic_t *pic = emu->priv->dev->pic + (port >> 7);
+
+  emu->priv->dev->next_event = 0;
+
+  if(port & 1) {
+    switch(pic->icw) {
+      case 2:
+        pic->base = val & 0xf8;
+        pic->icw = pic->single ? (pic->icw4 ? 4 : 0) : 3;
+        break;
+
+      case 3:
+        pic->icw = pic->icw4 ? 4 : 0;
+        break;
+
+      case 4:
+        pic->auto_eoi = (val >> 1) & 1;
+        pic->icw = 0;
+        break;
+
+      default:
+        pic->imr = val;
+        break;
+    }
+
+    return;
+  }
+
+  // ICW1
+  if(val & 0x10) {
+    pic->icw = 2;
+    pic->icw4 = val & 1;
+    pic->single = (val >> 1) & 1;
+    pic->irr = pic->isr = pic->imr = 0;
+    pic->auto_eoi = pic->read_isr = 0;
+
+    return;
+  }
+
+  // OCW3
+  if(val & 0x08) {
+    if(val & 2) pic->read_isr = val & 1;
+
+    return;
+  }
+
+  // OCW2; rotation is not supported
+  switch(val >> 5) {
+    case 1:
+    case 5:
+      // non-specific EOI
+      pic->isr &= pic->isr - 1;
+      break;
+
+    case 3:
+    case 7:
+      // specific EOI
+      pic->isr &= ~(1 << (val & 7));
+      break;
+  }
+}
+
+
+/*
+ * Periodic interrupt rate in RTC ticks.
+ */
+unsigned rtc_period(unsigned rate)
+{
+  if(!rate) return 0;
+
+  return rate <= 2 ? 1 << (rate + 6) : 1 << (rate - 1);
+}
+
+
+/*
+ * Current RTC time in seconds since 1970.
+ */
+s64 rtc_time(x86emu_t *emu)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+
+  if(dev->rtc.ram[0x0b] & 0x80) return dev->rtc.frozen;
+
+  return dev->rtc.offset + (s64) (dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ) / DEV_RTC_FREQ);
+}
+
+
+void rtc_set_time(x86emu_t *emu, s64 t)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+
+  if(dev->rtc.ram[0x0b] & 0x80) {
+    dev->rtc.frozen = t;
+  }
+  else {
+    dev->rtc.offset = t - (s64) (dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ) / DEV_RTC_FREQ);
+  }
+}
+
+
+/*
+ * Binary value to register format (BCD unless DM bit is set).
+ */
+unsigned rtc_encode(x86emu_t *emu, unsigned val)
+{
+  if(emu->priv->dev->rtc.ram[0x0b] & 0x04) return val;
+
+  return ((val / 10) << 4) + val % 10;
+}
+
+
+unsigned rtc_decode(x86emu_t *emu, unsigned val)
+{
+  if(emu->priv->dev->rtc.ram[0x0b] & 0x04) return val;
+
+  return (val >> 4) * 10 + (val & 0x0f);
+}
+
+
+/*
+ * Time register 'idx' for time 't'.
+ */
+unsigned rtc_time_reg(x86emu_t *emu, s64 t, unsigned idx)
+{
+  time_t tt = t;
+  struct tm tm;
+  unsigned hour;
+
+  gmtime_r(&tt, &tm);
+
+  switch(idx) {
+    case 0x00:
+      return rtc_encode(emu, tm.tm_sec);
+
+    case 0x02:
+      return rtc_encode(emu, tm.tm_min);
+
+    case 0x04:
+      if(emu->priv->dev->rtc.ram[0x0b] & 0x02) return rtc_encode(emu, tm.tm_hour);
+      hour = tm.tm_hour % 12 ? tm.tm_hour % 12 : 12;
+      return rtc_encode(emu, hour) + (tm.tm_hour >= 12 ? 0x80 : 0);
+
+    case 0x06:
+      return rtc_encode(emu, tm.tm_wday + 1);
+
+    case 0x07:
+      return rtc_encode(emu, tm.tm_mday);
+
+    case 0x08:
+      return rtc_encode(emu, tm.tm_mon + 1);
+
+    case 0x09:
+      return rtc_encode(emu, tm.tm_year % 100);
+
+    case 0x32:
+      return rtc_encode(emu, (tm.tm_year + 1900) / 100);
+  }
+
+  return 0;
+}
+
+
+unsigned rtc_read(x86emu_t *emu, unsigned idx)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  unsigned val, ticks;
+
+  switch(idx) {
+    case 0x00:
+    case 0x02:
+    case 0x04:
+    case 0x06:
+    case 0x07:
+    case 0x08:
+    case 0x09:
+    case 0x32:
+      return rtc_time_reg(emu, rtc_time(emu), idx);
+
+    case 0x0a:
+      // update in progress: last 244 us of each second
+      val = dev->rtc.ram[0x0a] & 0x7f;
+      ticks = dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ) % DEV_RTC_FREQ;
+      if(!(dev->rtc.ram[0x0b] & 0x80) && ticks >= DEV_RTC_FREQ - 8) val |= 0x80;
+      return val;
+
+    case 0x0c:
+      rtc_update(emu);
+      val = dev->rtc.ram[0x0c];
+      dev->rtc.ram[0x0c] = 0;
+      dev->next_event = 0;
+      return val;
+
+    case 0x0d:
+      // valid RAM and time
+      return 0x80;
+  }
+
+  return dev->rtc.ram[idx];
+}
+
+
+void rtc_write(x86emu_t *emu, unsigned idx, unsigned val)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  time_t tt = rtc_time(emu);
+  struct tm tm;
+  unsigned u;
+
+  gmtime_r(&tt, &tm);
+
+  switch(idx) {
+    case 0x00:
+      tm.tm_sec = rtc_decode(emu, val);
+      break;
+
+    case 0x02:
+      tm.tm_min = rtc_decode(emu, val);
+      break;
+
+    case 0x04:
+      if(dev->rtc.ram[0x0b] & 0x02) {
+        tm.tm_hour = rtc_decode(emu, val);
+      }
+      else {
+        u = rtc_decode(emu, val & 0x7f) % 12;
+        tm.tm_hour = u + (val & 0x80 ? 12 : 0);
+      }
+      break;
+
+    case 0x06:
+      // derived from date
+      return;
+
+    case 0x07:
+      tm.tm_mday = rtc_decode(emu, val);
+      break;
+
+    case 0x08:
+      tm.tm_mon = rtc_decode(emu, val) - 1;
+      break;
+
+    case 0x09:
+      tm.tm_year = (tm.tm_year + 1900) / 100 * 100 + rtc_decode(emu, val) - 1900;
+      break;
+
+    case 0x32:
+      tm.tm_year = rtc_decode(emu, val) * 100 + (tm.tm_year + 1900) % 100 - 1900;
+      break;
+
+    case 0x0a:
+      dev->rtc.ram[0x0a] = val & 0x7f;
+      dev->next_event = 0;
+      return;
+
+    case 0x0b:
+      if((val ^ dev->rtc.ram[0x0b]) & 0x80) {
+        rtc_update(emu);
+        if(val & 0x80) {
+          dev->rtc.frozen = tt;
+          dev->rtc.ram[0x0b] = val & ~0x10;
+        }
+        else {
+          dev->rtc.ram[0x0b] = val;
+          rtc_set_time(emu, dev->rtc.frozen);
+        }
+      }
+      else {
+        dev->rtc.ram[0x0b] = val;
+      }
+      dev->next_event = 0;
+      return;
+
+    case 0x0c:
+    case 0x0d:
+      return;
+
+    default:
+      dev->rtc.ram[idx] = val;
+      return;
+  }
+
+  rtc_set_time(emu, timegm(&tm));
+}
+
+
+/*
+ * Update RTC status flags and raise irq 8.
+ */
+void rtc_update(x86emu_t *emu)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u8 *ram = dev->rtc.ram;
+  u64 now = dev_ticks(emu, emu->x86.R_TSC, DEV_RTC_FREQ), last = dev->rtc.last, sec;
+  unsigned flags = 0, period, u, match;
+  s64 t;
+
+  if(now <= last) return;
+
+  dev->rtc.last = now;
+
+  period = rtc_period(ram[0x0a] & 0x0f);
+  if(period && now / period > last / period) flags |= 0x40;
+
+  if(!(ram[0x0b] & 0x80) && now / DEV_RTC_FREQ > last / DEV_RTC_FREQ) {
+    flags |= 0x10;
+
+    // check alarm for every second passed (up to a day)
+    sec = now / DEV_RTC_FREQ - last / DEV_RTC_FREQ;
+    t = dev->rtc.offset + (s64) (last / DEV_RTC_FREQ);
+    if(sec > 86400) {
+      t += sec - 86400;
+      sec = 86400;
+    }
+    for(; sec && !(flags & 0x20); sec--) {
+      t++;
+      for(match = 1, u = 0; u < 6 && match; u += 2) {
+        if((ram[u + 1] & 0xc0) != 0xc0 && ram[u + 1] != rtc_time_reg(emu, t, u)) match = 0;
+      }
+      if(match) flags |= 0x20;
+    }
+  }
+
+  if(!(ram[0x0c] & 0x80) && (flags & ram[0x0b] & 0x70)) {
+    flags |= 0x80;
+    pic_irq(emu, 8);
+  }
+
+  ram[0x0c] |= flags;
+}
+
+
+/*
+ * R_TSC of next RTC irq.
+ */
+u64 rtc_next(x86emu_t *emu)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  u8 *ram = dev->rtc.ram;
+  u64 now = dev->rtc.last, next = ~0ULL;
+  unsigned period;
+
+  // irq line stays active until register C is read
+  if(ram[0x0c] & 0x80) return next;
+
+  period = rtc_period(ram[0x0a] & 0x0f);
+  if((ram[0x0b] & 0x40) && period) next = (now / period + 1) * period;
+
+  if((ram[0x0b] & 0x30) && !(ram[0x0b] & 0x80) && (now / DEV_RTC_FREQ + 1) * DEV_RTC_FREQ < next) {
+    next = (now / DEV_RTC_FREQ + 1) * DEV_RTC_FREQ;
+  }
+
+  return next == ~0ULL ? next : dev_tsc(emu, next, DEV_RTC_FREQ);
+}
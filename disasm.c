@@ -0,0 +1,231 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Disassemble single instructions for trace decoders: the instruction is
+*   run in a scratch emulator object and its decoded text taken.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static void disasm_instr(x86emu_t *emu, const x86emu_event_t *ev);
+
+
+/*
+ * Disassemble the instruction at eip (code32: 32 bit code segment); len
+ * code bytes are available.
+ *
+ * emu is not modified; it only keeps a scratch object and a cache of
+ * recent results.
+ *
+ * Returns 0 on success, -1 if the instruction could not be decoded.
+ */
+API_SYM int x86emu_disasm(x86emu_t *emu, u32 eip, unsigned code32, const unsigned char *code, unsigned len, x86emu_disasm_t *instr)
+{
+  struct x86emu_disasm_s *dis;
+  x86emu_t *s;
+  unsigned u, idx;
+
+  if(!emu || !code || !len || !instr) return -1;
+
+  code32 = code32 ? 1 : 0;
+  if(len > sizeof dis->cache[0].bytes) len = sizeof dis->cache[0].bytes;
+
+  if(!(dis = emu->priv->disasm) && !(dis = emu->priv->disasm = calloc(1, sizeof *dis))) return -1;
+
+  idx = (eip ^ (code[0] << 4)) & (DISASM_CACHE - 1);
+
+  if(
+    dis->cache[idx].instr.len &&
+    dis->cache[idx].instr.len <= len &&
+    dis->cache[idx].eip == eip &&
+    dis->cache[idx].code32 == code32 &&
+    !memcmp(dis->cache[idx].bytes, code, dis->cache[idx].instr.len)
+  ) {
+    *instr = dis->cache[idx].instr;
+
+    return 0;
+  }
+
+  if(!(s = dis->emu)) {
+    if(!(s = dis->emu = x86emu_new(X86EMU_PERM_R | X86EMU_PERM_W | X86EMU_PERM_X, 0))) return -1;
+    x86emu_set_event_handler(s, X86EMU_EVENT_INSTR, disasm_instr);
+  }
+
+  x86emu_reset(s);
+
+  s->x86.R_CS = 0;
+  s->x86.R_CS_BASE = 0;
+  s->x86.R_CS_LIMIT = ~0;
+  if(code32) s->x86.R_CS_ACC |= 1 << 10;
+  s->x86.R_EIP = eip;
+
+  for(u = 0; u < len; u++) {
+    x86emu_write_byte(s, code32 ? eip + u : (eip + u) & 0xffff, code[u]);
+  }
+
+  instr->len = 0;
+  s->_private = instr;
+  s->max_instr = s->x86.R_TSC + 1;
+  x86emu_run(s, X86EMU_RUN_MAX_INSTR);
+  s->_private = NULL;
+
+  if(!instr->len || instr->len > len) return -1;
+
+  instr->branch = disasm_branch(code, instr->len, code32, eip, &instr->target, &instr->next);
+
+  dis->cache[idx].eip = eip;
+  dis->cache[idx].code32 = code32;
+  memcpy(dis->cache[idx].bytes, code, instr->len);
+  dis->cache[idx].instr = *instr;
+
+  return 0;
+}
+
+
+/*
+ * Instruction event of scratch object: store result.
+ */
+void disasm_instr(x86emu_t *emu, const x86emu_event_t *ev)
+{
+  x86emu_disasm_t *instr = emu->_private;
+  unsigned u = emu->x86.disasm_ptr - emu->x86.disasm_buf;
+
+  if(!instr) return;
+
+  if(u >= sizeof instr->text) u = sizeof instr->text - 1;
+  memcpy(instr->text, emu->x86.disasm_buf, u);
+  instr->text[u] = 0;
+
+  instr->len = ev->instr.len;
+}
+
+
+/*
+ * Get branch type (X86EMU_BRANCH_*) of the len byte instruction in buf,
+ * the target of direct branches (else 0), and the address of the next
+ * instruction (for calls: the return address pushed).
+ */
+unsigned disasm_branch(const unsigned char *buf, unsigned len, unsigned code32, u32 eip, u32 *target, u32 *next)
+{
+  unsigned u, op, data32 = code32, type = X86EMU_BRANCH_NONE, call = 0;
+  s32 ofs = 0;
+
+  for(u = 0; u < len; u++) {
+    switch(buf[u]) {
+      case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+      case 0x67: case 0xf0: case 0xf2: case 0xf3:
+        continue;
+      case 0x66:
+        data32 ^= 1;
+        continue;
+    }
+    break;
+  }
+
+  // prefixes only: no branch
+  op = u < len ? buf[u] : 0;
+
+  if((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3)) op = 0x70;
+
+  switch(op) {
+    case 0x70:
+      type = X86EMU_BRANCH_COND;
+      ofs = (s8) buf[len - 1];
+      break;
+
+    case 0x0f:
+      if(u + 1 < len && buf[u + 1] >= 0x80 && buf[u + 1] <= 0x8f) {
+        type = X86EMU_BRANCH_COND;
+        ofs = data32 ? (s32) (buf[len - 4] + (buf[len - 3] << 8) + (buf[len - 2] << 16) + ((u32) buf[len - 1] << 24)) : (s16) (buf[len - 2] + (buf[len - 1] << 8));
+      }
+      break;
+
+    case 0xeb:
+      type = X86EMU_BRANCH_JUMP;
+      ofs = (s8) buf[len - 1];
+      break;
+
+    case 0xe8:
+    case 0xe9:
+      type = op == 0xe8 ? X86EMU_BRANCH_CALL : X86EMU_BRANCH_JUMP;
+      call = op == 0xe8;
+      ofs = data32 ? (s32) (buf[len - 4] + (buf[len - 3] << 8) + (buf[len - 2] << 16) + ((u32) buf[len - 1] << 24)) : (s16) (buf[len - 2] + (buf[len - 1] << 8));
+      break;
+
+    case 0xc2:
+    case 0xc3:
+      type = X86EMU_BRANCH_RET;
+      break;
+
+    case 0x9a: case 0xea: case 0xca: case 0xcb: case 0xcf:
+      type = X86EMU_BRANCH_FAR;
+      call = op == 0x9a;
+      break;
+
+    case 0xff:
+      if(u + 1 < len) {
+        switch((buf[u + 1] >> 3) & 7) {
+          case 2:
+            type = X86EMU_BRANCH_ICALL;
+            call = 1;
+            break;
+          case 3: case 5:
+            type = X86EMU_BRANCH_FAR;
+            call = ((buf[u + 1] >> 3) & 7) == 3;
+            break;
+          case 4:
+            type = X86EMU_BRANCH_IJUMP;
+            break;
+        }
+      }
+      break;
+  }
+
+  *next = eip + len;
+  *target = *next + ofs;
+
+  // target and pushed return address have operand size, eip has code size
+  if(!data32) *target &= 0xffff;
+  if(type != X86EMU_BRANCH_COND && type != X86EMU_BRANCH_CALL && type != X86EMU_BRANCH_JUMP) *target = 0;
+  if(call ? !data32 : !code32) *next &= 0xffff;
+
+  return type;
+}
+
+struct x86emu_disasm_s *disasm_free(struct x86emu_disasm_s *dis)
+{
+  if(dis) {
+    x86emu_done(dis->emu);
+    free(dis);
+  }
+
+  return NULL;
+}
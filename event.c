@@ -0,0 +1,173 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Event callbacks: report instructions, memory and port accesses,
+*   interrupts, and mode switches as plain structs.
+*
+*   The event mask is evaluated at the start of x86emu_run().
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static unsigned event_cur_mode(x86emu_t *emu);
+
+
+/*
+ * Set event handler for the events in mask (X86EMU_EVENT_*).
+ *
+ * Returns previous handler.
+ */
+API_SYM x86emu_event_handler_t x86emu_set_event_handler(x86emu_t *emu, unsigned mask, x86emu_event_handler_t handler)
+{
+  x86emu_event_handler_t old;
+
+  if(!emu) return NULL;
+
+  if(!emu->priv->event) {
+    if(!handler || !mask) return NULL;
+    if(!(emu->priv->event = calloc(1, sizeof *emu->priv->event))) return NULL;
+  }
+
+  old = emu->priv->event->handler;
+
+  emu->priv->event->handler = handler;
+  emu->priv->event->mask = handler ? mask : 0;
+
+  /* events can be turned off while running, but not on */
+  emu->priv->event->active &= emu->priv->event->mask;
+
+  return old;
+}
+
+
+/*
+ * Called at start of x86emu_run().
+ */
+void event_start(x86emu_t *emu)
+{
+  emu->priv->event->active = emu->priv->event->mask;
+  emu->priv->event->mode = event_cur_mode(emu);
+}
+
+
+/*
+ * Instruction has been executed.
+ */
+void event_instr(x86emu_t *emu)
+{
+  x86emu_event_t ev;
+
+  ev.type = X86EMU_EVENT_INSTR;
+  ev.tsc = emu->x86.R_TSC;
+  ev.instr.cs = emu->x86.saved_cs;
+  ev.instr.eip = emu->x86.saved_eip;
+  ev.instr.len = emu->x86.instr_len;
+  ev.instr.bytes = emu->x86.instr_buf;
+
+  emu->priv->event->handler(emu, &ev);
+}
+
+
+/*
+ * Memory or port access.
+ */
+void event_access(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err)
+{
+  x86emu_event_t ev;
+  unsigned bits = type & 0xff;
+
+  type &= ~0xff;
+
+  ev.type = type >= X86EMU_MEMIO_I ? X86EMU_EVENT_IO : X86EMU_EVENT_MEM;
+
+  if(!(emu->priv->event->active & ev.type)) return;
+
+  ev.tsc = emu->x86.R_TSC;
+  ev.access.addr = addr;
+  ev.access.val = val;
+  ev.access.size = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+  ev.access.type = type;
+  ev.access.err = err;
+
+  emu->priv->event->handler(emu, &ev);
+}
+
+
+/*
+ * Interrupt or fault is about to be delivered.
+ */
+void event_intr(x86emu_t *emu)
+{
+  x86emu_event_t ev;
+
+  ev.type = X86EMU_EVENT_INTR;
+  ev.tsc = emu->x86.R_TSC;
+  ev.intr.nr = emu->x86.intr_nr;
+  ev.intr.type = emu->x86.intr_type;
+  ev.intr.errcode = emu->x86.intr_errcode;
+  ev.intr.cs = emu->x86.saved_cs;
+  ev.intr.eip = emu->x86.saved_eip;
+
+  emu->priv->event->handler(emu, &ev);
+}
+
+
+/*
+ * Check for mode switch; called before each instruction.
+ */
+void event_mode(x86emu_t *emu)
+{
+  x86emu_event_t ev;
+  unsigned mode = event_cur_mode(emu);
+
+  if(mode == emu->priv->event->mode) return;
+
+  ev.type = X86EMU_EVENT_MODE;
+  ev.tsc = emu->x86.R_TSC;
+  ev.mode.old_mode = emu->priv->event->mode;
+  ev.mode.new_mode = mode;
+
+  emu->priv->event->mode = mode;
+
+  emu->priv->event->handler(emu, &ev);
+}
+
+
+unsigned event_cur_mode(x86emu_t *emu)
+{
+  unsigned mode = 0;
+
+  if((emu->x86.R_CR0 & 1)) mode |= X86EMU_EVENT_MODE_PE;
+  if(ACC_D(emu->x86.R_CS_ACC)) mode |= X86EMU_EVENT_MODE_CODE32;
+  if(ACC_D(emu->x86.R_SS_ACC)) mode |= X86EMU_EVENT_MODE_STACK32;
+
+  return mode;
+}
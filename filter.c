@@ -0,0 +1,201 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Trace filters. Tracing can be limited to code ranges, R_TSC windows,
+*   and (for X86EMU_TRACE_DATA) data address ranges.
+*
+*   Outside code ranges and R_TSC windows, the trace flags are removed from
+*   the effective trace flags (emu->priv->trace), so untraced code runs at
+*   normal speed. emu->log.trace is never changed.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+
+/*
+ * Add filter range [start, end] (inclusive); type is X86EMU_FILTER_*.
+ *
+ * Ranges of the same type are or-ed, different types are and-ed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_add_trace_filter(x86emu_t *emu, unsigned type, u64 start, u64 end)
+{
+  struct x86emu_filter_s *filter;
+  filter_range_t *range;
+
+  if(!emu || type > X86EMU_FILTER_TSC || start > end) return -1;
+
+  if(!emu->priv->filter) {
+    if(!(emu->priv->filter = calloc(1, sizeof *emu->priv->filter))) return -1;
+    emu->priv->filter->in = 1;
+  }
+
+  filter = emu->priv->filter;
+
+  range = realloc(filter->range[type], (filter->ranges[type] + 1) * sizeof *range);
+  if(!range) return -1;
+
+  filter->range[type] = range;
+  range[filter->ranges[type]].start = start;
+  range[filter->ranges[type]++].end = end;
+
+  /* force re-check */
+  filter->lo = 1;
+  filter->hi = 0;
+
+  return 0;
+}
+
+
+/*
+ * Remove all filters.
+ */
+API_SYM void x86emu_clear_trace_filters(x86emu_t *emu)
+{
+  if(!emu) return;
+
+  emu->priv->filter = filter_free(emu->priv->filter);
+}
+
+
+/*
+ * Check current cs:eip and R_TSC, remove filtered flags from
+ * emu->priv->trace.
+ *
+ * Called before each instruction; the result is cached for the linear
+ * address range [lo, hi] until R_TSC reaches next_tsc.
+ */
+void filter_update(x86emu_t *emu)
+{
+  struct x86emu_filter_s *filter = emu->priv->filter;
+  filter_range_t *r;
+  u32 lin = emu->x86.R_CS_BASE + emu->x86.R_EIP;
+  u32 in_lo = 0, in_hi = ~0, out_lo = 0, out_hi = ~0;
+  u64 tsc = emu->x86.R_TSC, next_tsc = ~0ULL, end;
+  unsigned u, code_in = 1, tsc_in = 1;
+
+  if(lin >= filter->lo && lin <= filter->hi && tsc < filter->next_tsc) {
+    if(!filter->in) emu->priv->trace &= ~FILTER_TRACE_MASK;
+
+    return;
+  }
+
+  if(filter->ranges[X86EMU_FILTER_CODE]) {
+    code_in = 0;
+    for(u = 0; u < filter->ranges[X86EMU_FILTER_CODE]; u++) {
+      r = filter->range[X86EMU_FILTER_CODE] + u;
+      end = r->end > 0xffffffff ? 0xffffffff : r->end;
+      if(lin >= r->start && lin <= end) {
+        code_in = 1;
+        if(r->start > in_lo) in_lo = r->start;
+        if(end < in_hi) in_hi = end;
+      }
+      else if(end < lin) {
+        if(end + 1 > out_lo) out_lo = end + 1;
+      }
+      else if(r->start - 1 < out_hi) {
+        out_hi = r->start - 1;
+      }
+    }
+  }
+
+  if(filter->ranges[X86EMU_FILTER_TSC]) {
+    tsc_in = 0;
+    for(u = 0; u < filter->ranges[X86EMU_FILTER_TSC]; u++) {
+      r = filter->range[X86EMU_FILTER_TSC] + u;
+      if(tsc >= r->start && tsc <= r->end) {
+        tsc_in = 1;
+        if(r->end + 1 < next_tsc && r->end != ~0ULL) next_tsc = r->end + 1;
+      }
+      else if(r->start > tsc && r->start < next_tsc) {
+        next_tsc = r->start;
+      }
+    }
+  }
+
+  filter->lo = code_in ? in_lo : out_lo;
+  filter->hi = code_in ? in_hi : out_hi;
+  filter->next_tsc = next_tsc;
+
+  filter->in = code_in && tsc_in;
+
+  if(!filter->in) emu->priv->trace &= ~FILTER_TRACE_MASK;
+}
+
+
+/*
+ * Check data address against X86EMU_FILTER_DATA ranges.
+ *
+ * Returns 1 if it should be logged.
+ */
+int filter_data(x86emu_t *emu, u32 addr)
+{
+  struct x86emu_filter_s *filter = emu->priv->filter;
+  filter_range_t *r;
+  unsigned u;
+
+  if(!filter->ranges[X86EMU_FILTER_DATA]) return 1;
+
+  for(u = 0; u < filter->ranges[X86EMU_FILTER_DATA]; u++) {
+    r = filter->range[X86EMU_FILTER_DATA] + u;
+    if(addr >= r->start && addr <= r->end) return 1;
+  }
+
+  return 0;
+}
+
+
+struct x86emu_filter_s *filter_clone(struct x86emu_filter_s *filter)
+{
+  struct x86emu_filter_s *new_filter;
+  unsigned u;
+
+  new_filter = mem_dup(filter, sizeof *filter);
+  for(u = 0; u < sizeof filter->range / sizeof *filter->range; u++) {
+    new_filter->range[u] = mem_dup(filter->range[u], filter->ranges[u] * sizeof *filter->range[u]);
+  }
+
+  return new_filter;
+}
+
+
+struct x86emu_filter_s *filter_free(struct x86emu_filter_s *filter)
+{
+  unsigned u;
+
+  if(filter) {
+    for(u = 0; u < sizeof filter->range / sizeof *filter->range; u++) free(filter->range[u]);
+    free(filter);
+  }
+
+  return NULL;
+}
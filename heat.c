@@ -0,0 +1,229 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Memory access heatmap: read, write, and execute counters per cache line,
+*   collected in vm_memio(). Page counters are derived from them.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+// hash the line number: line addresses have their low bits clear
+#define HEAT_HASH(a)	(((a) / X86EMU_HEAT_LINE_SIZE) * 0x9e3779b1u)
+#define HEAT_USED(e)	((e)->r || (e)->w || (e)->x)
+
+static int heat_cmp(const void *a, const void *b);
+
+
+/*
+ * Turn heatmap on or off. Turning it on again clears all counters.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_heatmap(x86emu_t *emu, int on)
+{
+  struct x86emu_heat_s *heat;
+
+  if(!emu) return -1;
+
+  emu->priv->heat = heat_free(emu->priv->heat);
+
+  if(!on) return 0;
+
+  if(!(heat = calloc(1, sizeof *heat))) return -1;
+
+  heat->size = 1024;
+  if(!(heat->entry = calloc(heat->size, sizeof *heat->entry))) {
+    heat_free(heat);
+
+    return -1;
+  }
+
+  emu->priv->heat = heat;
+
+  return 0;
+}
+
+
+/*
+ * Get access counters per cache line (X86EMU_HEAT_LINES) or per page
+ * (X86EMU_HEAT_PAGES), sorted by address. Only accessed lines (pages) are
+ * listed.
+ *
+ * The list is valid until the next x86emu_get_heatmap() or
+ * x86emu_set_heatmap() call.
+ */
+API_SYM const x86emu_heat_entry_t *x86emu_get_heatmap(x86emu_t *emu, unsigned type, unsigned *entries)
+{
+  struct x86emu_heat_s *heat;
+  x86emu_heat_entry_t *list;
+  unsigned u, lines, n = 0;
+
+  if(entries) *entries = 0;
+
+  if(!emu || !(heat = emu->priv->heat)) return NULL;
+
+  free(heat->list);
+  if(!(list = heat->list = malloc((heat->entries + 1) * sizeof *list))) return NULL;
+
+  for(u = 0; u < heat->size; u++) {
+    if(HEAT_USED(heat->entry + u)) list[n++] = heat->entry[u];
+  }
+
+  qsort(list, n, sizeof *list, heat_cmp);
+
+  if(type == X86EMU_HEAT_PAGES && n) {
+    lines = n;
+    list[0].addr &= ~(X86EMU_PAGE_SIZE - 1);
+    for(u = 1, n = 1; u < lines; u++) {
+      if((list[u].addr & ~(X86EMU_PAGE_SIZE - 1)) == list[n - 1].addr) {
+        list[n - 1].r += list[u].r;
+        list[n - 1].w += list[u].w;
+        list[n - 1].x += list[u].x;
+      }
+      else {
+        list[n] = list[u];
+        list[n++].addr &= ~(X86EMU_PAGE_SIZE - 1);
+      }
+    }
+  }
+
+  if(entries) *entries = n;
+
+  return list;
+}
+
+
+/*
+ * Count memory access; type is X86EMU_MEMIO_R, _W, or _X.
+ */
+void heat_count(struct x86emu_heat_s *heat, u32 addr, unsigned type)
+{
+  x86emu_heat_entry_t *entry, *e;
+  unsigned u, mask = heat->size - 1, idx;
+
+  addr &= ~(X86EMU_HEAT_LINE_SIZE - 1);
+
+  e = heat->entry + heat->last;
+
+  if(e->addr != addr || !HEAT_USED(e)) {
+    for(idx = HEAT_HASH(addr) & mask; HEAT_USED(e = heat->entry + idx); idx = (idx + 1) & mask) {
+      if(e->addr == addr) break;
+    }
+
+    if(!HEAT_USED(e)) {
+      if(2 * (heat->entries + 1) > heat->size) {
+        if(!(entry = calloc(2 * heat->size, sizeof *entry))) return;
+        mask = 2 * heat->size - 1;
+        for(u = 0; u < heat->size; u++) {
+          if(!HEAT_USED(heat->entry + u)) continue;
+          for(idx = HEAT_HASH(heat->entry[u].addr) & mask; HEAT_USED(entry + idx); idx = (idx + 1) & mask);
+          entry[idx] = heat->entry[u];
+        }
+        free(heat->entry);
+        heat->entry = entry;
+        heat->size *= 2;
+        for(idx = HEAT_HASH(addr) & mask; HEAT_USED(e = heat->entry + idx); idx = (idx + 1) & mask);
+      }
+
+      e->addr = addr;
+      heat->entries++;
+    }
+
+    heat->last = e - heat->entry;
+  }
+
+  switch(type) {
+    case X86EMU_MEMIO_R:
+      e->r++;
+      break;
+    case X86EMU_MEMIO_W:
+      e->w++;
+      break;
+    default:
+      e->x++;
+      break;
+  }
+}
+
+
+/*
+ * Log counters per page.
+ */
+void heat_dump(x86emu_t *emu)
+{
+  const x86emu_heat_entry_t *e;
+  unsigned u, entries;
+
+  e = x86emu_get_heatmap(emu, X86EMU_HEAT_PAGES, &entries);
+
+  x86emu_log(emu, "; - - memory accesses per page (read, write, exec)\n");
+
+  for(u = 0; u < entries; u++) {
+    x86emu_log(emu,
+      "%08x: %12llu %12llu %12llu\n",
+      e[u].addr, (unsigned long long) e[u].r, (unsigned long long) e[u].w, (unsigned long long) e[u].x
+    );
+  }
+
+  x86emu_log(emu, "\n");
+}
+
+
+int heat_cmp(const void *a, const void *b)
+{
+  const x86emu_heat_entry_t *e1 = a, *e2 = b;
+
+  return e1->addr < e2->addr ? -1 : e1->addr > e2->addr;
+}
+
+
+struct x86emu_heat_s *heat_clone(struct x86emu_heat_s *heat)
+{
+  struct x86emu_heat_s *new_heat;
+
+  new_heat = mem_dup(heat, sizeof *heat);
+  new_heat->entry = mem_dup(heat->entry, heat->size * sizeof *heat->entry);
+  new_heat->list = NULL;
+
+  return new_heat;
+}
+
+
+struct x86emu_heat_s *heat_free(struct x86emu_heat_s *heat)
+{
+  if(heat) {
+    free(heat->entry);
+    free(heat->list);
+    free(heat);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,179 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Interrupt cost accounting. For each vector, count guest instructions
+*   and host time from entry via generate_int() to the matching iret.
+*
+*   The iret is matched by the stack address of the return frame. Nested
+*   interrupts are accounted to both the inner and (not as 'self') the
+*   outer vector.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static void icost_add(x86emu_t *emu, u8 nr, u64 instrs, u64 ns, u64 child_instrs, u64 child_ns);
+
+
+/*
+ * Turn interrupt cost accounting on or off. Turning it on again clears
+ * all counters.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_intr_cost(x86emu_t *emu, int on)
+{
+  if(!emu) return -1;
+
+  free(emu->priv->icost);
+  emu->priv->icost = NULL;
+
+  if(!on) return 0;
+
+  if(!(emu->priv->icost = calloc(1, sizeof *emu->priv->icost))) return -1;
+
+  return 0;
+}
+
+
+/*
+ * Get interrupt costs, indexed by vector (0x100 entries).
+ *
+ * Returns NULL if accounting is off.
+ */
+API_SYM const x86emu_intr_cost_t *x86emu_get_intr_cost(x86emu_t *emu)
+{
+  return emu && emu->priv->icost ? emu->priv->icost->cost : NULL;
+}
+
+
+/*
+ * Interrupt entry; the return frame has just been pushed.
+ */
+void icost_enter(x86emu_t *emu, u8 nr, unsigned type)
+{
+  struct x86emu_icost_s *icost = emu->priv->icost;
+  icost_frame_t *f;
+
+  if((type & 0xff) == INTR_TYPE_HW) icost->cost[nr].irqs++;
+
+  if(icost->depth >= ICOST_DEPTH) {
+    icost->lost++;
+    return;
+  }
+
+  f = icost->frame + icost->depth++;
+
+  f->sp = emu->x86.R_SS_BASE + (MODE_STACK32 ? emu->x86.R_ESP : emu->x86.R_SP);
+  f->nr = nr;
+  f->tsc = emu->x86.R_TSC;
+  f->ns = host_ns();
+  f->child_instrs = f->child_ns = 0;
+}
+
+
+/*
+ * Interrupt handled by intr or bios handler; ns is the time spent there.
+ */
+void icost_handled(x86emu_t *emu, u8 nr, unsigned type, u64 ns)
+{
+  if((type & 0xff) == INTR_TYPE_HW) emu->priv->icost->cost[nr].irqs++;
+
+  icost_add(emu, nr, 0, ns, 0, 0);
+}
+
+
+/*
+ * Called before iret pops the return frame.
+ */
+void icost_iret(x86emu_t *emu)
+{
+  struct x86emu_icost_s *icost = emu->priv->icost;
+  icost_frame_t *f;
+  u32 sp;
+
+  sp = emu->x86.R_SS_BASE + (MODE_STACK32 ? emu->x86.R_ESP : emu->x86.R_SP);
+
+  /* drop frames that have been left some other way */
+  while(icost->depth && icost->frame[icost->depth - 1].sp < sp) {
+    icost->depth--;
+    icost->lost++;
+  }
+
+  if(!icost->depth || icost->frame[icost->depth - 1].sp != sp) return;
+
+  f = icost->frame + --icost->depth;
+
+  /* R_TSC has not been incremented for iret yet */
+  icost_add(emu, f->nr, emu->x86.R_TSC - f->tsc, host_ns() - f->ns, f->child_instrs, f->child_ns);
+}
+
+
+void icost_add(x86emu_t *emu, u8 nr, u64 instrs, u64 ns, u64 child_instrs, u64 child_ns)
+{
+  struct x86emu_icost_s *icost = emu->priv->icost;
+  x86emu_intr_cost_t *c = icost->cost + nr;
+
+  c->calls++;
+  c->instrs += instrs;
+  c->self_instrs += instrs - child_instrs;
+  c->ns += ns;
+  c->self_ns += ns - child_ns;
+  if(ns > c->max_ns) c->max_ns = ns;
+
+  if(icost->depth) {
+    icost->frame[icost->depth - 1].child_instrs += instrs;
+    icost->frame[icost->depth - 1].child_ns += ns;
+  }
+}
+
+
+void icost_dump(x86emu_t *emu)
+{
+  x86emu_intr_cost_t *c;
+  unsigned u;
+
+  x86emu_log(emu, "; - - interrupt cost (instructions, ms)\n");
+
+  for(u = 0; u < 0x100; u++) {
+    c = emu->priv->icost->cost + u;
+    if(!c->calls) continue;
+    x86emu_log(emu,
+      "int %02x: calls %llu (irq %llu), instr %llu (self %llu), time %.3f (self %.3f, max %.3f)\n",
+      u, (unsigned long long) c->calls, (unsigned long long) c->irqs,
+      (unsigned long long) c->instrs, (unsigned long long) c->self_instrs,
+      c->ns / 1e6, c->self_ns / 1e6, c->max_ns / 1e6
+    );
+  }
+
+  if(emu->priv->icost->depth || emu->priv->icost->lost) {
+    x86emu_log(emu, "active %u, lost %llu\n", emu->priv->icost->depth, (unsigned long long) emu->priv->icost->lost);
+  }
+}
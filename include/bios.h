@@ -0,0 +1,58 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the native BIOS services.
+*
+****************************************************************************/
+
+
+
+typedef struct {
+  u8 intr;
+  u16 func, mask;	/* (AX & mask) == func */
+  x86emu_bios_handler_t handler;
+  void *ctx;
+} bios_shim_t;
+
+typedef struct {
+  u64 base, size;
+  unsigned type;	/* e820 type */
+} bios_mem_t;
+
+struct x86emu_bios_s {
+  u8 map[0x100 >> 3];	/* interrupts with registered handlers */
+  unsigned shims;
+  bios_shim_t *shim;
+  unsigned mems;
+  bios_mem_t *mem;	/* int 0x15 memory map */
+};
+
+int bios_call(x86emu_t *emu, u8 intr);
+struct x86emu_bios_s *bios_clone(struct x86emu_bios_s *bios);
+struct x86emu_bios_s *bios_free(struct x86emu_bios_s *bios);
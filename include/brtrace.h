@@ -0,0 +1,67 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+* Description:
+*   Header file for the branch trace.
+*
+****************************************************************************/
+
+
+
+#define BRTRACE_MIN_BUF		0x4000	/* min. buffer size; a page record needs 4k */
+#define BRTRACE_MAX_REC		(X86EMU_BRTRACE_MAGIC_LEN + 32)	/* max. size of other records */
+#define BRTRACE_STACK		64	/* call stack for return compression */
+
+/* cpu state as seen by the decoder */
+typedef struct {
+  u32 eip;
+  u32 base;
+  u16 cs;
+  unsigned code32:1;
+} brtrace_state_t;
+
+struct x86emu_brtrace_s {
+  x86emu_flush_func_t flush;
+  unsigned char *buf;
+  unsigned size;		/* allocated */
+  unsigned used;
+  u64 count;			/* instructions */
+  u64 last_pos;			/* count of last positioned record */
+  unsigned tnt;			/* pending taken/not taken bits, with end marker */
+  brtrace_state_t cur;		/* next instruction */
+  u32 stack[BRTRACE_STACK];	/* return addresses */
+  unsigned sp;			/* stack[sp - 1] is top */
+  unsigned depth;		/* valid entries */
+  unsigned char **shadow[1 << 10];	/* code pages as sent */
+  unsigned started:1;
+};
+
+void brtrace_start(x86emu_t *emu);
+void brtrace_instr(x86emu_t *emu, unsigned intr);
+void brtrace_input(x86emu_t *emu, u32 port, u32 val, unsigned type, unsigned err);
+void brtrace_stop(x86emu_t *emu, unsigned rs);
+void brtrace_close(x86emu_t *emu);
@@ -0,0 +1,57 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the binary trace format.
+*
+****************************************************************************/
+
+
+
+/* max. records a single event needs */
+#define BTRACE_MAX_RECS		16
+
+/* x86emu_btrace_s.valid bits; bits 0-2: addr[] */
+#define BTRACE_VALID_CS		(1 << 3)
+#define BTRACE_VALID_TSC	(1 << 4)
+
+struct x86emu_btrace_s {
+  u64 tsc;		/* R_TSC of last code record */
+  u32 addr[3];		/* last address, indexed by X86EMU_BTRACE_ADDR_* */
+  u16 cs;		/* cs of last code record */
+  unsigned valid;	/* BTRACE_VALID_*; cleared with the log buffer */
+};
+
+void btrace_code(x86emu_t *emu);
+void btrace_regs(x86emu_t *emu);
+void btrace_memio(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err);
+void btrace_acc(x86emu_t *emu, unsigned seg, u32 ofs, unsigned size);
+void btrace_descr(x86emu_t *emu, u32 dl, u32 dh);
+void btrace_intr(x86emu_t *emu, unsigned nr, unsigned type);
+void btrace_text(x86emu_t *emu, const char *s, unsigned len);
+void btrace_run(x86emu_t *emu, unsigned rs);
@@ -0,0 +1,80 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the call-graph profiler.
+*
+****************************************************************************/
+
+
+
+#define CG_DEPTH	256	/* max. tracked call depth */
+
+/* calling context tree node; node 0 is the root */
+typedef struct {
+  u32 addr;			/* function entry (linear) */
+  unsigned parent;
+  unsigned child;		/* first child, 0 = none */
+  unsigned next;		/* next sibling */
+  u64 calls;
+  u64 instrs, ns;		/* inclusive */
+  u64 self_instrs, self_ns;
+} cg_node_t;
+
+typedef struct {
+  u32 sp;			/* linear stack address of the return address */
+  unsigned node;
+  u64 tsc, ns;			/* at entry */
+} cg_frame_t;
+
+typedef struct {
+  u32 addr;
+  char *name;
+} cg_sym_t;
+
+struct x86emu_cg_s {
+  unsigned nodes;		/* used nodes */
+  unsigned max;			/* allocated nodes */
+  cg_node_t *node;
+  unsigned cur;			/* current node */
+  unsigned depth;
+  u64 lost;			/* calls beyond CG_DEPTH */
+  u64 tsc, ns;			/* last call or return */
+  u64 ns_ofs;			/* time spent outside x86emu_run() */
+  u64 stop_ns;
+  cg_frame_t frame[CG_DEPTH];
+  unsigned syms;
+  cg_sym_t *sym;		/* sorted by addr */
+};
+
+void cg_start(x86emu_t *emu);
+void cg_stop(x86emu_t *emu);
+void cg_call(x86emu_t *emu);
+void cg_ret(x86emu_t *emu);
+struct x86emu_cg_s *cg_clone(struct x86emu_cg_s *cg);
+struct x86emu_cg_s *cg_free(struct x86emu_cg_s *cg);
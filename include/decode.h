@@ -50,6 +50,57 @@
   memcpy((emu)->x86.disasm_ptr, (emu)->x86.decode_seg, 4), \
   (emu)->x86.disasm_ptr += (emu)->x86.default_seg ? 4 : 1
 
+/* polling loop detection, see X86EMU_RUN_POLL */
+#define POLL_MAX_LOOP		64	/* max. loop size in bytes */
+#define POLL_MAX_INPUTS		4	/* max. port reads per iteration */
+
+struct x86emu_poll_s {
+  x86emu_poll_handler_t handler;
+  u64 tsc;			/* R_TSC at loop head */
+  u64 until;			/* inputs stay the same up to this R_TSC */
+  u64 max_instr;
+  u16 cs;
+  u32 eip;			/* loop head */
+  struct i386_general_regs gen;
+  struct i386_special_regs spc;
+  sel_t seg[8];
+  struct {
+    u16 port, len;
+  } input[POLL_MAX_INPUTS];
+  unsigned inputs;
+  unsigned active:1;
+  unsigned unsafe:1;		/* iteration had side effects */
+};
+
+/* register delta trace, see X86EMU_TRACE_REGS_DELTA */
+#define RDELTA_KEYFRAME		1024	/* full register dump every n instructions */
+
+struct x86emu_rdelta_s {
+  unsigned valid:1;		/* reg[] and xmm[] hold the last logged state */
+  unsigned xmm_valid:1;
+  unsigned count;		/* deltas since last full dump */
+  u32 reg[16];
+  I128_reg_t xmm[8];
+};
+
+/* disassembly cache for code trace, see log_code() */
+#define DCACHE_SIZE		4096	/* entries, power of 2 */
+#define DCACHE_TEXT		120	/* max. cached text length */
+
+typedef struct {
+  u32 eip;
+  u16 cs;
+  u8 len;			/* instruction length, 0: unused */
+  u8 text_len;
+  unsigned mode;		/* _MODE_CODE32 | _MODE_STACK32 */
+  u8 bytes[16];			/* instruction bytes */
+  char text[DCACHE_TEXT];	/* cs:eip, bytes, and disassembly */
+} dcache_entry_t;
+
+struct x86emu_dcache_s {
+  dcache_entry_t entry[DCACHE_SIZE];
+};
+
 #define DECODE_HEX1(ofs) decode_hex1((emu), &(emu)->x86.disasm_ptr, ofs)
 #define DECODE_HEX2(ofs) decode_hex2((emu), &(emu)->x86.disasm_ptr, ofs)
 #define DECODE_HEX4(ofs) decode_hex4((emu), &(emu)->x86.disasm_ptr, ofs)
@@ -89,6 +140,10 @@ u32 fetch_io_long(x86emu_t *emu, u32 offset);
 void store_io_byte(x86emu_t *emu, u32 port, u8 val);
 void store_io_word(x86emu_t *emu, u32 port, u16 val);
 void store_io_long(x86emu_t *emu, u32 port, u32 val);
+unsigned emu_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
+void intr_raise(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err);
+u32 block_io(x86emu_t *emu, u32 port, sel_t *seg, u32 ofs, u32 count, unsigned size, unsigned type);
+sel_t *get_data_segment(x86emu_t *emu);
 u8* decode_rm_byte_register(x86emu_t *emu, int reg);
 u16* decode_rm_word_register(x86emu_t *emu, int reg);
 u32* decode_rm_long_register(x86emu_t *emu, int reg);
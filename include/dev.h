@@ -0,0 +1,115 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the built-in PIT, PIC, RTC and PCI device models.
+*
+****************************************************************************/
+
+
+#define DEV_PIT_FREQ		1193182
+#define DEV_RTC_FREQ		32768
+
+#define DEV_DEF_CLOCK		100000000
+/* 2000-01-01 00:00:00 UTC */
+#define DEV_DEF_RTC_TIME	946684800
+
+typedef struct {
+  u64 start;		/* pit ticks when counting started */
+  u64 edges;		/* output edges since start already passed to the pic */
+  unsigned reload;	/* 1 - 0x10000 */
+  unsigned count;	/* count while stopped */
+  unsigned latch;
+  unsigned mode:3;
+  unsigned rw:2;
+  unsigned bcd:1;
+  unsigned running:1;
+  unsigned out:1;	/* output while stopped */
+  unsigned latched:2;	/* latched count bytes left */
+  unsigned status_latched:1;
+  unsigned status:8;
+  unsigned read_msb:1;
+  unsigned write_msb:1;
+  unsigned write_lsb:8;
+} dev_pit_channel_t;
+
+typedef struct {
+  u8 irr, isr, imr;
+  u8 base;		/* vector base (ICW2) */
+  u8 icw;		/* next expected ICW, 0: initialized */
+  unsigned icw4:1;
+  unsigned single:1;
+  unsigned auto_eoi:1;
+  unsigned read_isr:1;
+} dev_pic_t;
+
+typedef struct {
+  u8 bus, devfn;
+  u8 config[256];
+  u32 bar_mask[7];	/* writable bits of BAR 0 - 5 and ROM BAR */
+} dev_pci_t;
+
+struct x86emu_dev_s {
+  unsigned devices;	/* X86EMU_DEV_* */
+  u32 clock;		/* emulated instructions per second */
+  u64 next_event;	/* R_TSC of next device event */
+
+  struct {
+    dev_pit_channel_t ch[3];
+    u8 port61;
+  } pit;
+
+  dev_pic_t pic[2];
+
+  struct {
+    s64 offset;		/* rtc seconds - elapsed seconds */
+    s64 frozen;		/* time while SET bit is active */
+    u64 last;		/* rtc ticks at last update */
+    u8 index;
+    u8 ram[128];
+  } rtc;
+
+  struct {
+    u32 addr;		/* port 0xcf8 */
+    unsigned devs;
+    dev_pci_t *dev;	/* sorted by bus, devfn */
+  } pci;
+};
+
+void dev_update(x86emu_t *emu);
+int dev_halt(x86emu_t *emu);
+int dev_port(x86emu_t *emu, unsigned port);
+u64 dev_poll(x86emu_t *emu, unsigned port, unsigned bits, unsigned type);
+unsigned dev_rtc_read(x86emu_t *emu, unsigned idx);
+void dev_reset(x86emu_t *emu);
+struct x86emu_dev_s *dev_clone(struct x86emu_dev_s *dev);
+struct x86emu_dev_s *dev_free(struct x86emu_dev_s *dev);
+
+u32 pci_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits);
+void pci_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits);
+int pci_bios(x86emu_t *emu, void *ctx);
@@ -0,0 +1,49 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the disassembler interface.
+*
+****************************************************************************/
+
+
+
+#define DISASM_CACHE		1024	/* power of 2 */
+
+struct x86emu_disasm_s {
+  x86emu_t *emu;		/* scratch object the code is run in */
+  struct {
+    u32 eip;
+    unsigned char code32;
+    unsigned char bytes[16];
+    x86emu_disasm_t instr;	/* instr.len = 0: unused */
+  } cache[DISASM_CACHE];
+};
+
+unsigned disasm_branch(const unsigned char *buf, unsigned len, unsigned code32, u32 eip, u32 *target, u32 *next);
+struct x86emu_disasm_s *disasm_free(struct x86emu_disasm_s *dis);
@@ -0,0 +1,49 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for event callbacks.
+*
+****************************************************************************/
+
+
+
+#define EVENT_ON(emu, e)	((emu)->priv->event && ((emu)->priv->event->active & (e)))
+
+struct x86emu_event_s {
+  x86emu_event_handler_t handler;
+  unsigned mask;		/* X86EMU_EVENT_* */
+  unsigned active;		/* mask for current x86emu_run() */
+  unsigned mode;		/* X86EMU_EVENT_MODE_* */
+};
+
+void event_start(x86emu_t *emu);
+void event_instr(x86emu_t *emu);
+void event_access(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err);
+void event_intr(x86emu_t *emu);
+void event_mode(x86emu_t *emu);
@@ -0,0 +1,55 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for trace filters.
+*
+****************************************************************************/
+
+
+
+/* trace flags that are switched off outside of the filter ranges */
+#define FILTER_TRACE_MASK	(X86EMU_TRACE_REGS | X86EMU_TRACE_CODE | X86EMU_TRACE_DATA | \
+				 X86EMU_TRACE_ACC | X86EMU_TRACE_IO | X86EMU_TRACE_INTS)
+
+typedef struct {
+  u64 start, end;		/* inclusive */
+} filter_range_t;
+
+struct x86emu_filter_s {
+  unsigned ranges[3];		/* indexed by X86EMU_FILTER_* */
+  filter_range_t *range[3];
+  unsigned in:1;		/* tracing on */
+  u32 lo, hi;			/* linear cs:eip range with the same result */
+  u64 next_tsc;			/* re-check at this R_TSC */
+};
+
+void filter_update(x86emu_t *emu);
+int filter_data(x86emu_t *emu, u32 addr);
+struct x86emu_filter_s *filter_clone(struct x86emu_filter_s *filter);
+struct x86emu_filter_s *filter_free(struct x86emu_filter_s *filter);
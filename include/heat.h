@@ -0,0 +1,47 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the memory access heatmap.
+*
+****************************************************************************/
+
+
+
+struct x86emu_heat_s {
+  unsigned entries;		/* used entries */
+  unsigned size;		/* power of 2 */
+  x86emu_heat_entry_t *entry;	/* hash table of lines */
+  unsigned last;		/* index of last used entry */
+  x86emu_heat_entry_t *list;	/* see x86emu_get_heatmap() */
+};
+
+void heat_count(struct x86emu_heat_s *heat, u32 addr, unsigned type);
+void heat_dump(x86emu_t *emu);
+struct x86emu_heat_s *heat_clone(struct x86emu_heat_s *heat);
+struct x86emu_heat_s *heat_free(struct x86emu_heat_s *heat);
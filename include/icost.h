@@ -0,0 +1,57 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for interrupt cost accounting.
+*
+****************************************************************************/
+
+
+
+#define ICOST_DEPTH	64	/* max. interrupt nesting */
+
+typedef struct {
+  u32 sp;			/* linear stack address after pushing the return frame */
+  u8 nr;
+  u64 tsc;			/* R_TSC at entry */
+  u64 ns;			/* host time at entry */
+  u64 child_instrs;		/* spent in nested interrupts */
+  u64 child_ns;
+} icost_frame_t;
+
+struct x86emu_icost_s {
+  unsigned depth;
+  u64 lost;			/* frames never left via iret */
+  icost_frame_t frame[ICOST_DEPTH];
+  x86emu_intr_cost_t cost[0x100];
+};
+
+void icost_enter(x86emu_t *emu, u8 nr, unsigned type);
+void icost_handled(x86emu_t *emu, u8 nr, unsigned type, u64 ns);
+void icost_iret(x86emu_t *emu);
+void icost_dump(x86emu_t *emu);
@@ -0,0 +1,70 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the i/o record/replay journal.
+*
+****************************************************************************/
+
+
+
+/*
+ * Journal layout: JOURNAL_MAGIC, then a sequence of records, each starting
+ * with a type byte. All values are stored little-endian.
+ *
+ * JOURNAL_MEMIO + (X86EMU_MEMIO_* >> 8 << 2) + size [+ JOURNAL_ERR]:
+ *   i/o port (2 bytes) or address (4 bytes), value (1, 2, or 4 bytes)
+ * JOURNAL_CPUID: eax, ebx, ecx, edx
+ * JOURNAL_RDMSR: eax, edx, msr access bits (1 byte)
+ * JOURNAL_INTR: R_TSC (8 bytes), interrupt (1 byte), type, error code
+ */
+#define JOURNAL_MAGIC		"xej\x01"
+#define JOURNAL_MAGIC_LEN	4
+
+#define JOURNAL_MEMIO		0x00
+#define JOURNAL_ERR		0x20
+#define JOURNAL_CPUID		0x80
+#define JOURNAL_RDMSR		0x81
+#define JOURNAL_INTR		0x82
+
+struct x86emu_journal_s {
+  unsigned mode;	/* X86EMU_JOURNAL_* */
+  unsigned char *buf;
+  unsigned size;	/* used */
+  unsigned max;		/* allocated */
+  unsigned pos;		/* replay position */
+  unsigned error:1;	/* replay diverged from journal */
+};
+
+unsigned journal_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
+void journal_cpuid(x86emu_t *emu);
+void journal_rdmsr(x86emu_t *emu);
+void journal_intr(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err);
+void journal_replay_intr(x86emu_t *emu);
+struct x86emu_journal_s *journal_clone(struct x86emu_journal_s *journal);
+struct x86emu_journal_s *journal_free(struct x86emu_journal_s *journal);
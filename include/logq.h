@@ -0,0 +1,58 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for asynchronous log flushing.
+*
+****************************************************************************/
+
+
+#include <pthread.h>
+
+typedef struct {
+  char *buf;
+  unsigned len;
+} logq_buf_t;
+
+struct x86emu_logq_s {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;		/* signalled when queue or free list change */
+  unsigned mode;		/* X86EMU_LOG_BLOCK, X86EMU_LOG_DROP */
+  unsigned buffers;		/* total buffers, including emu->log.buf */
+  logq_buf_t *queue;		/* full buffers, ring of 'buffers' entries */
+  unsigned head, count;
+  char **free_buf;		/* empty buffers */
+  unsigned free_count;
+  u64 dropped;			/* bytes */
+  unsigned busy:1;		/* flush() running */
+  unsigned stop:1;
+};
+
+void logq_put(x86emu_t *emu, unsigned len);
+void logq_free(x86emu_t *emu);
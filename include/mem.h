@@ -32,7 +32,110 @@
 ****************************************************************************/
 
 
+/*
+ * Page table entry.
+ *
+ * If MEM2_PAGE_ALLOC is set, the entry points to a page block consisting of
+ * the permission attributes, the emulated page data and a pointer to the
+ * mapped page data (see x86emu_set_page()). The lower bits of the (aligned)
+ * block address hold MEM2_PAGE_* flags. If MEM2_PAGE_MAPPED is not set, data
+ * is the emulated page data right behind the attributes.
+ *
+ * Writes to pages with MEM2_PAGE_TRACK set (see x86emu_map_framebuffer())
+ * set MEM2_PAGE_DIRTY.
+ *
+ * If MEM2_PAGE_ALLOC is not set, bits 8-15 hold the default attributes
+ * used when the block is allocated.
+ */
+typedef uintptr_t mem2_page_t;
+
+typedef mem2_page_t mem2_ptable_t[1 << X86EMU_PTABLE_BITS];
+typedef mem2_ptable_t *mem2_pdir_t[1 << X86EMU_PDIR_BITS];
+
+struct x86emu_mem_s {
+  mem2_pdir_t *pdir;
+  unsigned invalid:1;
+  unsigned char def_attr;
+  x86emu_perf_counters_t *perf;	/* X86EMU_PERF_MEM counters */
+};
+
+#define MEM2_PAGE_ALLOC		(1 << 0)
+#define MEM2_PAGE_MAPPED	(1 << 1)
+#define MEM2_PAGE_TRACK		(1 << 2)
+#define MEM2_PAGE_DIRTY		(1 << 3)
+#define MEM2_PAGE_FLAGS		0x3f
+
+#define MEM2_BLOCK_ALIGN	(MEM2_PAGE_FLAGS + 1)
+#define MEM2_BLOCK_SIZE		(2 * X86EMU_PAGE_SIZE + sizeof (unsigned char *))
+
+#define MEM2_PAGE_DEF_ATTR(a)	((mem2_page_t) (a) << 8)
+
+static inline unsigned char *mem2_attr(mem2_page_t page)
+{
+  return (unsigned char *) (page & ~(mem2_page_t) MEM2_PAGE_FLAGS);
+}
+
+static inline unsigned char **mem2_map(mem2_page_t page)
+{
+  return (unsigned char **) (mem2_attr(page) + 2 * X86EMU_PAGE_SIZE);
+}
+
+static inline unsigned char *mem2_data(mem2_page_t page)
+{
+  return page & MEM2_PAGE_MAPPED ? *mem2_map(page) : mem2_attr(page) + X86EMU_PAGE_SIZE;
+}
+
+static inline unsigned mem2_def_attr(mem2_page_t page)
+{
+  return (page >> 8) & 0xff;
+}
+
+/*
+ * Emulated i/o device, see x86emu_set_io_handler().
+ */
+struct x86emu_io_handler_s {
+  x86emu_io_in_handler_t in;
+  x86emu_io_out_handler_t out;
+  x86emu_io_block_handler_t block;
+  void *ctx;
+  void *block_ctx;
+  unsigned refs;	/* ports using this entry; 0: free */
+};
+
+#define IO_MAX_HANDLERS		0xff
+
+/*
+ * i/o permissions, access statistics and handlers for IO_CHUNK_SIZE ports.
+ */
+#define IO_CHUNK_BITS		8
+#define IO_CHUNK_SIZE		(1 << IO_CHUNK_BITS)
+
+struct x86emu_io_chunk_s {
+  unsigned char map[IO_CHUNK_SIZE];
+  unsigned char handler[IO_CHUNK_SIZE];	/* index + 1 into io.handler */
+  unsigned stats_i[IO_CHUNK_SIZE];
+  unsigned stats_o[IO_CHUNK_SIZE];
+};
+
+struct x86emu_io_chunk_s *io_chunk_alloc(x86emu_t *emu, unsigned port);
+void io_account(x86emu_t *emu, unsigned port, unsigned len, unsigned type, unsigned count);
+
+static inline struct x86emu_io_chunk_s *io_chunk(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_io_chunk_s *c = emu->priv->io.chunk[(port & 0xffff) >> IO_CHUNK_BITS];
+
+  return c ? c : io_chunk_alloc(emu, port);
+}
+
+static inline unsigned io_handler(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_io_chunk_s *c = emu->priv->io.chunk[(port & 0xffff) >> IO_CHUNK_BITS];
+
+  return c ? c->handler[port & (IO_CHUNK_SIZE - 1)] : 0;
+}
+
 unsigned vm_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
+unsigned vm_io(x86emu_t *emu, u32 addr, u32 *val, unsigned type);
 x86emu_mem_t *emu_mem_new(unsigned perm);
 x86emu_mem_t *emu_mem_free(x86emu_mem_t *mem);
 x86emu_mem_t *emu_mem_clone(x86emu_mem_t *mem);
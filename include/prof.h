@@ -0,0 +1,55 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the sampling profiler.
+*
+****************************************************************************/
+
+
+
+struct x86emu_prof_s {
+  unsigned flags;		/* X86EMU_PROF_* */
+  u64 interval;
+  u64 next;			/* R_TSC (or R_REAL_TSC) of next sample */
+  unsigned frames;		/* stack depth */
+  u64 samples;
+  unsigned entries;		/* used entries */
+  unsigned max;			/* allocated entries */
+  x86emu_prof_entry_t *entry;
+  unsigned hash_size;		/* power of 2 */
+  unsigned *hash;		/* entry index + 1, 0 = free */
+};
+
+void prof_sample(x86emu_t *emu);
+int prof_pprof_header(FILE *f, u64 period);
+int prof_pprof_sample(FILE *f, u64 count, unsigned depth, u64 *pc);
+int prof_pprof_trailer(FILE *f);
+void prof_dump(x86emu_t *emu);
+struct x86emu_prof_s *prof_clone(struct x86emu_prof_s *prof);
+struct x86emu_prof_s *prof_free(struct x86emu_prof_s *prof);
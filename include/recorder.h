@@ -0,0 +1,67 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Header file for the flight recorder.
+*
+****************************************************************************/
+
+
+
+typedef struct {
+  u64 tsc;
+  struct i386_general_regs gen;		/* after the instruction */
+  struct i386_special_regs spc;
+  u16 cs;
+  u8 len;
+  u8 code32;
+  u8 bytes[16];
+} recorder_instr_t;
+
+typedef struct {
+  u64 tsc;
+  u32 addr;
+  u32 val;
+  u16 type;		/* X86EMU_MEMIO_* */
+  u16 err;
+} recorder_access_t;
+
+struct x86emu_recorder_s {
+  unsigned flags;		/* X86EMU_RECORDER_* */
+  unsigned mask;		/* entries - 1, entries is a power of 2 */
+  u64 instrs;			/* total instructions recorded */
+  u64 accesses;			/* total accesses recorded */
+  recorder_instr_t *instr;
+  recorder_access_t *access;
+};
+
+void recorder_instr(x86emu_t *emu);
+void recorder_access(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err);
+void recorder_dump(x86emu_t *emu);
+struct x86emu_recorder_s *recorder_clone(struct x86emu_recorder_s *rec);
+struct x86emu_recorder_s *recorder_free(struct x86emu_recorder_s *rec);
@@ -383,6 +383,7 @@ typedef struct {
 
 #define INTR_TYPE_SOFT		1
 #define INTR_TYPE_FAULT		2
+#define INTR_TYPE_HW		3	/* external interrupt (device models) */
 #define INTR_MODE_RESTART	0x100
 #define INTR_MODE_ERRCODE	0x200
 
@@ -391,6 +392,8 @@ typedef struct {
 #define X86EMU_RUN_NO_EXEC	(1 << 2)
 #define X86EMU_RUN_NO_CODE	(1 << 3)
 #define X86EMU_RUN_LOOP		(1 << 4)
+#define X86EMU_RUN_JOURNAL	(1 << 5)
+#define X86EMU_RUN_POLL		(1 << 6)
 
 #define X86EMU_MEMIO_8		0
 #define X86EMU_MEMIO_16		1
@@ -413,6 +416,74 @@ typedef void (* x86emu_cpuid_handler_t)(struct x86emu_s *);
 typedef void (* x86emu_wrmsr_handler_t)(struct x86emu_s *);
 typedef void (* x86emu_rdmsr_handler_t)(struct x86emu_s *);
 typedef void (* x86emu_flush_func_t)(struct x86emu_s *, char *buf, unsigned size);
+typedef u32 (* x86emu_io_in_handler_t)(struct x86emu_s *, void *ctx, u32 port, unsigned bits);
+typedef void (* x86emu_io_out_handler_t)(struct x86emu_s *, void *ctx, u32 port, u32 val, unsigned bits);
+typedef void (* x86emu_io_block_handler_t)(struct x86emu_s *, void *ctx, u32 port, unsigned type, unsigned count, void *buf);
+typedef u64 (* x86emu_poll_handler_t)(struct x86emu_s *, u32 port, u32 val, unsigned bits);
+typedef int (* x86emu_bios_handler_t)(struct x86emu_s *, void *ctx);
+
+#define X86EMU_EVENT_INSTR	(1 << 0)	/* instruction executed */
+#define X86EMU_EVENT_MEM	(1 << 1)	/* memory access */
+#define X86EMU_EVENT_IO		(1 << 2)	/* port access */
+#define X86EMU_EVENT_INTR	(1 << 3)	/* interrupt or fault */
+#define X86EMU_EVENT_MODE	(1 << 4)	/* mode switch */
+
+#define X86EMU_EVENT_MODE_PE		(1 << 0)	/* protected mode */
+#define X86EMU_EVENT_MODE_CODE32	(1 << 1)
+#define X86EMU_EVENT_MODE_STACK32	(1 << 2)
+
+/* see x86emu_set_event_handler() */
+typedef struct {
+  unsigned type;		/* X86EMU_EVENT_* */
+  u64 tsc;			/* R_TSC */
+  union {
+    struct {			/* X86EMU_EVENT_INSTR */
+      u16 cs;
+      u32 eip;
+      unsigned len;
+      const u8 *bytes;
+    } instr;
+    struct {			/* X86EMU_EVENT_MEM, X86EMU_EVENT_IO */
+      u32 addr;			/* address or port */
+      u32 val;
+      unsigned size;		/* 1, 2, or 4 */
+      unsigned type;		/* X86EMU_MEMIO_{R,W,X,I,O} */
+      unsigned err;
+    } access;
+    struct {			/* X86EMU_EVENT_INTR */
+      u8 nr;
+      unsigned type;		/* INTR_TYPE_* | INTR_MODE_* */
+      u32 errcode;
+      u16 cs;
+      u32 eip;
+    } intr;
+    struct {			/* X86EMU_EVENT_MODE */
+      unsigned old_mode;	/* X86EMU_EVENT_MODE_* */
+      unsigned new_mode;
+    } mode;
+  };
+} x86emu_event_t;
+
+typedef void (* x86emu_event_handler_t)(struct x86emu_s *, const x86emu_event_t *ev);
+
+/* branch types, see x86emu_disasm() */
+#define X86EMU_BRANCH_NONE	0
+#define X86EMU_BRANCH_COND	1	/* conditional branch */
+#define X86EMU_BRANCH_JUMP	2	/* direct near jump */
+#define X86EMU_BRANCH_CALL	3	/* direct near call */
+#define X86EMU_BRANCH_IJUMP	4	/* indirect near jump */
+#define X86EMU_BRANCH_ICALL	5	/* indirect near call */
+#define X86EMU_BRANCH_RET	6	/* near return */
+#define X86EMU_BRANCH_FAR	7	/* far jump, call, or return, iret */
+
+/* see x86emu_disasm() */
+typedef struct {
+  unsigned len;			/* instruction length */
+  unsigned branch;		/* X86EMU_BRANCH_* */
+  u32 target;			/* target of direct branches, else 0 */
+  u32 next;			/* eip of next instruction (return address of calls) */
+  char text[256];		/* disassembled instruction, as in the code log */
+} x86emu_disasm_t;
 
 typedef struct {
   struct i386_general_regs gen;
@@ -456,8 +527,159 @@ typedef struct {
 #define X86EMU_TRACE_INTS	(1 << 5)
 #define X86EMU_TRACE_TIME	(1 << 6)
 #define X86EMU_TRACE_DEBUG	(1 << 7)
+#define X86EMU_TRACE_BINARY	(1 << 8)
+#define X86EMU_TRACE_REGS_DELTA	(1 << 9)	/* with X86EMU_TRACE_REGS: log only changed registers */
 #define X86EMU_TRACE_DEFAULT	(X86EMU_TRACE_REGS | X86EMU_TRACE_CODE | X86EMU_TRACE_DATA | X86EMU_TRACE_IO | X86EMU_TRACE_INTS)
 
+/*
+ * Binary trace records (X86EMU_TRACE_BINARY), X86EMU_BTRACE_REC_SIZE bytes each:
+ *
+ *   type (1 byte), info (1 byte), delta (2 bytes, signed), value (4 bytes)
+ *
+ * All values are little-endian. Addresses are stored as delta to the previous
+ * address of the same kind (X86EMU_BTRACE_ADDR_*); X86EMU_BTRACE_ADDR sets a
+ * new base if the delta does not fit.
+ */
+#define X86EMU_BTRACE_REC_SIZE	8
+
+#define X86EMU_BTRACE_CODE	0x01	/* info: length + 0x80 (32 bit code), delta: eip, value: 4 code bytes */
+#define X86EMU_BTRACE_BYTES	0x02	/* info: length (max. 6), followed by data */
+#define X86EMU_BTRACE_MEMIO	0x03	/* info: (X86EMU_MEMIO_* >> 8) + (size << 4) + 0x80 (error), delta: address, value: data */
+#define X86EMU_BTRACE_ADDR	0x04	/* info: X86EMU_BTRACE_ADDR_*, value: address */
+#define X86EMU_BTRACE_CS	0x05	/* value: cs of the following code */
+#define X86EMU_BTRACE_TSC	0x06	/* delta + value: 48 bit R_TSC of the following code, else previous + 1 */
+#define X86EMU_BTRACE_TIME	0x07	/* delta + value: 48 bit real time stamp difference (X86EMU_TRACE_TIME) */
+#define X86EMU_BTRACE_INTR	0x08	/* info: INTR_TYPE_*, value: interrupt */
+#define X86EMU_BTRACE_REG	0x09	/* info: register (eax, ebx, ecx, edx, esi, edi, ebp, esp, cs, ss, ds, es, fs, gs, eip, eflags) */
+#define X86EMU_BTRACE_ACC	0x0a	/* info: size + (segment << 4), value: offset */
+#define X86EMU_BTRACE_DESCR	0x0b	/* info: 0 (low dword), 1 (high dword), value: descriptor */
+#define X86EMU_BTRACE_TEXT	0x0c	/* like X86EMU_BTRACE_BYTES; log text (x86emu_log(), debug instruction) */
+#define X86EMU_BTRACE_RUN	0x0d	/* value: x86emu_run() result, X86EMU_RUN_* */
+
+#define X86EMU_BTRACE_ADDR_MEM	0
+#define X86EMU_BTRACE_ADDR_IO	1
+#define X86EMU_BTRACE_ADDR_EIP	2
+
+/*
+ * Branch trace (x86emu_set_branch_trace()): X86EMU_BRTRACE_MAGIC, then a
+ * sequence of records. Numbers are stored as LEB128 (7 bits per byte, low
+ * bits first, 0x80: more bytes follow).
+ *
+ * A byte with bit 7 set holds up to 6 taken (1) / not taken (0) bits, first
+ * bit in the highest position, preceded by a 1 bit as end marker. There is
+ * one bit for each conditional branch and for each near return that has an
+ * entry on the call stack (1: returns to the address the matching call
+ * pushed). Other records flush pending bits first.
+ *
+ * X86EMU_BRTRACE_TARGET and X86EMU_BRTRACE_FAR give the target of indirect
+ * jumps and calls, far transfers, and mispredicted returns. The other records
+ * start with the instruction count since the previous one of these and apply
+ * before the instruction with that number (PAGE, CODE, INPUT: while it runs).
+ *
+ * Code pages are sent when first executed and when executed bytes change.
+ * If a page cannot be read directly (custom memory handler), only the bytes
+ * of the executed instruction are sent in a CODE record; other bytes are 0.
+ *
+ * cpu state (*): cs, cs base, code size (0: 16 bit, 1: 32 bit), eip
+ */
+#define X86EMU_BRTRACE_MAGIC	"xeb\x01"
+#define X86EMU_BRTRACE_MAGIC_LEN	4
+
+#define X86EMU_BRTRACE_TARGET	0x01	/* eip */
+#define X86EMU_BRTRACE_FAR	0x02	/* cpu state (*) */
+#define X86EMU_BRTRACE_JUMP	0x10	/* cpu state (*): continue there */
+#define X86EMU_BRTRACE_INTR	0x11	/* interrupt, INTR_TYPE_*, cpu state (*) after interrupt */
+#define X86EMU_BRTRACE_PAGE	0x12	/* page number, 4096 bytes: code page */
+#define X86EMU_BRTRACE_INPUT	0x13	/* port, X86EMU_MEMIO_* size + 0x80 (error), value: port input */
+#define X86EMU_BRTRACE_STOP	0x14	/* x86emu_run() result, X86EMU_RUN_* */
+#define X86EMU_BRTRACE_CODE	0x15	/* address, length, bytes: code not in a page record */
+
+#define X86EMU_LOG_BLOCK	0	/* x86emu_set_log_async(): wait for a free buffer */
+#define X86EMU_LOG_DROP		1	/* x86emu_set_log_async(): drop log if no buffer is free */
+
+#define X86EMU_RECORDER_DUMP_ERROR	(1 << 0)	/* dump if x86emu_run() stops because of X86EMU_RUN_* */
+#define X86EMU_RECORDER_DUMP_FAULT	(1 << 1)	/* dump on faults */
+
+#define X86EMU_PROF_FRAMES	8		/* max. stack depth incl. sampled instruction */
+#define X86EMU_PROF_REAL_TIME	(1 << 0)	/* x86emu_set_profiler(): interval is in real time stamp ticks */
+
+/*
+ * Profiler histogram entry: eip[0] is the sampled instruction, eip[1..] are
+ * return addresses (near calls). Linear address is cs_base + eip[].
+ */
+typedef struct {
+  u32 count;
+  u16 cs;
+  u16 frames;
+  u32 cs_base;
+  u32 eip[X86EMU_PROF_FRAMES];
+} x86emu_prof_entry_t;
+
+#define X86EMU_FILTER_CODE	0	/* x86emu_add_trace_filter(): cs:eip (linear) range */
+#define X86EMU_FILTER_DATA	1	/* x86emu_add_trace_filter(): data address range */
+#define X86EMU_FILTER_TSC	2	/* x86emu_add_trace_filter(): R_TSC range */
+
+#define X86EMU_COV_BLOCKS	(1 << 0)	/* count basic blocks */
+#define X86EMU_COV_INSTRS	(1 << 1)	/* count every instruction */
+#define X86EMU_COV_EDGES	(1 << 2)	/* AFL-style edge bitmap */
+
+/* coverage counter; entries with count 0 are unused */
+typedef struct {
+  u32 addr;		/* linear address */
+  u32 count;
+} x86emu_cov_entry_t;
+
+/* interrupt cost, see x86emu_get_intr_cost(); 'self' excludes nested interrupts */
+typedef struct {
+  u64 calls;
+  u64 irqs;		/* calls that were external interrupts (INTR_TYPE_HW) */
+  u64 instrs;		/* guest instructions incl. iret */
+  u64 self_instrs;
+  u64 ns;		/* host time */
+  u64 self_ns;
+  u64 max_ns;
+} x86emu_intr_cost_t;
+
+#define X86EMU_CG_CALLGRIND	0	/* x86emu_write_callgraph(): callgrind format */
+#define X86EMU_CG_PPROF		1	/* x86emu_write_callgraph(): legacy pprof CPU profile */
+
+#define X86EMU_HEAT_LINE_SIZE	64
+#define X86EMU_HEAT_LINES	0	/* x86emu_get_heatmap(): per cache line */
+#define X86EMU_HEAT_PAGES	1	/* x86emu_get_heatmap(): per page */
+
+/* memory access counters, see x86emu_get_heatmap() */
+typedef struct {
+  u32 addr;		/* start of line or page */
+  u64 r, w, x;
+} x86emu_heat_entry_t;
+
+#define X86EMU_PERF_INSTR	(1 << 0)	/* instructions, prefix bytes */
+#define X86EMU_PERF_MEMIO	(1 << 1)	/* memio handler calls */
+#define X86EMU_PERF_MEM		(1 << 2)	/* page walks and allocations */
+#define X86EMU_PERF_LOG		(1 << 3)	/* log flushes */
+#define X86EMU_PERF_INTR	(1 << 4)	/* interrupts */
+#define X86EMU_PERF_CALLBACK	(1 << 5)	/* time spent in callbacks */
+#define X86EMU_PERF_ALL		((1 << 6) - 1)
+
+#define X86EMU_PERF_CB_MEMIO		0	/* only if not the default memio handler */
+#define X86EMU_PERF_CB_INTR		1
+#define X86EMU_PERF_CB_CODE_CHECK	2
+#define X86EMU_PERF_CB_CPUID		3
+
+/* see x86emu_get_perf_counters() */
+typedef struct {
+  u64 instrs;
+  u64 prefixes;			/* prefix bytes */
+  u64 memio[5][4];		/* indexed by X86EMU_MEMIO_{R,W,X,I,O} >> 8 and X86EMU_MEMIO_{8,16,32,8_NOPERM} */
+  u64 page_walks;
+  u64 page_allocs;
+  u64 log_flushes;
+  u64 log_bytes;
+  u64 intrs;
+  u64 callbacks[4];		/* indexed by X86EMU_PERF_CB_* */
+  u64 callback_ns[4];
+} x86emu_perf_counters_t;
+
 #define X86EMU_DUMP_REGS	(1 << 0)
 #define X86EMU_DUMP_MEM		(1 << 1)
 #define X86EMU_DUMP_ACC_MEM	(1 << 2)
@@ -467,6 +689,9 @@ typedef struct {
 #define X86EMU_DUMP_IO		(1 << 6)
 #define X86EMU_DUMP_INTS	(1 << 7)
 #define X86EMU_DUMP_TIME	(1 << 8)
+#define X86EMU_DUMP_RECORDER	(1 << 9)
+#define X86EMU_DUMP_PROFILE	(1 << 10)
+#define X86EMU_DUMP_HEATMAP	(1 << 11)
 #define X86EMU_DUMP_DEFAULT	(X86EMU_DUMP_REGS | X86EMU_DUMP_INV_MEM | X86EMU_DUMP_ATTR | X86EMU_DUMP_ASCII | X86EMU_DUMP_IO | X86EMU_DUMP_INTS | X86EMU_DUMP_TIME)
 
 #define X86EMU_PERM_R		(1 << 0)
@@ -492,20 +717,27 @@ typedef struct {
 
 #define X86EMU_IO_PORTS		(1 << 16)
 
-typedef struct {
-  unsigned char *attr;	// malloc'ed
-  unsigned char *data;	// NOT malloc'ed
-  unsigned char def_attr;
-} mem2_page_t;
+/* built-in device models, see x86emu_set_devices() */
+#define X86EMU_DEV_PIT		(1 << 0)
+#define X86EMU_DEV_PIC		(1 << 1)
+#define X86EMU_DEV_RTC		(1 << 2)
+#define X86EMU_DEV_PCI		(1 << 3)
+#define X86EMU_DEV_PCI_BIOS	(1 << 4)
+#define X86EMU_DEV_ALL		(X86EMU_DEV_PIT | X86EMU_DEV_PIC | X86EMU_DEV_RTC | X86EMU_DEV_PCI | X86EMU_DEV_PCI_BIOS)
 
-typedef mem2_page_t mem2_ptable_t[1 << X86EMU_PTABLE_BITS];
-typedef mem2_ptable_t *mem2_pdir_t[1 << X86EMU_PDIR_BITS];
+/* built-in BIOS services, see x86emu_set_bios() */
+#define X86EMU_BIOS_MEM		(1 << 0)
+#define X86EMU_BIOS_TIME	(1 << 1)
+#define X86EMU_BIOS_KBD		(1 << 2)
+#define X86EMU_BIOS_ALL		(X86EMU_BIOS_MEM | X86EMU_BIOS_TIME | X86EMU_BIOS_KBD)
 
-typedef struct {
-  mem2_pdir_t *pdir;
-  unsigned invalid:1;
-  unsigned char def_attr;
-} x86emu_mem_t;
+/* see x86emu_set_journal() */
+#define X86EMU_JOURNAL_OFF	0
+#define X86EMU_JOURNAL_RECORD	1
+#define X86EMU_JOURNAL_REPLAY	2
+
+/* emulated memory; opaque, use x86emu_{get,set}_{perm,page}() */
+typedef struct x86emu_mem_s x86emu_mem_t;
 
 
 /****************************************************************************
@@ -526,8 +758,8 @@ typedef struct x86emu_s {
   x86emu_wrmsr_handler_t rdmsr;
   x86emu_mem_t *mem;
   struct {
-    unsigned char *map;
-    unsigned *stats_i, *stats_o;
+    unsigned char *map;			/* deprecated: always NULL, use x86emu_get_io_perm() */
+    unsigned *stats_i, *stats_o;	/* deprecated: always NULL, use x86emu_get_io_stats() */
     unsigned iopl_needed:1;
     unsigned iopl_ok:1;
   } io;
@@ -546,6 +778,7 @@ typedef struct x86emu_s {
     void *private;		/* deprecated: use _private */
 #endif
   };
+  struct x86emu_priv_s *priv;		/* library internal state */
 } x86emu_t;
 
 /*-------------------------- Function Prototypes --------------------------*/
@@ -560,12 +793,52 @@ void x86emu_stop(x86emu_t *emu);
 
 void x86emu_set_log(x86emu_t *emu, unsigned buffer_size, x86emu_flush_func_t flush);
 unsigned x86emu_clear_log(x86emu_t *emu, int flush) __attribute__ ((nonnull (1)));
+int x86emu_set_log_async(x86emu_t *emu, unsigned buffers, unsigned mode);
+u64 x86emu_sync_log(x86emu_t *emu);
+int x86emu_set_recorder(x86emu_t *emu, unsigned entries, unsigned flags);
+int x86emu_set_profiler(x86emu_t *emu, unsigned interval, unsigned frames, unsigned flags);
+const x86emu_prof_entry_t *x86emu_get_profile(x86emu_t *emu, unsigned *entries, u64 *samples);
+int x86emu_write_profile(x86emu_t *emu, const char *file);
+int x86emu_set_coverage(x86emu_t *emu, unsigned flags, unsigned bitmap_size);
+const x86emu_cov_entry_t *x86emu_get_coverage(x86emu_t *emu, unsigned *size, const u8 **bitmap, unsigned *bitmap_size);
+void x86emu_reset_coverage(x86emu_t *emu);
+int x86emu_add_trace_filter(x86emu_t *emu, unsigned type, u64 start, u64 end);
+void x86emu_clear_trace_filters(x86emu_t *emu);
+int x86emu_set_intr_cost(x86emu_t *emu, int on);
+const x86emu_intr_cost_t *x86emu_get_intr_cost(x86emu_t *emu);
+int x86emu_set_callgraph(x86emu_t *emu, int on);
+int x86emu_load_symbols(x86emu_t *emu, const char *file);
+int x86emu_write_callgraph(x86emu_t *emu, const char *file, unsigned format);
+int x86emu_set_heatmap(x86emu_t *emu, int on);
+const x86emu_heat_entry_t *x86emu_get_heatmap(x86emu_t *emu, unsigned type, unsigned *entries);
+int x86emu_set_perf_counters(x86emu_t *emu, unsigned groups);
+int x86emu_get_perf_counters(x86emu_t *emu, x86emu_perf_counters_t *counters);
+int x86emu_set_branch_trace(x86emu_t *emu, unsigned buffer_size, x86emu_flush_func_t flush);
 void x86emu_log(x86emu_t *emu, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
 void x86emu_dump(x86emu_t *emu, int flags);
 
 void x86emu_set_perm(x86emu_t *emu, unsigned start, unsigned end, unsigned perm);
 void x86emu_set_io_perm(x86emu_t *emu, unsigned start, unsigned end, unsigned perm);
+unsigned x86emu_get_io_perm(x86emu_t *emu, unsigned port);
+void x86emu_get_io_stats(x86emu_t *emu, unsigned port, unsigned *in, unsigned *out);
+int x86emu_set_io_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, x86emu_io_in_handler_t in, x86emu_io_out_handler_t out, void *ctx);
+int x86emu_set_io_block_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, x86emu_io_block_handler_t block, void *ctx);
+int x86emu_set_devices(x86emu_t *emu, unsigned devices);
+void x86emu_set_dev_clock(x86emu_t *emu, u32 clock);
+void x86emu_set_rtc_time(x86emu_t *emu, u64 seconds);
+int x86emu_pci_add_device(x86emu_t *emu, unsigned bus, unsigned dev, unsigned func, const void *config, unsigned size);
+int x86emu_pci_load_device(x86emu_t *emu, unsigned bus, unsigned dev, unsigned func, const char *file);
+int x86emu_set_journal(x86emu_t *emu, unsigned mode, const void *buf, unsigned size);
+const void *x86emu_get_journal(x86emu_t *emu, unsigned *size, unsigned *pos);
+x86emu_poll_handler_t x86emu_set_poll_handler(x86emu_t *emu, x86emu_poll_handler_t handler);
+int x86emu_set_bios_handler(x86emu_t *emu, u8 intr, unsigned func, unsigned mask, x86emu_bios_handler_t handler, void *ctx);
+void x86emu_set_bios(x86emu_t *emu, unsigned services);
+int x86emu_bios_add_mem(x86emu_t *emu, u64 base, u64 size, unsigned type);
 void x86emu_set_page(x86emu_t *emu, unsigned page, void *address);
+unsigned x86emu_get_perm(x86emu_t *emu, unsigned addr);
+void *x86emu_get_page(x86emu_t *emu, unsigned page);
+void x86emu_map_framebuffer(x86emu_t *emu, unsigned addr, unsigned size, void *buffer);
+unsigned x86emu_get_dirty_pages(x86emu_t *emu, unsigned addr, unsigned size, unsigned char *bitmap, int clear);
 void x86emu_reset_access_stats(x86emu_t *emu);
 
 x86emu_rdmsr_handler_t x86emu_set_rdmsr_handler(x86emu_t *emu, x86emu_rdmsr_handler_t handler);
@@ -574,6 +847,7 @@ x86emu_cpuid_handler_t x86emu_set_cpuid_handler(x86emu_t *emu, x86emu_cpuid_hand
 x86emu_code_handler_t x86emu_set_code_handler(x86emu_t *emu, x86emu_code_handler_t handler);
 x86emu_intr_handler_t x86emu_set_intr_handler(x86emu_t *emu, x86emu_intr_handler_t handler);
 x86emu_memio_handler_t x86emu_set_memio_handler(x86emu_t *emu, x86emu_memio_handler_t handler);
+x86emu_event_handler_t x86emu_set_event_handler(x86emu_t *emu, unsigned mask, x86emu_event_handler_t handler);
 
 void x86emu_intr_raise(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err);
 
@@ -585,6 +859,8 @@ void x86emu_write_byte(x86emu_t *emu, unsigned addr, unsigned val);
 void x86emu_write_byte_noperm(x86emu_t *emu, unsigned addr, unsigned val);
 void x86emu_write_word(x86emu_t *emu, unsigned addr, unsigned val);
 void x86emu_write_dword(x86emu_t *emu, unsigned addr, unsigned val);
+void *x86emu_get_ptr(x86emu_t *emu, unsigned addr, unsigned len, unsigned perm, unsigned *avail);
+int x86emu_disasm(x86emu_t *emu, u32 eip, unsigned code32, const unsigned char *code, unsigned len, x86emu_disasm_t *instr);
 
 void x86emu_set_seg_register(x86emu_t *emu, sel_t *seg, u16 val);
 
@@ -39,20 +39,73 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
 
 // exported symbol - all others are not exported by the library
 #define API_SYM			__attribute__((visibility("default")))
 
 #include "x86emu.h"
+
+/*
+ * Library internal part of x86emu_t.
+ *
+ * Kept out of x86emu_t so the public struct layout does not change.
+ */
+struct x86emu_priv_s {
+  struct {
+    struct x86emu_io_chunk_s *chunk[X86EMU_IO_PORTS >> 8];	/* allocated on first use */
+    unsigned char def_perm[X86EMU_IO_PORTS >> 8];	/* permissions of unallocated chunks */
+    unsigned perm_ports;		/* ports with r/w permissions */
+    struct x86emu_io_handler_s *handler;
+    unsigned handlers;
+  } io;
+  unsigned trace;			/* effective trace flags: emu->log.trace minus filtered ones */
+  struct x86emu_dev_s *dev;		/* device models, see x86emu_set_devices() */
+  struct x86emu_journal_s *journal;	/* see x86emu_set_journal() */
+  struct x86emu_poll_s *poll;		/* see X86EMU_RUN_POLL */
+  struct x86emu_bios_s *bios;		/* see x86emu_set_bios_handler() */
+  struct x86emu_btrace_s *btrace;	/* see X86EMU_TRACE_BINARY */
+  struct x86emu_logq_s *logq;		/* see x86emu_set_log_async() */
+  struct x86emu_recorder_s *recorder;	/* see x86emu_set_recorder() */
+  struct x86emu_prof_s *prof;		/* see x86emu_set_profiler() */
+  struct x86emu_cov_s *cov;		/* see x86emu_set_coverage() */
+  struct x86emu_filter_s *filter;	/* see x86emu_add_trace_filter() */
+  struct x86emu_icost_s *icost;		/* see x86emu_set_intr_cost() */
+  struct x86emu_cg_s *cg;		/* see x86emu_set_callgraph() */
+  struct x86emu_heat_s *heat;		/* see x86emu_set_heatmap() */
+  struct x86emu_perf_s *perf;		/* see x86emu_set_perf_counters() */
+  struct x86emu_event_s *event;		/* see x86emu_set_event_handler() */
+  struct x86emu_rdelta_s *rdelta;	/* see X86EMU_TRACE_REGS_DELTA */
+  struct x86emu_dcache_s *dcache;	/* see X86EMU_TRACE_CODE */
+  struct x86emu_brtrace_s *brtrace;	/* see x86emu_set_branch_trace() */
+  struct x86emu_disasm_s *disasm;	/* see x86emu_disasm() */
+};
+
 #include "decode.h"
 #include "ops.h"
 #include "prim_ops.h"
 #include "mem.h"
-
-#define INTR_RAISE_DIV0(a)	x86emu_intr_raise(a, 0, INTR_TYPE_SOFT | INTR_MODE_RESTART, 0)
-#define INTR_RAISE_SOFT(a, n)	x86emu_intr_raise(a, n, INTR_TYPE_SOFT, 0)
-#define INTR_RAISE_GP(a, err)	x86emu_intr_raise(a, 0x0d, INTR_TYPE_FAULT | INTR_MODE_RESTART | INTR_MODE_ERRCODE, err)
-#define INTR_RAISE_UD(a)	x86emu_intr_raise(a, 0x06, INTR_TYPE_FAULT | INTR_MODE_RESTART, 0)
+#include "dev.h"
+#include "journal.h"
+#include "bios.h"
+#include "btrace.h"
+#include "logq.h"
+#include "recorder.h"
+#include "prof.h"
+#include "cov.h"
+#include "filter.h"
+#include "icost.h"
+#include "cg.h"
+#include "heat.h"
+#include "perf.h"
+#include "event.h"
+#include "brtrace.h"
+#include "disasm.h"
+
+#define INTR_RAISE_DIV0(a)	intr_raise(a, 0, INTR_TYPE_SOFT | INTR_MODE_RESTART, 0)
+#define INTR_RAISE_SOFT(a, n)	intr_raise(a, n, INTR_TYPE_SOFT, 0)
+#define INTR_RAISE_GP(a, err)	intr_raise(a, 0x0d, INTR_TYPE_FAULT | INTR_MODE_RESTART | INTR_MODE_ERRCODE, err)
+#define INTR_RAISE_UD(a)	intr_raise(a, 0x06, INTR_TYPE_FAULT | INTR_MODE_RESTART, 0)
 
 #define MODE_REPE		((emu)->x86.mode & _MODE_REPE)
 #define MODE_REPNE		((emu)->x86.mode & _MODE_REPNE)
@@ -143,6 +196,17 @@ static inline u64 tsc(void)
 #endif
 
 
+/* host time in ns */
+static inline u64 host_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
 #if WITH_IOPL
 #if defined(__i386__)
 static inline unsigned getiopl(void)
@@ -0,0 +1,402 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Deterministic record/replay of everything the emulated cpu gets from
+*   outside: port input, reads through a custom memory handler, cpuid and
+*   rdmsr results and interrupts raised via x86emu_intr_raise().
+*
+*   The built-in device models are part of the emulation and not recorded.
+*
+*   Only guest accesses (decode_memio(), emu_memio()) are journaled; host
+*   calls of x86emu_read_*() and x86emu_write_*() bypass the journal. The
+*   intr and code_check callbacks run in both modes and are not journaled.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static int journal_check(x86emu_t *emu, u32 addr, unsigned type);
+static int journal_reserve(struct x86emu_journal_s *journal, unsigned len);
+static void journal_put(struct x86emu_journal_s *journal, u32 val, unsigned len);
+static unsigned char *journal_get(x86emu_t *emu, unsigned rec, unsigned len);
+static u32 journal_val(unsigned char *p, unsigned len);
+
+
+/*
+ * Start recording (X86EMU_JOURNAL_RECORD), replay journal at buf
+ * (X86EMU_JOURNAL_REPLAY), or stop (X86EMU_JOURNAL_OFF).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_journal(x86emu_t *emu, unsigned mode, const void *buf, unsigned size)
+{
+  struct x86emu_journal_s *journal;
+
+  if(!emu) return -1;
+
+  emu->priv->journal = journal_free(emu->priv->journal);
+
+  if(mode == X86EMU_JOURNAL_OFF) return 0;
+
+  if(mode != X86EMU_JOURNAL_RECORD && mode != X86EMU_JOURNAL_REPLAY) return -1;
+
+  if(mode == X86EMU_JOURNAL_REPLAY) {
+    if(!buf || size < JOURNAL_MAGIC_LEN || memcmp(buf, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)) return -1;
+  }
+  else {
+    buf = JOURNAL_MAGIC;
+    size = JOURNAL_MAGIC_LEN;
+  }
+
+  if(!(journal = calloc(1, sizeof *journal))) return -1;
+
+  journal->mode = mode;
+  journal->max = size < 0x10000 ? 0x10000 : size;
+
+  if(!(journal->buf = malloc(journal->max))) {
+    free(journal);
+
+    return -1;
+  }
+
+  memcpy(journal->buf, buf, size);
+  journal->size = size;
+  journal->pos = JOURNAL_MAGIC_LEN;
+
+  emu->priv->journal = journal;
+
+  return 0;
+}
+
+
+/*
+ * Get current journal.
+ *
+ * When replaying, *pos is set to the number of bytes consumed so far.
+ */
+API_SYM const void *x86emu_get_journal(x86emu_t *emu, unsigned *size, unsigned *pos)
+{
+  struct x86emu_journal_s *journal;
+
+  if(size) *size = 0;
+  if(pos) *pos = 0;
+
+  if(!emu || !(journal = emu->priv->journal)) return NULL;
+
+  if(size) *size = journal->size;
+  if(pos) *pos = journal->mode == X86EMU_JOURNAL_REPLAY ? journal->pos : journal->size;
+
+  return journal->buf;
+}
+
+
+/*
+ * Memory and i/o access while recording or replaying.
+ *
+ * Replaces the memio call in decode_memio() and emu_memio(); host accesses
+ * don't get here.
+ */
+unsigned journal_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+  unsigned err = 0, bits = type & 0xff, len, rec, u;
+  unsigned char *p;
+  int j = journal_check(emu, addr, type);
+
+  if(bits == X86EMU_MEMIO_8_NOPERM) bits = X86EMU_MEMIO_8;
+  len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+
+  if(journal->mode == X86EMU_JOURNAL_REPLAY && j) {
+    if((type & ~0xff) >= X86EMU_MEMIO_I) io_account(emu, addr & 0xffff, len, type & ~0xff, 1);
+
+    // writes go nowhere
+    if(j < 0) return 0;
+
+    rec = JOURNAL_MEMIO + ((type >> 8) << 2) + bits;
+    u = (type & ~0xff) == X86EMU_MEMIO_I ? 2 : 4;
+    if(!(p = journal_get(emu, rec, u + len))) {
+      *val = 0xffffffff >> (32 - len * 8);
+
+      return 1;
+    }
+
+    if(journal_val(p + 1, u) != (u == 2 ? addr & 0xffff : addr)) {
+      journal->error = 1;
+      x86emu_stop(emu);
+    }
+
+    *val = journal_val(p + 1 + u, len);
+
+    return *p & JOURNAL_ERR ? 1 : 0;
+  }
+
+  if(type >= X86EMU_MEMIO_I && io_handler(emu, addr)) {
+    err = vm_io(emu, addr, val, type);
+  }
+  else {
+    err = emu->priv->perf ? perf_memio(emu, addr, val, type) : emu->memio(emu, addr, val, type);
+  }
+
+  if(journal->mode == X86EMU_JOURNAL_RECORD && j > 0) {
+    u = (type & ~0xff) == X86EMU_MEMIO_I ? 2 : 4;
+    if(!journal_reserve(journal, 1 + u + len)) {
+      journal_put(journal, JOURNAL_MEMIO + ((type >> 8) << 2) + bits + (err ? JOURNAL_ERR : 0), 1);
+      journal_put(journal, u == 2 ? addr & 0xffff : addr, u);
+      journal_put(journal, *val, len);
+    }
+  }
+
+  return err;
+}
+
+
+/*
+ * cpuid while recording or replaying.
+ */
+void journal_cpuid(x86emu_t *emu)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+  unsigned char *p;
+
+  if(journal->mode == X86EMU_JOURNAL_REPLAY) {
+    if(!(p = journal_get(emu, JOURNAL_CPUID, 16))) return;
+    emu->x86.R_EAX = journal_val(p + 1, 4);
+    emu->x86.R_EBX = journal_val(p + 5, 4);
+    emu->x86.R_ECX = journal_val(p + 9, 4);
+    emu->x86.R_EDX = journal_val(p + 13, 4);
+
+    return;
+  }
+
+  emu->cpuid(emu);
+
+  if(journal_reserve(journal, 17)) return;
+
+  journal_put(journal, JOURNAL_CPUID, 1);
+  journal_put(journal, emu->x86.R_EAX, 4);
+  journal_put(journal, emu->x86.R_EBX, 4);
+  journal_put(journal, emu->x86.R_ECX, 4);
+  journal_put(journal, emu->x86.R_EDX, 4);
+}
+
+
+/*
+ * rdmsr while recording or replaying.
+ */
+void journal_rdmsr(x86emu_t *emu)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+  unsigned msr = emu->x86.R_ECX;
+  unsigned char *p;
+
+  if(journal->mode == X86EMU_JOURNAL_REPLAY) {
+    if(!(p = journal_get(emu, JOURNAL_RDMSR, 9))) return;
+    emu->x86.R_EAX = journal_val(p + 1, 4);
+    emu->x86.R_EDX = journal_val(p + 5, 4);
+    emu->x86.msr_perm[msr] = p[9];
+
+    return;
+  }
+
+  emu->rdmsr(emu);
+
+  if(journal_reserve(journal, 10)) return;
+
+  journal_put(journal, JOURNAL_RDMSR, 1);
+  journal_put(journal, emu->x86.R_EAX, 4);
+  journal_put(journal, emu->x86.R_EDX, 4);
+  journal_put(journal, emu->x86.msr_perm[msr], 1);
+}
+
+
+/*
+ * Interrupt raised from outside the emulator.
+ *
+ * It is recorded with the current instruction count; when replaying, the
+ * journal provides it instead.
+ */
+void journal_intr(x86emu_t *emu, u8 intr_nr, unsigned type, unsigned err)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+
+  if(journal->mode == X86EMU_JOURNAL_REPLAY || emu->x86.intr_type) return;
+
+  intr_raise(emu, intr_nr, type, err);
+
+  if(journal_reserve(journal, 18)) return;
+
+  journal_put(journal, JOURNAL_INTR, 1);
+  journal_put(journal, emu->x86.R_TSC, 4);
+  journal_put(journal, emu->x86.R_TSC >> 32, 4);
+  journal_put(journal, intr_nr, 1);
+  journal_put(journal, type, 4);
+  journal_put(journal, err, 4);
+}
+
+
+/*
+ * Replay: raise interrupts recorded at the current instruction.
+ */
+void journal_replay_intr(x86emu_t *emu)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+  unsigned char *p;
+  u64 tsc;
+
+  while(journal->pos + 18 <= journal->size) {
+    p = journal->buf + journal->pos;
+    if(*p != JOURNAL_INTR) break;
+    tsc = journal_val(p + 1, 4) + ((u64) journal_val(p + 5, 4) << 32);
+    if(tsc != emu->x86.R_TSC) break;
+    intr_raise(emu, p[9], journal_val(p + 10, 4), journal_val(p + 14, 4));
+    journal->pos += 18;
+  }
+}
+
+
+struct x86emu_journal_s *journal_clone(struct x86emu_journal_s *journal)
+{
+  struct x86emu_journal_s *new_journal;
+
+  if(!journal || !(new_journal = mem_dup(journal, sizeof *journal))) return NULL;
+
+  if(!(new_journal->buf = malloc(journal->max))) {
+    free(new_journal);
+
+    return NULL;
+  }
+
+  memcpy(new_journal->buf, journal->buf, journal->size);
+
+  return new_journal;
+}
+
+
+struct x86emu_journal_s *journal_free(struct x86emu_journal_s *journal)
+{
+  if(journal) {
+    free(journal->buf);
+    free(journal);
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Decide how an access is handled.
+ *
+ * Returns 1 if the value comes from outside (recorded/replayed), -1 for
+ * writes that are dropped when replaying, 0 if the access is emulated.
+ */
+int journal_check(x86emu_t *emu, u32 addr, unsigned type)
+{
+  type &= ~0xff;
+
+  if(type >= X86EMU_MEMIO_I) {
+    if(dev_port(emu, addr & 0xffff)) return 0;
+
+    return type == X86EMU_MEMIO_I ? 1 : -1;
+  }
+
+  if(emu->memio == vm_memio) return 0;
+
+  return type == X86EMU_MEMIO_W ? -1 : 1;
+}
+
+
+/*
+ * Make room for len more bytes.
+ *
+ * Returns 0 on success, -1 if the journal could not be extended.
+ */
+int journal_reserve(struct x86emu_journal_s *journal, unsigned len)
+{
+  unsigned char *buf;
+
+  if(journal->size + len > journal->max) {
+    if(!(buf = realloc(journal->buf, journal->max * 2))) return -1;
+    journal->buf = buf;
+    journal->max *= 2;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Append len bytes of val (see journal_reserve()).
+ */
+void journal_put(struct x86emu_journal_s *journal, u32 val, unsigned len)
+{
+  for(; len; len--, val >>= 8) journal->buf[journal->size++] = val;
+}
+
+
+/*
+ * Replay: get next record.
+ *
+ * rec is the expected record type, len its data size. On mismatch, replay
+ * stops and NULL is returned.
+ */
+unsigned char *journal_get(x86emu_t *emu, unsigned rec, unsigned len)
+{
+  struct x86emu_journal_s *journal = emu->priv->journal;
+  unsigned char *p;
+
+  journal_replay_intr(emu);
+
+  p = journal->buf + journal->pos;
+
+  if(
+    journal->error ||
+    journal->pos + 1 + len > journal->size ||
+    (*p & ~JOURNAL_ERR) != rec
+  ) {
+    journal->error = 1;
+    x86emu_stop(emu);
+
+    return NULL;
+  }
+
+  journal->pos += 1 + len;
+
+  return p;
+}
+
+
+u32 journal_val(unsigned char *p, unsigned len)
+{
+  u32 val = 0;
+
+  while(len--) val = (val << 8) + p[len];
+
+  return val;
+}
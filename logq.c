@@ -0,0 +1,204 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Asynchronous log flushing. Full log buffers are queued and written by a
+*   separate thread via emu->log.flush() while the emulation continues
+*   with the next free buffer.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static void *logq_thread(void *arg);
+
+
+/*
+ * Use 'buffers' log buffers (including the current one) and flush them
+ * asynchronously; buffers < 2 switches back to synchronous flushing.
+ *
+ * mode is X86EMU_LOG_BLOCK or X86EMU_LOG_DROP.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_log_async(x86emu_t *emu, unsigned buffers, unsigned mode)
+{
+  struct x86emu_logq_s *logq;
+
+  if(!emu) return -1;
+
+  logq_free(emu);
+
+  if(buffers < 2) return 0;
+
+  if(!emu->log.buf || !emu->log.flush) return -1;
+
+  if(!(logq = calloc(1, sizeof *logq))) return -1;
+
+  logq->mode = mode;
+  logq->queue = calloc(buffers, sizeof *logq->queue);
+  logq->free_buf = calloc(buffers, sizeof *logq->free_buf);
+
+  if(logq->queue && logq->free_buf) {
+    for(; logq->free_count < buffers - 1; logq->free_count++) {
+      if(!(logq->free_buf[logq->free_count] = malloc(emu->log.size))) break;
+    }
+  }
+
+  if(logq->free_count == buffers - 1) {
+    logq->buffers = buffers;
+    pthread_mutex_init(&logq->lock, NULL);
+    pthread_cond_init(&logq->cond, NULL);
+    emu->priv->logq = logq;
+    if(!pthread_create(&logq->thread, NULL, logq_thread, emu)) return 0;
+    emu->priv->logq = NULL;
+    pthread_mutex_destroy(&logq->lock);
+    pthread_cond_destroy(&logq->cond);
+  }
+
+  while(logq->free_count) free(logq->free_buf[--logq->free_count]);
+  free(logq->free_buf);
+  free(logq->queue);
+  free(logq);
+
+  return -1;
+}
+
+
+/*
+ * Wait until all queued log buffers have been written.
+ *
+ * Returns number of dropped log bytes (X86EMU_LOG_DROP).
+ */
+API_SYM u64 x86emu_sync_log(x86emu_t *emu)
+{
+  struct x86emu_logq_s *logq;
+  u64 dropped;
+
+  if(!emu || !(logq = emu->priv->logq)) return 0;
+
+  pthread_mutex_lock(&logq->lock);
+  while(logq->count || logq->busy) pthread_cond_wait(&logq->cond, &logq->lock);
+  dropped = logq->dropped;
+  pthread_mutex_unlock(&logq->lock);
+
+  return dropped;
+}
+
+
+/*
+ * Queue current log buffer (len bytes used) and continue with a free one.
+ *
+ * If there's none, wait (X86EMU_LOG_BLOCK) or drop the log (X86EMU_LOG_DROP).
+ */
+void logq_put(x86emu_t *emu, unsigned len)
+{
+  struct x86emu_logq_s *logq = emu->priv->logq;
+
+  pthread_mutex_lock(&logq->lock);
+
+  if(logq->mode == X86EMU_LOG_BLOCK) {
+    while(!logq->free_count) pthread_cond_wait(&logq->cond, &logq->lock);
+  }
+
+  if(logq->free_count) {
+    logq->queue[(logq->head + logq->count) % logq->buffers] = (logq_buf_t) { emu->log.buf, len };
+    logq->count++;
+    emu->log.buf = logq->free_buf[--logq->free_count];
+    pthread_cond_broadcast(&logq->cond);
+  }
+  else {
+    logq->dropped += len;
+  }
+
+  pthread_mutex_unlock(&logq->lock);
+}
+
+
+/*
+ * Write all queued buffers, then stop flush thread.
+ */
+void logq_free(x86emu_t *emu)
+{
+  struct x86emu_logq_s *logq = emu->priv->logq;
+
+  if(!logq) return;
+
+  pthread_mutex_lock(&logq->lock);
+  logq->stop = 1;
+  pthread_cond_broadcast(&logq->cond);
+  pthread_mutex_unlock(&logq->lock);
+
+  pthread_join(logq->thread, NULL);
+
+  pthread_mutex_destroy(&logq->lock);
+  pthread_cond_destroy(&logq->cond);
+
+  while(logq->free_count) free(logq->free_buf[--logq->free_count]);
+  free(logq->free_buf);
+  free(logq->queue);
+  free(logq);
+
+  emu->priv->logq = NULL;
+}
+
+
+/*
+ * Flush thread: write queued buffers via emu->log.flush().
+ */
+void *logq_thread(void *arg)
+{
+  x86emu_t *emu = arg;
+  struct x86emu_logq_s *logq = emu->priv->logq;
+  logq_buf_t b;
+
+  pthread_mutex_lock(&logq->lock);
+
+  for(;;) {
+    while(!logq->count && !logq->stop) pthread_cond_wait(&logq->cond, &logq->lock);
+    if(!logq->count) break;
+
+    b = logq->queue[logq->head];
+    logq->head = (logq->head + 1) % logq->buffers;
+    logq->count--;
+    logq->busy = 1;
+    pthread_mutex_unlock(&logq->lock);
+
+    emu->log.flush(emu, b.buf, b.len);
+
+    pthread_mutex_lock(&logq->lock);
+    logq->free_buf[logq->free_count++] = b.buf;
+    logq->busy = 0;
+    pthread_cond_broadcast(&logq->cond);
+  }
+
+  pthread_mutex_unlock(&logq->lock);
+
+  return NULL;
+}
@@ -64,12 +64,18 @@ static void vm_w_word(x86emu_mem_t *vm, unsigned addr, unsigned val);
 static void vm_w_dword(x86emu_mem_t *vm, unsigned addr, unsigned val);
 
 static mem2_page_t *vm_get_page(x86emu_mem_t *mem, unsigned addr, int create);
+static unsigned char *vm_alloc_block(void);
+static int io_set_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, struct x86emu_io_handler_s *new, unsigned block);
+static void io_port_handler(x86emu_t *emu, unsigned port, struct x86emu_io_handler_s *new, unsigned block, struct x86emu_io_handler_s *h);
+static unsigned io_handler_idx(x86emu_t *emu, struct x86emu_io_handler_s *new, int add);
+static void io_handler_unref(x86emu_t *emu, unsigned idx);
 static unsigned vm_i_byte(x86emu_t *emu, unsigned addr);
 static unsigned vm_i_dword(x86emu_t *emu, unsigned addr);
 static unsigned vm_i_word(x86emu_t *emu, unsigned addr);
 static void vm_o_byte(x86emu_t *emu, unsigned addr, unsigned val);
 static void vm_o_dword(x86emu_t *emu, unsigned addr, unsigned val);
 static void vm_o_word(x86emu_t *emu, unsigned addr, unsigned val);
+static int io_ports_access(x86emu_t *emu, unsigned port, unsigned len, unsigned perm);
 
 void *mem_dup(const void *src, size_t n)
 {
@@ -108,7 +114,7 @@ x86emu_mem_t *emu_mem_free(x86emu_mem_t *mem)
         if(!ptable) continue;
         for(u1 = 0; u1 < (1 << X86EMU_PTABLE_BITS); u1++) {
           page = (*ptable)[u1];
-          free(page.attr);
+          if(page & MEM2_PAGE_ALLOC) free(mem2_attr(page));
         }
         free(ptable);
       }
@@ -128,6 +134,7 @@ x86emu_mem_t *emu_mem_clone(x86emu_mem_t *mem)
   mem2_ptable_t *ptable, *new_ptable;
   mem2_page_t page;
   unsigned pdir_idx, u1;
+  unsigned char *block;
   x86emu_mem_t *new_mem = NULL;
 
   if(!mem) return new_mem;
@@ -142,11 +149,10 @@ x86emu_mem_t *emu_mem_clone(x86emu_mem_t *mem)
       new_ptable = (*new_pdir)[pdir_idx] = mem_dup(ptable, sizeof *ptable);
       for(u1 = 0; u1 < (1 << X86EMU_PTABLE_BITS); u1++) {
         page = (*ptable)[u1];
-        if(page.attr) {
-          (*new_ptable)[u1].attr = mem_dup(page.attr, 2 * X86EMU_PAGE_SIZE);
-          if(page.data == page.attr + X86EMU_PAGE_SIZE) {
-            (*new_ptable)[u1].data = (*new_ptable)[u1].attr + X86EMU_PAGE_SIZE;
-          }
+        if(page & MEM2_PAGE_ALLOC) {
+          block = vm_alloc_block();
+          memcpy(block, mem2_attr(page), MEM2_BLOCK_SIZE);
+          (*new_ptable)[u1] = (mem2_page_t) block | (page & MEM2_PAGE_FLAGS);
         }
       }
     }
@@ -161,6 +167,7 @@ API_SYM void x86emu_reset_access_stats(x86emu_t *emu)
   mem2_pdir_t *pdir;
   mem2_ptable_t *ptable;
   mem2_page_t page;
+  unsigned char *attr;
   unsigned pdir_idx, u, u1;
 
   if(!emu || !emu->mem || !(pdir = emu->mem->pdir)) return;
@@ -170,9 +177,10 @@ API_SYM void x86emu_reset_access_stats(x86emu_t *emu)
     if(!ptable) continue;
     for(u = 0; u < (1 << X86EMU_PTABLE_BITS); u++) {
       page = (*ptable)[u];
-      if(page.attr) {
+      if(page & MEM2_PAGE_ALLOC) {
+        attr = mem2_attr(page);
         for(u1 = 0; u1 < X86EMU_PAGE_SIZE; u1++) {
-          page.attr[u1] &= X86EMU_PERM_RWX | X86EMU_PERM_VALID;
+          attr[u1] &= X86EMU_PERM_RWX | X86EMU_PERM_VALID;
         }
       }
     }
@@ -182,17 +190,40 @@ API_SYM void x86emu_reset_access_stats(x86emu_t *emu)
 
 API_SYM void x86emu_set_io_perm(x86emu_t *emu, unsigned start, unsigned end, unsigned perm)
 {
+  struct x86emu_io_chunk_s *c;
+  unsigned idx, i, u, n;
+
   if(!emu) return;
 
   if(end > X86EMU_IO_PORTS - 1) end = X86EMU_IO_PORTS - 1;
 
-  while(start <= end) emu->io.map[start++] = perm;
+  perm &= 0xff;
+
+  for(; start <= end; start += n) {
+    idx = start >> IO_CHUNK_BITS;
+    u = start & (IO_CHUNK_SIZE - 1);
+    n = IO_CHUNK_SIZE - u;
+    if(n > end - start + 1) n = end - start + 1;
+
+    // whole chunk that hasn't been used yet: just update default permissions
+    if(!emu->priv->io.chunk[idx] && n == IO_CHUNK_SIZE) {
+      if(emu->priv->io.def_perm[idx] & (X86EMU_PERM_R | X86EMU_PERM_W)) emu->priv->io.perm_ports -= n;
+      emu->priv->io.def_perm[idx] = perm;
+      if(perm & (X86EMU_PERM_R | X86EMU_PERM_W)) emu->priv->io.perm_ports += n;
 
-  for(start = perm = 0; start < X86EMU_IO_PORTS; start++) {
-    perm |= emu->io.map[start];
+      continue;
+    }
+
+    c = io_chunk(emu, start);
+
+    for(i = u; i < u + n; i++) {
+      if(c->map[i] & (X86EMU_PERM_R | X86EMU_PERM_W)) emu->priv->io.perm_ports--;
+      c->map[i] = perm;
+      if(perm & (X86EMU_PERM_R | X86EMU_PERM_W)) emu->priv->io.perm_ports++;
+    }
   }
 
-  emu->io.iopl_needed = (perm & (X86EMU_PERM_R | X86EMU_PERM_W)) ? 1 : 0;
+  emu->io.iopl_needed = emu->priv->io.perm_ports ? 1 : 0;
 
 #if WITH_IOPL 
   emu->io.iopl_ok = emu->io.iopl_needed && getiopl() != 3 ? 0 : 1;
@@ -202,15 +233,268 @@ API_SYM void x86emu_set_io_perm(x86emu_t *emu, unsigned start, unsigned end, uns
 }
 
 
+API_SYM unsigned x86emu_get_io_perm(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_io_chunk_s *c;
+
+  if(!emu) return 0;
+
+  port &= 0xffff;
+
+  c = emu->priv->io.chunk[port >> IO_CHUNK_BITS];
+
+  return c ? c->map[port & (IO_CHUNK_SIZE - 1)] : emu->priv->io.def_perm[port >> IO_CHUNK_BITS];
+}
+
+
+API_SYM void x86emu_get_io_stats(x86emu_t *emu, unsigned port, unsigned *in, unsigned *out)
+{
+  struct x86emu_io_chunk_s *c = NULL;
+
+  if(emu) c = emu->priv->io.chunk[(port & 0xffff) >> IO_CHUNK_BITS];
+
+  port &= IO_CHUNK_SIZE - 1;
+
+  if(in) *in = c ? c->stats_i[port] : 0;
+  if(out) *out = c ? c->stats_o[port] : 0;
+}
+
+
+/*
+ * Allocate i/o chunk for 'port'.
+ */
+struct x86emu_io_chunk_s *io_chunk_alloc(x86emu_t *emu, unsigned port)
+{
+  struct x86emu_io_chunk_s **c = emu->priv->io.chunk + ((port & 0xffff) >> IO_CHUNK_BITS);
+
+  if(!*c && (*c = calloc(1, sizeof **c))) {
+    memset((*c)->map, emu->priv->io.def_perm[(port & 0xffff) >> IO_CHUNK_BITS], sizeof (*c)->map);
+  }
+
+  return *c;
+}
+
+
+/*
+ * Update access flags and statistics of ports port - port + len - 1.
+ */
+void io_account(x86emu_t *emu, unsigned port, unsigned len, unsigned type, unsigned count)
+{
+  struct x86emu_io_chunk_s *c;
+  unsigned u, idx;
+
+  for(u = 0; u < len; u++) {
+    c = io_chunk(emu, port + u);
+    idx = (port + u) & (IO_CHUNK_SIZE - 1);
+    if(type == X86EMU_MEMIO_I) {
+      c->map[idx] |= X86EMU_ACC_R;
+      c->stats_i[idx] += count;
+    }
+    else {
+      c->map[idx] |= X86EMU_ACC_W;
+      c->stats_o[idx] += count;
+    }
+  }
+}
+
+
+/*
+ * Register in/out handlers for ports first_port - last_port.
+ *
+ * Passing NULL for both handlers removes them from the range; block handlers
+ * are kept. At most IO_MAX_HANDLERS distinct handler/ctx combinations can be
+ * in use at the same time; if the range would need more, nothing is changed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_io_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, x86emu_io_in_handler_t in, x86emu_io_out_handler_t out, void *ctx)
+{
+  struct x86emu_io_handler_s h = { };
+
+  if(!emu) return -1;
+
+  h.in = in;
+  h.out = out;
+  h.ctx = in || out ? ctx : NULL;
+
+  return io_set_handler(emu, first_port, last_port, &h, 0);
+}
+
+
+/*
+ * Register block handler for rep ins/outs on ports first_port - last_port.
+ *
+ * Passing NULL removes it from the range; in/out handlers are kept. Same
+ * limit as for x86emu_set_io_handler().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_io_block_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, x86emu_io_block_handler_t block, void *ctx)
+{
+  struct x86emu_io_handler_s h = { };
+
+  if(!emu) return -1;
+
+  h.block = block;
+  h.block_ctx = block ? ctx : NULL;
+
+  return io_set_handler(emu, first_port, last_port, &h, 1);
+}
+
+
+/*
+ * Set in/out (block = 0) or block (block = 1) part of the port handlers.
+ *
+ * The first pass reserves (references) all needed handler entries, the
+ * second updates the ports and drops the references to their old entries.
+ * So if we run out of entries, no port has been changed yet.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int io_set_handler(x86emu_t *emu, unsigned first_port, unsigned last_port, struct x86emu_io_handler_s *new, unsigned block)
+{
+  struct x86emu_io_handler_s h;
+  unsigned port, idx, old;
+
+  if(last_port > X86EMU_IO_PORTS - 1) last_port = X86EMU_IO_PORTS - 1;
+
+  for(port = first_port; port <= last_port; port++) {
+    io_port_handler(emu, port, new, block, &h);
+    if(!h.in && !h.out && !h.block) continue;
+    if(!(idx = io_handler_idx(emu, &h, 1))) {
+      // out of handler entries: release what we got so far
+      while(port-- > first_port) {
+        io_port_handler(emu, port, new, block, &h);
+        io_handler_unref(emu, io_handler_idx(emu, &h, 0));
+      }
+      return -1;
+    }
+    emu->priv->io.handler[idx - 1].refs++;
+  }
+
+  for(port = first_port; port <= last_port; port++) {
+    io_port_handler(emu, port, new, block, &h);
+    idx = io_handler_idx(emu, &h, 0);
+    old = io_handler(emu, port);
+    if(idx || old) {
+      io_chunk(emu, port)->handler[port & (IO_CHUNK_SIZE - 1)] = idx;
+    }
+    io_handler_unref(emu, old);
+  }
+
+  return 0;
+}
+
+
+/*
+ * Get handlers port would have after setting the in/out (block = 0) or block
+ * (block = 1) part to new.
+ */
+void io_port_handler(x86emu_t *emu, unsigned port, struct x86emu_io_handler_s *new, unsigned block, struct x86emu_io_handler_s *h)
+{
+  unsigned idx;
+
+  if((idx = io_handler(emu, port))) {
+    *h = emu->priv->io.handler[idx - 1];
+  }
+  else {
+    memset(h, 0, sizeof *h);
+  }
+
+  if(block) {
+    h->block = new->block;
+    h->block_ctx = new->block_ctx;
+  }
+  else {
+    h->in = new->in;
+    h->out = new->out;
+    h->ctx = new->ctx;
+  }
+}
+
+
+/*
+ * Find i/o handler entry; if add is set, add it if it does not exist.
+ *
+ * Unused entries (refs = 0) are reused. A new entry starts with refs = 0.
+ *
+ * Returns index + 1, 0 if all handlers are NULL, there is no such entry, or
+ * there's no space left.
+ */
+unsigned io_handler_idx(x86emu_t *emu, struct x86emu_io_handler_s *new, int add)
+{
+  struct x86emu_io_handler_s *h;
+  unsigned idx, free_idx = 0;
+
+  if(!new->in && !new->out && !new->block) return 0;
+
+  for(idx = 0; idx < emu->priv->io.handlers; idx++) {
+    h = emu->priv->io.handler + idx;
+    if(
+      h->in == new->in && h->out == new->out && h->ctx == new->ctx &&
+      h->block == new->block && h->block_ctx == new->block_ctx
+    ) return idx + 1;
+    if(!free_idx && !h->refs) free_idx = idx + 1;
+  }
+
+  if(!add) return 0;
+
+  if(free_idx) {
+    idx = free_idx - 1;
+  }
+  else {
+    if(idx >= IO_MAX_HANDLERS) return 0;
+    h = realloc(emu->priv->io.handler, (idx + 1) * sizeof *h);
+    if(!h) return 0;
+    emu->priv->io.handler = h;
+    emu->priv->io.handlers = idx + 1;
+  }
+
+  h = emu->priv->io.handler + idx;
+  *h = *new;
+  h->refs = 0;
+
+  return idx + 1;
+}
+
+
+/*
+ * Drop reference to i/o handler entry idx (index + 1); free it if unused.
+ */
+void io_handler_unref(x86emu_t *emu, unsigned idx)
+{
+  struct x86emu_io_handler_s *h;
+
+  if(!idx) return;
+
+  h = emu->priv->io.handler + idx - 1;
+
+  if(h->refs && !--h->refs) memset(h, 0, sizeof *h);
+}
+
+
+unsigned char *vm_alloc_block()
+{
+  void *block;
+
+  if(posix_memalign(&block, MEM2_BLOCK_ALIGN, MEM2_BLOCK_SIZE)) return NULL;
+
+  return block;
+}
+
+
 mem2_page_t *vm_get_page(x86emu_mem_t *mem, unsigned addr, int create)
 {
   mem2_pdir_t *pdir;
   mem2_ptable_t *ptable;
   mem2_page_t page;
+  unsigned char *attr;
   unsigned pdir_idx = addr >> (32 - X86EMU_PDIR_BITS);
   unsigned ptable_idx = (addr >> X86EMU_PAGE_BITS) & ((1 << X86EMU_PTABLE_BITS) - 1);
   unsigned u;
 
+  if(mem->perf) mem->perf->page_walks++;
+
   pdir = mem->pdir;
   if(!pdir) {
     mem->pdir = pdir = calloc(1, sizeof *pdir);
@@ -222,21 +506,20 @@ mem2_page_t *vm_get_page(x86emu_mem_t *mem, unsigned addr, int create)
     ptable = (*pdir)[pdir_idx] = calloc(1, sizeof *ptable);
     // fprintf(stderr, "ptable = %p\n", ptable);
     for(u = 0; u < (1 << X86EMU_PTABLE_BITS); u++) {
-      (*ptable)[u].def_attr = mem->def_attr;
-      // fprintf(stderr, "ptable[%u] = %p\n", u, &((*ptable)[u].def_attr));
+      (*ptable)[u] = MEM2_PAGE_DEF_ATTR(mem->def_attr);
     }
     // fprintf(stderr, "pdir[%d] = %p (%d)\n", pdir_idx, ptable, sizeof *ptable);
   }
 
   if(create) {
     page = (*ptable)[ptable_idx];
-    if(!page.attr) {
-      page.attr = calloc(1, 2 * X86EMU_PAGE_SIZE);
-      page.data = page.attr + X86EMU_PAGE_SIZE;
-      // fprintf(stderr, "page = %p, page.def_attr = %p\n", page, &page.def_attr);
-      memset(page.attr, page.def_attr, X86EMU_PAGE_SIZE);
-      (*ptable)[ptable_idx] = page;
-      // fprintf(stderr, "page.attr[%d] = %p\n", ptable_idx, page.attr);
+    if(!(page & MEM2_PAGE_ALLOC)) {
+      attr = vm_alloc_block();
+      if(mem->perf) mem->perf->page_allocs++;
+      memset(attr, mem2_def_attr(page), X86EMU_PAGE_SIZE);
+      memset(attr + X86EMU_PAGE_SIZE, 0, MEM2_BLOCK_SIZE - X86EMU_PAGE_SIZE);
+      (*ptable)[ptable_idx] = (mem2_page_t) attr | MEM2_PAGE_ALLOC;
+      // fprintf(stderr, "page.attr[%d] = %p\n", ptable_idx, attr);
     }
   }
 
@@ -248,6 +531,7 @@ API_SYM void x86emu_set_perm(x86emu_t *emu, unsigned start, unsigned end, unsign
 {
   x86emu_mem_t *mem;
   mem2_page_t *page;
+  unsigned char *attr;
   unsigned idx;
 
   if(!emu || !(mem = emu->mem)) return;
@@ -257,10 +541,10 @@ API_SYM void x86emu_set_perm(x86emu_t *emu, unsigned start, unsigned end, unsign
   // x86emu_log(emu, "set perm: start 0x%x, end 0x%x, perm 0x%x\n", start, end, perm);
 
   if((idx = start & (X86EMU_PAGE_SIZE - 1))) {
-    page = vm_get_page(mem, start, 1);
+    attr = mem2_attr(*vm_get_page(mem, start, 1));
     for(; idx < X86EMU_PAGE_SIZE && start <= end; start++) {
-      // x86emu_log(emu, "  page %p, idx = 0x%x\n", page, idx);
-      page->attr[idx++] = perm;
+      // x86emu_log(emu, "  page %p, idx = 0x%x\n", attr, idx);
+      attr[idx++] = perm;
     }
     if(!start || start > end) return;
   }
@@ -269,9 +553,13 @@ API_SYM void x86emu_set_perm(x86emu_t *emu, unsigned start, unsigned end, unsign
 
   for(; end - start >= X86EMU_PAGE_SIZE - 1; start += X86EMU_PAGE_SIZE) {
     page = vm_get_page(mem, start, 0);
-    page->def_attr = perm;
     // x86emu_log(emu, "  page %p (start 0x%x, end - start 0x%x)\n", page, start, end - start);
-    if(page->attr) memset(page->attr, page->def_attr, X86EMU_PAGE_SIZE);
+    if(*page & MEM2_PAGE_ALLOC) {
+      memset(mem2_attr(*page), perm, X86EMU_PAGE_SIZE);
+    }
+    else {
+      *page = MEM2_PAGE_DEF_ATTR(perm);
+    }
     if(!start) return;
     if(end - start == X86EMU_PAGE_SIZE - 1) {
       start += X86EMU_PAGE_SIZE;
@@ -283,11 +571,11 @@ API_SYM void x86emu_set_perm(x86emu_t *emu, unsigned start, unsigned end, unsign
 
   // x86emu_log(emu, "  3: start 0x%x, end 0x%x\n", start, end);
 
-  page = vm_get_page(mem, start, 1);
+  attr = mem2_attr(*vm_get_page(mem, start, 1));
   end = end - start + 1;
   for(idx = 0; idx < end; idx++) {
-    // x86emu_log(emu, "  page %p, idx = 0x%x\n", page, idx);
-    page->attr[idx] = perm;
+    // x86emu_log(emu, "  page %p, idx = 0x%x\n", attr, idx);
+    attr[idx] = perm;
   }
 }
 
@@ -296,6 +584,7 @@ API_SYM void x86emu_set_page(x86emu_t *emu, unsigned page, void *address)
 {
   x86emu_mem_t *mem;
   mem2_page_t *p;
+  unsigned char *attr;
   unsigned u;
 
   if(!emu || !(mem = emu->mem)) return;
@@ -303,27 +592,188 @@ API_SYM void x86emu_set_page(x86emu_t *emu, unsigned page, void *address)
   p = vm_get_page(mem, page, 1);
 
   if(address) {
-    p->data = address;
+    *mem2_map(*p) = address;
+    *p |= MEM2_PAGE_MAPPED;
 
     // tag memory as initialized
+    attr = mem2_attr(*p);
     for(u = 0; u < X86EMU_PAGE_SIZE; u++) {
-      p->attr[u] |= X86EMU_PERM_VALID;
+      attr[u] |= X86EMU_PERM_VALID;
     }
   }
   else {
-    p->data = p->attr + X86EMU_PAGE_SIZE;
+    *p &= ~(mem2_page_t) MEM2_PAGE_MAPPED;
+  }
+}
+
+
+API_SYM void *x86emu_get_page(x86emu_t *emu, unsigned page)
+{
+  mem2_page_t p;
+
+  if(!emu || !emu->mem) return NULL;
+
+  p = *vm_get_page(emu->mem, page, 0);
+
+  return p & MEM2_PAGE_MAPPED ? *mem2_map(p) : NULL;
+}
+
+
+API_SYM unsigned x86emu_get_perm(x86emu_t *emu, unsigned addr)
+{
+  mem2_page_t p;
+
+  if(!emu || !emu->mem) return 0;
+
+  p = *vm_get_page(emu->mem, addr, 0);
+
+  return p & MEM2_PAGE_ALLOC ? mem2_attr(p)[addr & (X86EMU_PAGE_SIZE - 1)] : mem2_def_attr(p);
+}
+
+
+/*
+ * Direct pointer into emulated memory.
+ *
+ * perm: required X86EMU_PERM_* bits and X86EMU_ACC_* bits to set.
+ *
+ * Returns pointer to data at addr, *avail is set to the number of contiguous
+ * bytes (up to len) that may be accessed through it.
+ */
+API_SYM void *x86emu_get_ptr(x86emu_t *emu, unsigned addr, unsigned len, unsigned perm, unsigned *avail)
+{
+  x86emu_mem_t *mem;
+  mem2_page_t *p, page;
+  unsigned char *ptr = NULL, *data, *attr;
+  unsigned cnt, idx, u, n, a;
+  unsigned need = perm & X86EMU_PERM_RWX;
+  unsigned acc = perm & (X86EMU_ACC_R | X86EMU_ACC_W | X86EMU_ACC_X);
+
+  if(avail) *avail = 0;
+
+  // a custom handler might intercept any access
+  if(!emu || !(mem = emu->mem) || emu->memio != vm_memio) return NULL;
+
+  for(cnt = 0; cnt < len;) {
+    p = vm_get_page(mem, addr + cnt, 1);
+    page = *p;
+    idx = (addr + cnt) & (X86EMU_PAGE_SIZE - 1);
+    data = mem2_data(page) + idx;
+
+    if(!cnt) {
+      ptr = data;
+    }
+    else if(data != ptr + cnt) {
+      break;
+    }
+
+    n = X86EMU_PAGE_SIZE - idx;
+    if(n > len - cnt) n = len - cnt;
+
+    if(need || acc) {
+      attr = mem2_attr(page) + idx;
+      for(u = 0; u < n && (attr[u] & need) == need; u++) {
+        a = attr[u] | acc;
+        if((acc & X86EMU_ACC_W)) {
+          a |= X86EMU_PERM_VALID;
+        }
+        else if(acc && !(a & X86EMU_PERM_VALID)) {
+          a |= X86EMU_ACC_INVALID;
+        }
+        attr[u] = a;
+      }
+    }
+    else {
+      u = n;
+    }
+
+    if(u && (acc & X86EMU_ACC_W) && (page & MEM2_PAGE_TRACK)) *p = page | MEM2_PAGE_DIRTY;
+
+    cnt += u;
+
+    // stop at inaccessible byte or at 4GB
+    if(u < n || !(addr + cnt)) break;
+  }
+
+  if(!cnt) return NULL;
+
+  if(avail) *avail = cnt;
+
+  return ptr;
+}
+
+
+/*
+ * Map host buffer into emulated memory and track writes to it.
+ *
+ * addr and size are rounded to full pages. Pass buffer = NULL to remove the
+ * mapping.
+ */
+API_SYM void x86emu_map_framebuffer(x86emu_t *emu, unsigned addr, unsigned size, void *buffer)
+{
+  mem2_page_t *p;
+  unsigned u, pages;
+
+  if(!emu || !emu->mem || !size) return;
+
+  pages = ((addr & (X86EMU_PAGE_SIZE - 1)) + size + X86EMU_PAGE_SIZE - 1) >> X86EMU_PAGE_BITS;
+  addr &= ~(X86EMU_PAGE_SIZE - 1);
+
+  for(u = 0; u < pages; u++, addr += X86EMU_PAGE_SIZE) {
+    x86emu_set_page(emu, addr, buffer ? (unsigned char *) buffer + (u << X86EMU_PAGE_BITS) : NULL);
+    p = vm_get_page(emu->mem, addr, 1);
+    if(buffer) {
+      *p |= MEM2_PAGE_TRACK;
+    }
+    else {
+      *p &= ~(mem2_page_t) (MEM2_PAGE_TRACK | MEM2_PAGE_DIRTY);
+    }
+    if(!(addr + X86EMU_PAGE_SIZE)) break;
+  }
+}
+
+
+/*
+ * Get (and reset) dirty state of framebuffer pages in addr - addr + size - 1.
+ *
+ * If bitmap is not NULL, bit n is set if page n of the range has been
+ * written to (bit 0 = bit 0 of bitmap[0]).
+ *
+ * Returns number of dirty pages.
+ */
+API_SYM unsigned x86emu_get_dirty_pages(x86emu_t *emu, unsigned addr, unsigned size, unsigned char *bitmap, int clear)
+{
+  mem2_page_t *p;
+  unsigned u, pages, dirty = 0;
+
+  if(!emu || !emu->mem || !size) return 0;
+
+  pages = ((addr & (X86EMU_PAGE_SIZE - 1)) + size + X86EMU_PAGE_SIZE - 1) >> X86EMU_PAGE_BITS;
+  addr &= ~(X86EMU_PAGE_SIZE - 1);
+
+  if(bitmap) memset(bitmap, 0, (pages + 7) >> 3);
+
+  for(u = 0; u < pages; u++, addr += X86EMU_PAGE_SIZE) {
+    p = vm_get_page(emu->mem, addr, 0);
+    if(*p & MEM2_PAGE_DIRTY) {
+      dirty++;
+      if(bitmap) bitmap[u >> 3] |= 1 << (u & 7);
+      if(clear) *p &= ~(mem2_page_t) MEM2_PAGE_DIRTY;
+    }
+    if(!(addr + X86EMU_PAGE_SIZE)) break;
   }
+
+  return dirty;
 }
 
 
 unsigned vm_r_byte(x86emu_mem_t *mem, unsigned addr)
 {
-  mem2_page_t *page;
+  mem2_page_t page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   unsigned char *perm;
 
-  page = vm_get_page(mem, addr, 1);
-  perm = page->attr + page_idx;
+  page = *vm_get_page(mem, addr, 1);
+  perm = mem2_attr(page) + page_idx;
 
   if(*perm & X86EMU_PERM_R) {
     *perm |= X86EMU_ACC_R;
@@ -331,7 +781,7 @@ unsigned vm_r_byte(x86emu_mem_t *mem, unsigned addr)
       *perm |= X86EMU_ACC_INVALID;
       mem->invalid = 1;
     }
-    return page->data[page_idx];
+    return mem2_data(page)[page_idx];
   }
 
   mem->invalid = 1;
@@ -342,25 +792,25 @@ unsigned vm_r_byte(x86emu_mem_t *mem, unsigned addr)
 
 unsigned vm_r_byte_noperm(x86emu_mem_t *mem, unsigned addr)
 {
-  mem2_page_t *page;
+  mem2_page_t page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   // unsigned char *attr;
 
-  page = vm_get_page(mem, addr, 1);
-  // attr = page->attr + page_idx;
+  page = *vm_get_page(mem, addr, 1);
+  // attr = mem2_attr(page) + page_idx;
 
-  return page->data[page_idx];
+  return mem2_data(page)[page_idx];
 }
 
 
 unsigned vm_r_word(x86emu_mem_t *mem, unsigned addr)
 {
-  mem2_page_t *page;
+  mem2_page_t page;
   unsigned val, page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   u16 *perm16;
 
-  page = vm_get_page(mem, addr, 1);
-  perm16 = (u16 *) (page->attr + page_idx);
+  page = *vm_get_page(mem, addr, 1);
+  perm16 = (u16 *) (mem2_attr(page) + page_idx);
 
   if(
 #if STRICT_ALIGN
@@ -379,9 +829,9 @@ unsigned vm_r_word(x86emu_mem_t *mem, unsigned addr)
   *perm16 |= PERM16(X86EMU_ACC_R);
 
 #if defined(__BIG_ENDIAN__) || STRICT_ALIGN
-  val = page->data[page_idx] + (page->data[page_idx + 1] << 8);
+  val = mem2_data(page)[page_idx] + (mem2_data(page)[page_idx + 1] << 8);
 #else
-  val = *(u16 *) (page->data + page_idx);
+  val = *(u16 *) (mem2_data(page) + page_idx);
 #endif
 
   return val;
@@ -390,12 +840,12 @@ unsigned vm_r_word(x86emu_mem_t *mem, unsigned addr)
 
 unsigned vm_r_dword(x86emu_mem_t *mem, unsigned addr)
 {
-  mem2_page_t *page;
+  mem2_page_t page;
   unsigned val, page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   u32 *perm32;
 
-  page = vm_get_page(mem, addr, 1);
-  perm32 = (u32 *) (page->attr + page_idx);
+  page = *vm_get_page(mem, addr, 1);
+  perm32 = (u32 *) (mem2_attr(page) + page_idx);
 
   if(
 #if STRICT_ALIGN
@@ -416,12 +866,12 @@ unsigned vm_r_dword(x86emu_mem_t *mem, unsigned addr)
   *perm32 |= PERM32(X86EMU_ACC_R);
 
 #if defined(__BIG_ENDIAN__) || STRICT_ALIGN
-  val = page->data[page_idx] +
-    (page->data[page_idx + 1] << 8) +
-    (page->data[page_idx + 2] << 16) +
-    (page->data[page_idx + 3] << 24);
+  val = mem2_data(page)[page_idx] +
+    (mem2_data(page)[page_idx + 1] << 8) +
+    (mem2_data(page)[page_idx + 2] << 16) +
+    (mem2_data(page)[page_idx + 3] << 24);
 #else
-  val = *(u32 *) (page->data + page_idx);
+  val = *(u32 *) (mem2_data(page) + page_idx);
 #endif
 
   return val;
@@ -430,12 +880,12 @@ unsigned vm_r_dword(x86emu_mem_t *mem, unsigned addr)
 
 unsigned vm_x_byte(x86emu_mem_t *mem, unsigned addr)
 {
-  mem2_page_t *page;
+  mem2_page_t page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   unsigned char *attr;
 
-  page = vm_get_page(mem, addr, 1);
-  attr = page->attr + page_idx;
+  page = *vm_get_page(mem, addr, 1);
+  attr = mem2_attr(page) + page_idx;
 
   if(*attr & X86EMU_PERM_X) {
     *attr |= X86EMU_ACC_X;
@@ -443,7 +893,7 @@ unsigned vm_x_byte(x86emu_mem_t *mem, unsigned addr)
       *attr |= X86EMU_ACC_INVALID;
       mem->invalid = 1;
     }
-    return page->data[page_idx];
+    return mem2_data(page)[page_idx];
   }
 
   mem->invalid = 1;
@@ -466,16 +916,18 @@ unsigned vm_x_dword(x86emu_mem_t *mem, unsigned addr)
 
 void vm_w_byte(x86emu_mem_t *mem, unsigned addr, unsigned val)
 {
-  mem2_page_t *page;
+  mem2_page_t *p, page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   unsigned char *attr;
 
-  page = vm_get_page(mem, addr, 1);
-  attr = page->attr + page_idx;
+  p = vm_get_page(mem, addr, 1);
+  page = *p;
+  attr = mem2_attr(page) + page_idx;
 
   if(*attr & X86EMU_PERM_W) {
     *attr |= X86EMU_PERM_VALID | X86EMU_ACC_W;
-    page->data[page_idx] = val;
+    mem2_data(page)[page_idx] = val;
+    if(page & MEM2_PAGE_TRACK) *p = page | MEM2_PAGE_DIRTY;
   }
   else {
     *attr |= X86EMU_ACC_INVALID;
@@ -487,26 +939,29 @@ void vm_w_byte(x86emu_mem_t *mem, unsigned addr, unsigned val)
 
 void vm_w_byte_noperm(x86emu_mem_t *mem, unsigned addr, unsigned val)
 {
-  mem2_page_t *page;
+  mem2_page_t *p, page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   unsigned char *attr;
 
-  page = vm_get_page(mem, addr, 1);
-  attr = page->attr + page_idx;
+  p = vm_get_page(mem, addr, 1);
+  page = *p;
+  attr = mem2_attr(page) + page_idx;
 
   *attr |= X86EMU_PERM_VALID | X86EMU_ACC_W;
-  page->data[page_idx] = val;
+  mem2_data(page)[page_idx] = val;
+  if(page & MEM2_PAGE_TRACK) *p = page | MEM2_PAGE_DIRTY;
 }
 
 
 void vm_w_word(x86emu_mem_t *mem, unsigned addr, unsigned val)
 {
-  mem2_page_t *page;
+  mem2_page_t *p, page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   u16 *perm16;
 
-  page = vm_get_page(mem, addr, 1);
-  perm16 = (u16 *) (page->attr + page_idx);
+  p = vm_get_page(mem, addr, 1);
+  page = *p;
+  perm16 = (u16 *) (mem2_attr(page) + page_idx);
 
   if(
 #if STRICT_ALIGN
@@ -524,23 +979,26 @@ void vm_w_word(x86emu_mem_t *mem, unsigned addr, unsigned val)
 
   *perm16 |= PERM16(X86EMU_PERM_VALID | X86EMU_ACC_W);
 
+  if(page & MEM2_PAGE_TRACK) *p = page | MEM2_PAGE_DIRTY;
+
 #if defined(__BIG_ENDIAN__) || STRICT_ALIGN
-  page->data[page_idx] = val;
-  page->data[page_idx + 1] = val >> 8;
+  mem2_data(page)[page_idx] = val;
+  mem2_data(page)[page_idx + 1] = val >> 8;
 #else
-  *(u16 *) (page->data + page_idx) = val;
+  *(u16 *) (mem2_data(page) + page_idx) = val;
 #endif
 }
 
 
 void vm_w_dword(x86emu_mem_t *mem, unsigned addr, unsigned val)
 {
-  mem2_page_t *page;
+  mem2_page_t *p, page;
   unsigned page_idx = addr & (X86EMU_PAGE_SIZE - 1);
   u32 *perm32;
 
-  page = vm_get_page(mem, addr, 1);
-  perm32 = (u32 *) (page->attr + page_idx);
+  p = vm_get_page(mem, addr, 1);
+  page = *p;
+  perm32 = (u32 *) (mem2_attr(page) + page_idx);
 
   if(
 #if STRICT_ALIGN
@@ -560,23 +1018,62 @@ void vm_w_dword(x86emu_mem_t *mem, unsigned addr, unsigned val)
 
   *perm32 |= PERM32(X86EMU_PERM_VALID | X86EMU_ACC_W);
 
+  if(page & MEM2_PAGE_TRACK) *p = page | MEM2_PAGE_DIRTY;
+
 #if defined(__BIG_ENDIAN__) || STRICT_ALIGN
-  page->data[page_idx] = val;
-  page->data[page_idx + 1] = val >> 8;
-  page->data[page_idx + 2] = val >> 16;
-  page->data[page_idx + 3] = val >> 24;
+  mem2_data(page)[page_idx] = val;
+  mem2_data(page)[page_idx + 1] = val >> 8;
+  mem2_data(page)[page_idx + 2] = val >> 16;
+  mem2_data(page)[page_idx + 3] = val >> 24;
 #else
-  *(u32 *) (page->data + page_idx) = val;
+  *(u32 *) (mem2_data(page) + page_idx) = val;
 #endif
 }
 
 
+/*
+ * Check permission perm (X86EMU_PERM_R or X86EMU_PERM_W) of len ports.
+ *
+ * If all ports are accessible, mark them as accessed and update access
+ * statistics. The ports may be spread over two chunks.
+ */
+int io_ports_access(x86emu_t *emu, unsigned port, unsigned len, unsigned perm)
+{
+  struct x86emu_io_chunk_s *c;
+  unsigned u, idx;
+
+  for(u = 0; u < len; u++) {
+    c = io_chunk(emu, port + u);
+    if(!(c->map[(port + u) & (IO_CHUNK_SIZE - 1)] & perm)) return 0;
+  }
+
+  for(u = 0; u < len; u++) {
+    c = io_chunk(emu, port + u);
+    idx = (port + u) & (IO_CHUNK_SIZE - 1);
+    if(perm == X86EMU_PERM_R) {
+      c->map[idx] |= X86EMU_ACC_R;
+      c->stats_i[idx]++;
+    }
+    else {
+      c->map[idx] |= X86EMU_ACC_W;
+      c->stats_o[idx]++;
+    }
+  }
+
+  return 1;
+}
+
+
 unsigned vm_i_byte(x86emu_t *emu, unsigned addr)
 {
+  struct x86emu_io_chunk_s *c;
   unsigned char *perm;
+  unsigned idx;
 
   addr &= 0xffff;
-  perm = emu->io.map + addr;
+  idx = addr & (IO_CHUNK_SIZE - 1);
+  c = io_chunk(emu, addr);
+  perm = c->map + idx;
 
   if(
     emu->io.iopl_ok &&
@@ -584,7 +1081,7 @@ unsigned vm_i_byte(x86emu_t *emu, unsigned addr)
   ) {
     *perm |= X86EMU_ACC_R;
 
-    emu->io.stats_i[addr]++;
+    c->stats_i[idx]++;
 
     return inb(addr);
   }
@@ -600,17 +1097,14 @@ unsigned vm_i_byte(x86emu_t *emu, unsigned addr)
 
 unsigned vm_i_word(x86emu_t *emu, unsigned addr)
 {
-  unsigned char *perm;
   unsigned val;
 
   addr &= 0xffff;
-  perm = emu->io.map + addr;
 
   if(
     !emu->io.iopl_ok ||
     addr == 0xffff ||
-    !(perm[0] & X86EMU_PERM_R) ||
-    !(perm[1] & X86EMU_PERM_R)
+    !io_ports_access(emu, addr, 2, X86EMU_PERM_R)
   ) {
     val = vm_i_byte(emu, addr);
     val += (vm_i_byte(emu, addr + 1) << 8);
@@ -618,31 +1112,21 @@ unsigned vm_i_word(x86emu_t *emu, unsigned addr)
     return val;
   }
 
-  perm[0] |= X86EMU_ACC_R;
-  perm[1] |= X86EMU_ACC_R;
-
-  emu->io.stats_i[addr]++;
-  emu->io.stats_i[addr + 1]++;
-
   return inw(addr);
 }
 
 
+
 unsigned vm_i_dword(x86emu_t *emu, unsigned addr)
 {
-  unsigned char *perm;
   unsigned val;
 
   addr &= 0xffff;
-  perm = emu->io.map + addr;
 
   if(
     !emu->io.iopl_ok ||
     addr >= 0xfffd ||
-    !(perm[0] & X86EMU_PERM_R) ||
-    !(perm[1] & X86EMU_PERM_R) ||
-    !(perm[2] & X86EMU_PERM_R) ||
-    !(perm[3] & X86EMU_PERM_R)
+    !io_ports_access(emu, addr, 4, X86EMU_PERM_R)
   ) {
     val = vm_i_byte(emu, addr);
     val += (vm_i_byte(emu, addr + 1) << 8);
@@ -652,26 +1136,21 @@ unsigned vm_i_dword(x86emu_t *emu, unsigned addr)
     return val;
   }
 
-  perm[0] |= X86EMU_ACC_R;
-  perm[1] |= X86EMU_ACC_R;
-  perm[2] |= X86EMU_ACC_R;
-  perm[3] |= X86EMU_ACC_R;
-
-  emu->io.stats_i[addr]++;
-  emu->io.stats_i[addr + 1]++;
-  emu->io.stats_i[addr + 2]++;
-  emu->io.stats_i[addr + 3]++;
-
   return inl(addr);
 }
 
 
+
 void vm_o_byte(x86emu_t *emu, unsigned addr, unsigned val)
 {
+  struct x86emu_io_chunk_s *c;
   unsigned char *perm;
+  unsigned idx;
 
   addr &= 0xffff;
-  perm = emu->io.map + addr;
+  idx = addr & (IO_CHUNK_SIZE - 1);
+  c = io_chunk(emu, addr);
+  perm = c->map + idx;
 
   if(
     emu->io.iopl_ok &&
@@ -679,7 +1158,7 @@ void vm_o_byte(x86emu_t *emu, unsigned addr, unsigned val)
   ) {
     *perm |= X86EMU_ACC_W;
 
-    emu->io.stats_o[addr]++;
+    c->stats_o[idx]++;
 
     outb(val, addr);
   }
@@ -693,16 +1172,12 @@ void vm_o_byte(x86emu_t *emu, unsigned addr, unsigned val)
 
 void vm_o_word(x86emu_t *emu, unsigned addr, unsigned val)
 {
-  unsigned char *perm;
-
   addr &= 0xffff;
-  perm = emu->io.map + addr;
 
   if(
     !emu->io.iopl_ok ||
     addr == 0xffff ||
-    !(perm[0] & X86EMU_PERM_W) ||
-    !(perm[1] & X86EMU_PERM_W)
+    !io_ports_access(emu, addr, 2, X86EMU_PERM_W)
   ) {
     vm_o_byte(emu, addr, val);
     vm_o_byte(emu, addr + 1, val);
@@ -710,30 +1185,19 @@ void vm_o_word(x86emu_t *emu, unsigned addr, unsigned val)
     return;
   }
 
-  perm[0] |= X86EMU_ACC_W;
-  perm[1] |= X86EMU_ACC_W;
-
-  emu->io.stats_o[addr]++;
-  emu->io.stats_o[addr + 1]++;
-
   outw(val, addr);
 }
 
 
+
 void vm_o_dword(x86emu_t *emu, unsigned addr, unsigned val)
 {
-  unsigned char *perm;
-
   addr &= 0xffff;
-  perm = emu->io.map + addr;
 
   if(
     !emu->io.iopl_ok ||
     addr >= 0xfffd ||
-    !(perm[0] & X86EMU_PERM_W) ||
-    !(perm[1] & X86EMU_PERM_W) ||
-    !(perm[2] & X86EMU_PERM_W) ||
-    !(perm[3] & X86EMU_PERM_W)
+    !io_ports_access(emu, addr, 4, X86EMU_PERM_W)
   ) {
     vm_o_byte(emu, addr, val);
     vm_o_byte(emu, addr + 1, val);
@@ -743,17 +1207,40 @@ void vm_o_dword(x86emu_t *emu, unsigned addr, unsigned val)
     return;
   }
 
-  perm[0] |= X86EMU_ACC_W;
-  perm[1] |= X86EMU_ACC_W;
-  perm[2] |= X86EMU_ACC_W;
-  perm[3] |= X86EMU_ACC_W;
+  outl(val, addr);
+}
 
-  emu->io.stats_o[addr]++;
-  emu->io.stats_o[addr + 1]++;
-  emu->io.stats_o[addr + 2]++;
-  emu->io.stats_o[addr + 3]++;
 
-  outl(val, addr);
+
+/*
+ * Port i/o through registered device handler.
+ *
+ * The handler of the first port gets the whole access. Access statistics
+ * are updated as for real ports but i/o permissions are not checked.
+ * Ports without a handler for the access direction go to emu->memio.
+ */
+unsigned vm_io(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
+{
+  struct x86emu_io_handler_s *h;
+  unsigned port, bits = type & 0xff, len;
+
+  port = addr & 0xffff;
+  h = emu->priv->io.handler + io_handler(emu, port) - 1;
+  len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+
+  if((type & ~0xff) == X86EMU_MEMIO_I) {
+    if(!h->in) return emu->priv->perf ? perf_memio(emu, addr, val, type) : emu->memio(emu, addr, val, type);
+    *val = h->in(emu, h->ctx, port, bits);
+    if(len < 4) *val &= (1u << (len * 8)) - 1;
+  }
+  else {
+    if(!h->out) return emu->priv->perf ? perf_memio(emu, addr, val, type) : emu->memio(emu, addr, val, type);
+    h->out(emu, h->ctx, port, *val, bits);
+  }
+
+  io_account(emu, port, len, type & ~0xff, 1);
+
+  return 0;
 }
 
 
@@ -766,6 +1253,8 @@ unsigned vm_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
 
   mem->invalid = 0;
 
+  if(emu->priv->heat && type <= X86EMU_MEMIO_X && bits != X86EMU_MEMIO_8_NOPERM) heat_count(emu->priv->heat, addr, type);
+
   switch(type) {
     case X86EMU_MEMIO_R:
       switch(bits) {
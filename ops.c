@@ -2374,6 +2374,8 @@ static void x86emuOp_call_far_IMM(x86emu_t *emu, u8 op1)
 
   x86emu_set_seg_register(emu, emu->x86.R_CS_SEL, cs);
   emu->x86.R_EIP = eip;
+
+  if(emu->priv->cg) cg_call(emu);
 }
 
 
@@ -3649,6 +3651,8 @@ static void x86emuOp_ret_near_IMM(x86emu_t *emu, u8 op1)
 
   DECODE_HEX4(imm);
 
+  if(emu->priv->cg) cg_ret(emu);
+
   if(MODE_DATA32) {
     emu->x86.R_EIP = pop_long(emu);
     emu->x86.R_ESP += imm;
@@ -3668,6 +3672,8 @@ static void x86emuOp_ret_near(x86emu_t *emu, u8 op1)
 {
   OP_DECODE("ret");
 
+  if(emu->priv->cg) cg_ret(emu);
+
   if(MODE_DATA32) {
     emu->x86.R_EIP = pop_long(emu);
   }
@@ -3943,6 +3949,8 @@ static void x86emuOp_ret_far_IMM(x86emu_t *emu, u8 op1)
 
   DECODE_HEX4(imm);
 
+  if(emu->priv->cg) cg_ret(emu);
+
   if(MODE_DATA32) {
     eip = pop_long(emu);
     cs = pop_long(emu);
@@ -3970,6 +3978,8 @@ static void x86emuOp_ret_far(x86emu_t *emu, u8 op1)
 
   OP_DECODE("retf");
 
+  if(emu->priv->cg) cg_ret(emu);
+
   if(MODE_DATA32) {
     eip = pop_long(emu);
     cs = pop_long(emu);
@@ -4035,6 +4045,10 @@ static void x86emuOp_iret(x86emu_t *emu, u8 op1)
 
   OP_DECODE("iret");
 
+  if(emu->priv->icost) icost_iret(emu);
+
+  if(emu->priv->cg) cg_ret(emu);
+
   if(MODE_DATA32) {   
     eip = pop_long(emu);
     cs = pop_long(emu);
@@ -4494,6 +4508,8 @@ static void x86emuOp_call_near_IMM(x86emu_t *emu, u8 op1)
   }
 
   emu->x86.R_EIP = eip;
+
+  if(emu->priv->cg) cg_call(emu);
 }
 
 
@@ -4575,7 +4591,7 @@ static void x86emuOp_jump_byte_IMM(x86emu_t *emu, u8 op1)
   }
 
   // we had a prefix: special debug instruction
-  if((emu->log.trace & X86EMU_TRACE_DEBUG) && emu->x86.R_EIP - emu->x86.saved_eip == 3 && ofs >= 1) {
+  if((emu->priv->trace & X86EMU_TRACE_DEBUG) && emu->x86.R_EIP - emu->x86.saved_eip == 3 && ofs >= 1) {
     emu->x86.debug_start = emu->x86.R_CS_BASE + emu->x86.R_EIP;
     emu->x86.debug_len = ofs;
   }
@@ -4647,6 +4663,7 @@ Handles opcode 0xf4
 static void x86emuOp_hlt(x86emu_t *emu, u8 op1)
 {
   OP_DECODE("hlt");
+  if(emu->priv->dev && dev_halt(emu)) return;
   x86emu_stop(emu);
 }
 
@@ -5184,6 +5201,7 @@ static void x86emuOp_opcFF_word_RM(x86emu_t *emu, u8 op1)
           push_word(emu, emu->x86.R_IP);
           emu->x86.R_EIP = *reg16;
         }
+        if(emu->priv->cg) cg_call(emu);
         break;
 
       case 4:	/* jmp */
@@ -5275,6 +5293,7 @@ static void x86emuOp_opcFF_word_RM(x86emu_t *emu, u8 op1)
           push_word(emu, emu->x86.R_IP);
         }
         emu->x86.R_EIP = val;
+        if(emu->priv->cg) cg_call(emu);
         break;
 
       case 3:	/* call far */
@@ -5301,6 +5320,7 @@ static void x86emuOp_opcFF_word_RM(x86emu_t *emu, u8 op1)
 
         x86emu_set_seg_register(emu, emu->x86.R_CS_SEL, cs);
         emu->x86.R_EIP = val;
+        if(emu->priv->cg) cg_call(emu);
         break;
 
       case 4:	/* jmp */
@@ -740,7 +740,10 @@ static void x86emuOp2_rdmsr(x86emu_t *emu, u8 op2)
     INTR_RAISE_UD(emu);
   }
   else {
-    if(emu->rdmsr) {
+    if(emu->priv->journal) {
+      if(emu->rdmsr) journal_rdmsr(emu);
+    }
+    else if(emu->rdmsr) {
       emu->rdmsr(emu);
     }
   }
@@ -1064,7 +1067,15 @@ static void x86emuOp2_cpuid(x86emu_t *emu, u8 op2)
   OP_DECODE("cpuid ");
 
   if(emu->cpuid) {
-    emu->cpuid(emu);
+    if(emu->priv->journal) {
+      journal_cpuid(emu);
+    }
+    else if(emu->priv->perf) {
+      perf_cpuid(emu);
+    }
+    else {
+      emu->cpuid(emu);
+    }
   }
   else {
     INTR_RAISE_UD(emu);
@@ -0,0 +1,376 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   PCI configuration space emulation (configuration mechanism #1 and
+*   PCI BIOS int 0x1a, ax = 0xb1xx) based on config space snapshots.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+#define PCI_SUCCESSFUL		0x00
+#define PCI_FUNC_NOT_SUPPORTED	0x81
+#define PCI_DEVICE_NOT_FOUND	0x86
+#define PCI_BAD_REGISTER	0x87
+
+static dev_pci_t *pci_find(x86emu_t *emu, unsigned bus, unsigned devfn);
+static u8 pci_wmask(dev_pci_t *pci, unsigned reg);
+static u32 pci_read(x86emu_t *emu, unsigned bus, unsigned devfn, unsigned reg, unsigned len);
+static void pci_write(x86emu_t *emu, unsigned bus, unsigned devfn, unsigned reg, unsigned len, u32 val);
+static void pci_read_resources(dev_pci_t *pci, const char *file);
+
+
+/*
+ * Add PCI device with config space data 'config' (up to 256 bytes).
+ *
+ * Returns 0 on success, -1 on failure. Device models must have been
+ * enabled (see x86emu_set_devices()).
+ */
+API_SYM int x86emu_pci_add_device(x86emu_t *emu, unsigned bus, unsigned dev, unsigned func, const void *config, unsigned size)
+{
+  struct x86emu_dev_s *d;
+  dev_pci_t *pci;
+  unsigned u, devfn = (dev << 3) + func;
+
+  if(!emu || !(d = emu->priv->dev) || bus > 0xff || dev > 0x1f || func > 7 || !config) return -1;
+
+  if(!(pci = pci_find(emu, bus, devfn))) {
+    pci = realloc(d->pci.dev, (d->pci.devs + 1) * sizeof *pci);
+    if(!pci) return -1;
+    d->pci.dev = pci;
+
+    for(u = 0; u < d->pci.devs; u++) {
+      if((pci[u].bus << 8) + pci[u].devfn > (bus << 8) + devfn) break;
+    }
+    memmove(pci + u + 1, pci + u, (d->pci.devs - u) * sizeof *pci);
+    d->pci.devs++;
+
+    pci += u;
+  }
+
+  memset(pci, 0, sizeof *pci);
+  pci->bus = bus;
+  pci->devfn = devfn;
+
+  if(size > sizeof pci->config) size = sizeof pci->config;
+  memcpy(pci->config, config, size);
+
+  return 0;
+}
+
+
+/*
+ * Add PCI device from config space dump (e.g. /sys/bus/pci/devices/<device>/config).
+ *
+ * If there's a 'resource' file in the same directory, it is used to get
+ * the BAR sizes.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+API_SYM int x86emu_pci_load_device(x86emu_t *emu, unsigned bus, unsigned dev, unsigned func, const char *file)
+{
+  FILE *f;
+  u8 config[256];
+  unsigned size;
+  char *res, *s;
+
+  if(!file || !(f = fopen(file, "r"))) return -1;
+
+  size = fread(config, 1, sizeof config, f);
+  fclose(f);
+
+  if(size < 0x40 || x86emu_pci_add_device(emu, bus, dev, func, config, size)) return -1;
+
+  if((res = malloc(strlen(file) + sizeof "resource"))) {
+    strcpy(res, file);
+    s = strrchr(res, '/');
+    strcpy(s ? s + 1 : res, "resource");
+    pci_read_resources(pci_find(emu, bus, (dev << 3) + func), res);
+    free(res);
+  }
+
+  return 0;
+}
+
+
+dev_pci_t *pci_find(x86emu_t *emu, unsigned bus, unsigned devfn)
+{
+  dev_pci_t *pci = emu->priv->dev->pci.dev;
+  unsigned u;
+
+  for(u = 0; u < emu->priv->dev->pci.devs; u++, pci++) {
+    if(pci->bus == bus && pci->devfn == devfn) return pci;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Get BAR sizes from sysfs 'resource' file.
+ *
+ * Without it BARs are read-only.
+ */
+void pci_read_resources(dev_pci_t *pci, const char *file)
+{
+  FILE *f;
+  unsigned long long start, end, flags, mask;
+  unsigned u, reg;
+  u32 bar;
+
+  if(!pci || !(f = fopen(file, "r"))) return;
+
+  for(u = 0; u < 7 && fscanf(f, "%llx %llx %llx", &start, &end, &flags) == 3; u++) {
+    if(!end || end < start) continue;
+
+    reg = u == 6 ? 0x30 : 0x10 + 4 * u;
+    bar = pci->config[reg] + (pci->config[reg + 1] << 8) + (pci->config[reg + 2] << 16) + (pci->config[reg + 3] << 24);
+    mask = ~(end - start);
+
+    if(u == 6) {
+      pci->bar_mask[u] = (mask & ~0x7ffULL) | 1;
+    }
+    else if(bar & 1) {
+      pci->bar_mask[u] = mask & ~3ULL;
+    }
+    else {
+      pci->bar_mask[u] = mask & ~0xfULL;
+      // 64 bit BAR
+      if((bar & 6) == 4 && u < 5) pci->bar_mask[u + 1] = mask >> 32;
+    }
+  }
+
+  fclose(f);
+}
+
+
+/*
+ * Writable bits of config register byte.
+ */
+u8 pci_wmask(dev_pci_t *pci, unsigned reg)
+{
+  unsigned type = pci->config[0x0e] & 0x7f;
+
+  // command, cache line size, latency timer, interrupt line
+  if(reg == 0x04 || reg == 0x05 || reg == 0x0c || reg == 0x0d || reg == 0x3c) return 0xff;
+
+  // device specific
+  if(reg >= 0x40) return 0xff;
+
+  if(reg >= 0x10 && reg < 0x18) return pci->bar_mask[(reg - 0x10) >> 2] >> ((reg & 3) * 8);
+
+  if(type == 0) {
+    if(reg >= 0x18 && reg < 0x28) return pci->bar_mask[(reg - 0x10) >> 2] >> ((reg & 3) * 8);
+    if(reg >= 0x30 && reg < 0x34) return pci->bar_mask[6] >> ((reg & 3) * 8);
+  }
+  else if(type == 1) {
+    // bus numbers, bridge windows, bridge control
+    if(reg >= 0x18 && reg < 0x30 && reg != 0x1e && reg != 0x1f) return 0xff;
+    if(reg == 0x3e || reg == 0x3f) return 0xff;
+  }
+
+  return 0;
+}
+
+
+u32 pci_read(x86emu_t *emu, unsigned bus, unsigned devfn, unsigned reg, unsigned len)
+{
+  dev_pci_t *pci = pci_find(emu, bus, devfn);
+  unsigned u;
+  u32 val = 0;
+
+  if(!pci) return 0xffffffff >> (32 - len * 8);
+
+  for(u = 0; u < len; u++) {
+    val += pci->config[(reg + u) & 0xff] << (u * 8);
+  }
+
+  return val;
+}
+
+
+void pci_write(x86emu_t *emu, unsigned bus, unsigned devfn, unsigned reg, unsigned len, u32 val)
+{
+  dev_pci_t *pci = pci_find(emu, bus, devfn);
+  unsigned u, r;
+  u8 mask;
+
+  if(!pci) return;
+
+  for(u = 0; u < len; u++, val >>= 8) {
+    r = (reg + u) & 0xff;
+    mask = pci_wmask(pci, r);
+    pci->config[r] = (pci->config[r] & ~mask) + (val & mask);
+  }
+}
+
+
+/*
+ * Ports 0xcf8 - 0xcff: configuration mechanism #1.
+ */
+u32 pci_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits)
+{
+  u32 addr = emu->priv->dev->pci.addr;
+  unsigned len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+
+  if(port == 0xcf8 && len == 4) return addr;
+
+  if(port < 0xcfc || !(addr & 0x80000000)) return 0xffffffff;
+
+  return pci_read(emu, (addr >> 16) & 0xff, (addr >> 8) & 0xff, (addr & 0xfc) + (port & 3), len);
+}
+
+
+void pci_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits)
+{
+  u32 addr = emu->priv->dev->pci.addr;
+  unsigned len = bits == X86EMU_MEMIO_32 ? 4 : bits == X86EMU_MEMIO_16 ? 2 : 1;
+
+  if(port == 0xcf8 && len == 4) {
+    emu->priv->dev->pci.addr = val & 0x80fffffc;
+
+    return;
+  }
+
+  if(port < 0xcfc || !(addr & 0x80000000)) return;
+
+  pci_write(emu, (addr >> 16) & 0xff, (addr >> 8) & 0xff, (addr & 0xfc) + (port & 3), len, val);
+}
+
+
+/*
+ * PCI BIOS (int 0x1a, ah = 0xb1), see x86emu_set_bios_handler().
+ *
+ * Returns 1 if the interrupt has been handled.
+ */
+int pci_bios(x86emu_t *emu, void *ctx)
+{
+  struct x86emu_dev_s *dev = emu->priv->dev;
+  dev_pci_t *pci = dev->pci.dev;
+  unsigned u, idx, err = PCI_SUCCESSFUL, bus = emu->x86.R_BH, devfn = emu->x86.R_BL, reg = emu->x86.R_DI;
+
+  if(emu->x86.R_AH != 0xb1) return 0;
+
+  switch(emu->x86.R_AL) {
+    case 0x01:
+      // installation check: mechanism #1, version 2.10
+      emu->x86.R_AL = 0x01;
+      emu->x86.R_BX = 0x0210;
+      emu->x86.R_CL = dev->pci.devs ? pci[dev->pci.devs - 1].bus : 0;
+      emu->x86.R_EDX = 0x20494350;
+      break;
+
+    case 0x02:
+    case 0x03:
+      // find device (cx: device, dx: vendor) resp. class (ecx), si: index
+      err = PCI_DEVICE_NOT_FOUND;
+      for(idx = emu->x86.R_SI, u = 0; u < dev->pci.devs; u++, pci++) {
+        if(emu->x86.R_AL == 0x02) {
+          if(
+            emu->x86.R_DX == 0xffff ||
+            pci->config[0] + (pci->config[1] << 8) != emu->x86.R_DX ||
+            pci->config[2] + (pci->config[3] << 8) != emu->x86.R_CX
+          ) continue;
+        }
+        else {
+          if(pci->config[9] + (pci->config[10] << 8) + (pci->config[11] << 16) != (emu->x86.R_ECX & 0xffffff)) continue;
+        }
+        if(!idx--) {
+          emu->x86.R_BH = pci->bus;
+          emu->x86.R_BL = pci->devfn;
+          err = PCI_SUCCESSFUL;
+          break;
+        }
+      }
+      break;
+
+    case 0x08:
+      if(reg > 0xff) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      emu->x86.R_CL = pci_read(emu, bus, devfn, reg, 1);
+      break;
+
+    case 0x09:
+      if(reg > 0xff || (reg & 1)) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      emu->x86.R_CX = pci_read(emu, bus, devfn, reg, 2);
+      break;
+
+    case 0x0a:
+      if(reg > 0xff || (reg & 3)) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      emu->x86.R_ECX = pci_read(emu, bus, devfn, reg, 4);
+      break;
+
+    case 0x0b:
+      if(reg > 0xff) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      pci_write(emu, bus, devfn, reg, 1, emu->x86.R_CL);
+      break;
+
+    case 0x0c:
+      if(reg > 0xff || (reg & 1)) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      pci_write(emu, bus, devfn, reg, 2, emu->x86.R_CX);
+      break;
+
+    case 0x0d:
+      if(reg > 0xff || (reg & 3)) {
+        err = PCI_BAD_REGISTER;
+        break;
+      }
+      pci_write(emu, bus, devfn, reg, 4, emu->x86.R_ECX);
+      break;
+
+    default:
+      err = PCI_FUNC_NOT_SUPPORTED;
+      break;
+  }
+
+  emu->x86.R_AH = err;
+  if(err) {
+    SET_FLAG(F_CF);
+  }
+  else {
+    CLEAR_FLAG(F_CF);
+  }
+
+  return 1;
+}
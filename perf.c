@@ -0,0 +1,162 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Engine performance counters. Counter groups are selected with
+*   x86emu_set_perf_counters(); disabled groups cost a pointer check.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+
+/*
+ * Enable counter groups (X86EMU_PERF_*); 0 turns counters off. All counters
+ * are cleared.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_perf_counters(x86emu_t *emu, unsigned groups)
+{
+  if(!emu) return -1;
+
+  free(emu->priv->perf);
+  emu->priv->perf = NULL;
+  emu->mem->perf = NULL;
+
+  if(!groups) return 0;
+
+  if(!(emu->priv->perf = calloc(1, sizeof *emu->priv->perf))) return -1;
+
+  emu->priv->perf->groups = groups;
+  if((groups & X86EMU_PERF_MEM)) emu->mem->perf = &emu->priv->perf->c;
+
+  return 0;
+}
+
+
+/*
+ * Get a copy of the counters.
+ *
+ * Returns 0 on success, -1 if counters are off.
+ */
+API_SYM int x86emu_get_perf_counters(x86emu_t *emu, x86emu_perf_counters_t *counters)
+{
+  if(!emu || !emu->priv->perf || !counters) return -1;
+
+  *counters = emu->priv->perf->c;
+
+  return 0;
+}
+
+
+/*
+ * Call memio handler.
+ */
+unsigned perf_memio(x86emu_t *emu, u32 addr, u32 *val, unsigned type)
+{
+  x86emu_perf_counters_t *c = &emu->priv->perf->c;
+  unsigned err;
+  u64 t;
+
+  if((emu->priv->perf->groups & X86EMU_PERF_MEMIO) && (type >> 8) <= (X86EMU_MEMIO_O >> 8)) {
+    c->memio[type >> 8][type & 3]++;
+  }
+
+  if(!(emu->priv->perf->groups & X86EMU_PERF_CALLBACK) || emu->memio == vm_memio) {
+    return emu->memio(emu, addr, val, type);
+  }
+
+  t = host_ns();
+  err = emu->memio(emu, addr, val, type);
+  c->callback_ns[X86EMU_PERF_CB_MEMIO] += host_ns() - t;
+  c->callbacks[X86EMU_PERF_CB_MEMIO]++;
+
+  return err;
+}
+
+
+/*
+ * Call interrupt handler.
+ */
+int perf_intr(x86emu_t *emu, u8 nr, unsigned type)
+{
+  x86emu_perf_counters_t *c = &emu->priv->perf->c;
+  int i;
+  u64 t;
+
+  if(!(emu->priv->perf->groups & X86EMU_PERF_CALLBACK)) return emu->intr(emu, nr, type);
+
+  t = host_ns();
+  i = emu->intr(emu, nr, type);
+  c->callback_ns[X86EMU_PERF_CB_INTR] += host_ns() - t;
+  c->callbacks[X86EMU_PERF_CB_INTR]++;
+
+  return i;
+}
+
+
+/*
+ * Call code check handler.
+ */
+int perf_code_check(x86emu_t *emu)
+{
+  x86emu_perf_counters_t *c = &emu->priv->perf->c;
+  int i;
+  u64 t;
+
+  if(!(emu->priv->perf->groups & X86EMU_PERF_CALLBACK)) return emu->code_check(emu);
+
+  t = host_ns();
+  i = emu->code_check(emu);
+  c->callback_ns[X86EMU_PERF_CB_CODE_CHECK] += host_ns() - t;
+  c->callbacks[X86EMU_PERF_CB_CODE_CHECK]++;
+
+  return i;
+}
+
+
+/*
+ * Call cpuid handler.
+ */
+void perf_cpuid(x86emu_t *emu)
+{
+  x86emu_perf_counters_t *c = &emu->priv->perf->c;
+  u64 t;
+
+  if(!(emu->priv->perf->groups & X86EMU_PERF_CALLBACK)) {
+    emu->cpuid(emu);
+    return;
+  }
+
+  t = host_ns();
+  emu->cpuid(emu);
+  c->callback_ns[X86EMU_PERF_CB_CPUID] += host_ns() - t;
+  c->callbacks[X86EMU_PERF_CB_CPUID]++;
+}
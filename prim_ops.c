@@ -2300,15 +2300,21 @@ Implements the IN string instruction and side effects.
 void ins(x86emu_t *emu, int size)
 {
   s32 inc;
-  u32 count;
+  u32 count, n;
 
-  inc = ACCESS_FLAG(F_DF) ? -1 : 1;
+  inc = ACCESS_FLAG(F_DF) ? -size : size;
 
   if(MODE_ADDR32) {
     if(MODE_REP) {
       count = emu->x86.R_ECX;
       emu->x86.R_ECX = 0;
 
+      if(inc > 0) {
+        n = block_io(emu, emu->x86.R_DX, emu->x86.seg + R_ES_INDEX, emu->x86.R_EDI, count, size, X86EMU_MEMIO_I);
+        emu->x86.R_EDI += n * size;
+        count -= n;
+      }
+
       switch(size) {
         case 1:
           while(count--) {
@@ -2342,7 +2348,7 @@ void ins(x86emu_t *emu, int size)
           store_data_long_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_EDI, fetch_io_long(emu, emu->x86.R_DX));
           break;
       }
-       emu->x86.R_EDI += inc;
+      emu->x86.R_EDI += inc;
     }
   }
   else {
@@ -2350,6 +2356,14 @@ void ins(x86emu_t *emu, int size)
       count = emu->x86.R_CX;
       emu->x86.R_CX = 0;
 
+      // block transfer must not wrap at 64k
+      if(inc > 0) {
+        n = (0x10000 - emu->x86.R_DI) / size;
+        n = block_io(emu, emu->x86.R_DX, emu->x86.seg + R_ES_INDEX, emu->x86.R_DI, count < n ? count : n, size, X86EMU_MEMIO_I);
+        emu->x86.R_DI += n * size;
+        count -= n;
+      }
+
       switch(size) {
         case 1:
           while(count--) {
@@ -2395,31 +2409,37 @@ Implements the OUT string instruction and side effects.
 void outs(x86emu_t *emu, int size)
 {
   s32 inc;
-  u32 count;
+  u32 count, n;
 
-  inc = ACCESS_FLAG(F_DF) ? -1 : 1;
+  inc = ACCESS_FLAG(F_DF) ? -size : size;
 
   if(MODE_ADDR32) {
     if(MODE_REP) {
       count = emu->x86.R_ECX;
       emu->x86.R_ECX = 0;
-   
+
+      if(inc > 0) {
+        n = block_io(emu, emu->x86.R_DX, get_data_segment(emu), emu->x86.R_ESI, count, size, X86EMU_MEMIO_O);
+        emu->x86.R_ESI += n * size;
+        count -= n;
+      }
+
       switch(size) {
         case 1:
           while(count--) {
-            store_io_byte(emu, emu->x86.R_DX, fetch_data_byte_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+            store_io_byte(emu, emu->x86.R_DX, fetch_data_byte(emu, emu->x86.R_ESI));
             emu->x86.R_ESI += inc;
           }
           break;
         case 2:
           while(count--) {
-            store_io_word(emu, emu->x86.R_DX, fetch_data_word_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+            store_io_word(emu, emu->x86.R_DX, fetch_data_word(emu, emu->x86.R_ESI));
             emu->x86.R_ESI += inc;
           }
           break;
         case 4:
           while(count--) {
-            store_io_long(emu, emu->x86.R_DX, fetch_data_long_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+            store_io_long(emu, emu->x86.R_DX, fetch_data_long(emu, emu->x86.R_ESI));
             emu->x86.R_ESI += inc;
           }
           break;
@@ -2428,39 +2448,47 @@ void outs(x86emu_t *emu, int size)
     else {
       switch(size) {
         case 1:
-          store_io_byte(emu, emu->x86.R_DX, fetch_data_byte_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+          store_io_byte(emu, emu->x86.R_DX, fetch_data_byte(emu, emu->x86.R_ESI));
           break;
         case 2:
-          store_io_word(emu, emu->x86.R_DX, fetch_data_word_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+          store_io_word(emu, emu->x86.R_DX, fetch_data_word(emu, emu->x86.R_ESI));
           break;
         case 4:
-          store_io_long(emu, emu->x86.R_DX, fetch_data_long_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_ESI));
+          store_io_long(emu, emu->x86.R_DX, fetch_data_long(emu, emu->x86.R_ESI));
           break;
       }
-      emu->x86.R_SI += inc;
+      emu->x86.R_ESI += inc;
     }
   }
   else {
     if(MODE_REP) {
       count = emu->x86.R_CX;
       emu->x86.R_CX = 0;
-   
+
+      // block transfer must not wrap at 64k
+      if(inc > 0) {
+        n = (0x10000 - emu->x86.R_SI) / size;
+        n = block_io(emu, emu->x86.R_DX, get_data_segment(emu), emu->x86.R_SI, count < n ? count : n, size, X86EMU_MEMIO_O);
+        emu->x86.R_SI += n * size;
+        count -= n;
+      }
+
       switch(size) {
         case 1:
           while(count--) {
-            store_io_byte(emu, emu->x86.R_DX, fetch_data_byte_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+            store_io_byte(emu, emu->x86.R_DX, fetch_data_byte(emu, emu->x86.R_SI));
             emu->x86.R_SI += inc;
           }
           break;
         case 2:
           while(count--) {
-            store_io_word(emu, emu->x86.R_DX, fetch_data_word_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+            store_io_word(emu, emu->x86.R_DX, fetch_data_word(emu, emu->x86.R_SI));
             emu->x86.R_SI += inc;
           }
           break;
         case 4:
           while(count--) {
-            store_io_long(emu, emu->x86.R_DX, fetch_data_long_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+            store_io_long(emu, emu->x86.R_DX, fetch_data_long(emu, emu->x86.R_SI));
             emu->x86.R_SI += inc;
           }
           break;
@@ -2469,13 +2497,13 @@ void outs(x86emu_t *emu, int size)
     else {
       switch(size) {
         case 1:
-          store_io_byte(emu, emu->x86.R_DX, fetch_data_byte_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+          store_io_byte(emu, emu->x86.R_DX, fetch_data_byte(emu, emu->x86.R_SI));
           break;
         case 2:
-          store_io_word(emu, emu->x86.R_DX, fetch_data_word_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+          store_io_word(emu, emu->x86.R_DX, fetch_data_word(emu, emu->x86.R_SI));
           break;
         case 4:
-          store_io_long(emu, emu->x86.R_DX, fetch_data_long_abs(emu, emu->x86.seg + R_ES_INDEX, emu->x86.R_SI));
+          store_io_long(emu, emu->x86.R_DX, fetch_data_long(emu, emu->x86.R_SI));
           break;
       }
       emu->x86.R_SI += inc;
@@ -0,0 +1,345 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Sampling profiler. Every 'interval' instructions (or real time stamp
+*   ticks) cs:eip and optionally the return addresses found by following
+*   the (e)bp chain are added to a histogram.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static x86emu_prof_entry_t *prof_entry(struct x86emu_prof_s *prof, x86emu_prof_entry_t *e);
+static unsigned prof_hash(x86emu_prof_entry_t *e);
+static u32 prof_read(x86emu_t *emu, u32 addr, unsigned len);
+static int prof_cmp(const void *a, const void *b);
+
+
+/*
+ * Sample every 'interval' instructions with up to 'frames' stack frames
+ * (including the current instruction); interval = 0 turns the profiler off.
+ *
+ * flags: X86EMU_PROF_*.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_profiler(x86emu_t *emu, unsigned interval, unsigned frames, unsigned flags)
+{
+  struct x86emu_prof_s *prof;
+
+  if(!emu) return -1;
+
+  emu->priv->prof = prof_free(emu->priv->prof);
+
+  if(!interval) return 0;
+
+  if(!WITH_TSC && (flags & X86EMU_PROF_REAL_TIME)) return -1;
+
+  if(!(prof = calloc(1, sizeof *prof))) return -1;
+
+  prof->flags = flags;
+  prof->interval = interval;
+  prof->frames = frames < 1 ? 1 : frames > X86EMU_PROF_FRAMES ? X86EMU_PROF_FRAMES : frames;
+  prof->next = ((flags & X86EMU_PROF_REAL_TIME) ? emu->x86.R_REAL_TSC : emu->x86.R_TSC) + interval;
+
+  emu->priv->prof = prof;
+
+  return 0;
+}
+
+
+/*
+ * Get histogram entries and total number of samples.
+ */
+API_SYM const x86emu_prof_entry_t *x86emu_get_profile(x86emu_t *emu, unsigned *entries, u64 *samples)
+{
+  struct x86emu_prof_s *prof = emu ? emu->priv->prof : NULL;
+
+  if(entries) *entries = prof ? prof->entries : 0;
+  if(samples) *samples = prof ? prof->samples : 0;
+
+  return prof ? prof->entry : NULL;
+}
+
+
+/*
+ * Write profile in legacy pprof cpu profile format (native 64 bit words).
+ * Addresses are linear addresses; the period is 'interval' (see
+ * prof_pprof_header()).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_write_profile(x86emu_t *emu, const char *file)
+{
+  struct x86emu_prof_s *prof;
+  x86emu_prof_entry_t *e;
+  FILE *f;
+  u64 pc[X86EMU_PROF_FRAMES];
+  unsigned u, n;
+  int err;
+
+  if(!emu || !(prof = emu->priv->prof) || !file) return -1;
+
+  if(!(f = fopen(file, "w"))) return -1;
+
+  err = prof_pprof_header(f, prof->interval);
+
+  for(u = 0; u < prof->entries && !err; u++) {
+    e = prof->entry + u;
+    for(n = 0; n < e->frames; n++) pc[n] = (u32) (e->cs_base + e->eip[n]);
+    err = prof_pprof_sample(f, e->count, n, pc);
+  }
+
+  if(!err) err = prof_pprof_trailer(f);
+
+  if(fclose(f)) err = -1;
+
+  return err;
+}
+
+
+/*
+ * Legacy pprof cpu profile header: 0, 3 (header words), 0 (version),
+ * sampling period, 0.
+ *
+ * pprof takes the period as microseconds. We have no time base and store
+ * instructions (or real time stamp ticks) per sample instead, so what pprof
+ * reports as microseconds are instructions.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int prof_pprof_header(FILE *f, u64 period)
+{
+  u64 w[5] = { 0, 3, 0, period, 0 };
+
+  return fwrite(w, sizeof *w, 5, f) == 5 ? 0 : -1;
+}
+
+
+/*
+ * pprof sample: count, depth, depth addresses (innermost first).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int prof_pprof_sample(FILE *f, u64 count, unsigned depth, u64 *pc)
+{
+  u64 w[2] = { count, depth };
+
+  if(fwrite(w, sizeof *w, 2, f) != 2) return -1;
+
+  return fwrite(pc, sizeof *pc, depth, f) == depth ? 0 : -1;
+}
+
+
+/*
+ * pprof trailer: 0, 1, 0.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int prof_pprof_trailer(FILE *f)
+{
+  u64 w[3] = { 0, 1, 0 };
+
+  return fwrite(w, sizeof *w, 3, f) == 3 ? 0 : -1;
+}
+
+
+/*
+ * Take a sample at the current instruction.
+ */
+void prof_sample(x86emu_t *emu)
+{
+  struct x86emu_prof_s *prof = emu->priv->prof;
+  x86emu_prof_entry_t e, *ent;
+  unsigned code32, stack32, len;
+  u32 bp, next_bp, ret;
+
+  prof->next = ((prof->flags & X86EMU_PROF_REAL_TIME) ? emu->x86.R_REAL_TSC : emu->x86.R_TSC) + prof->interval;
+
+  memset(&e, 0, sizeof e);
+
+  e.cs = emu->x86.R_CS;
+  e.cs_base = emu->x86.R_CS_BASE;
+  e.eip[0] = emu->x86.R_EIP;
+  e.frames = 1;
+
+  code32 = ACC_D(emu->x86.R_CS_ACC);
+  stack32 = ACC_D(emu->x86.R_SS_ACC);
+  len = code32 ? 4 : 2;
+
+  bp = stack32 ? emu->x86.R_EBP : emu->x86.R_BP;
+
+  /* frame: [bp] = caller's bp, [bp + len] = return address */
+  while(e.frames < prof->frames && bp) {
+    next_bp = prof_read(emu, emu->x86.R_SS_BASE + bp, len);
+    ret = prof_read(emu, emu->x86.R_SS_BASE + bp + len, len);
+    e.eip[e.frames++] = ret;
+    if(next_bp <= bp) break;
+    bp = next_bp;
+  }
+
+  prof->samples++;
+
+  if((ent = prof_entry(prof, &e))) ent->count++;
+}
+
+
+/*
+ * Write histogram to log, most frequent first.
+ */
+void prof_dump(x86emu_t *emu)
+{
+  struct x86emu_prof_s *prof = emu->priv->prof;
+  x86emu_prof_entry_t **list, *e;
+  unsigned u, n;
+
+  if(!prof) return;
+
+  x86emu_log(emu, "; - - profile: %llu samples\n", (unsigned long long) prof->samples);
+
+  if(!prof->samples || !(list = malloc(prof->entries * sizeof *list))) return;
+
+  for(u = 0; u < prof->entries; u++) list[u] = prof->entry + u;
+
+  qsort(list, prof->entries, sizeof *list, prof_cmp);
+
+  for(u = 0; u < prof->entries; u++) {
+    e = list[u];
+    x86emu_log(emu, "%8u %5.1f%% %04x:%08x", e->count, e->count * 100. / prof->samples, e->cs, e->eip[0]);
+    for(n = 1; n < e->frames; n++) x86emu_log(emu, " < %08x", e->eip[n]);
+    x86emu_log(emu, "\n");
+  }
+
+  x86emu_log(emu, "\n");
+
+  free(list);
+}
+
+
+struct x86emu_prof_s *prof_clone(struct x86emu_prof_s *prof)
+{
+  struct x86emu_prof_s *new_prof;
+
+  new_prof = mem_dup(prof, sizeof *prof);
+  new_prof->entry = mem_dup(prof->entry, prof->max * sizeof *prof->entry);
+  new_prof->hash = mem_dup(prof->hash, prof->hash_size * sizeof *prof->hash);
+
+  return new_prof;
+}
+
+
+struct x86emu_prof_s *prof_free(struct x86emu_prof_s *prof)
+{
+  if(prof) {
+    free(prof->entry);
+    free(prof->hash);
+    free(prof);
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Find histogram entry for e, add new one if needed.
+ */
+x86emu_prof_entry_t *prof_entry(struct x86emu_prof_s *prof, x86emu_prof_entry_t *e)
+{
+  x86emu_prof_entry_t *ent;
+  unsigned u, idx, *hash;
+
+  if(prof->hash_size) {
+    for(idx = prof_hash(e) & (prof->hash_size - 1); (u = prof->hash[idx]); idx = (idx + 1) & (prof->hash_size - 1)) {
+      ent = prof->entry + u - 1;
+      if(
+        ent->cs == e->cs &&
+        ent->cs_base == e->cs_base &&
+        ent->frames == e->frames &&
+        !memcmp(ent->eip, e->eip, e->frames * sizeof *e->eip)
+      ) return ent;
+    }
+  }
+
+  /* keep hash table at most half full */
+  if(2 * (prof->entries + 1) > prof->hash_size) {
+    u = prof->hash_size ? 2 * prof->hash_size : 256;
+    if(!(hash = calloc(u, sizeof *hash))) return NULL;
+    free(prof->hash);
+    prof->hash = hash;
+    prof->hash_size = u;
+    for(u = 0; u < prof->entries; u++) {
+      for(idx = prof_hash(prof->entry + u) & (prof->hash_size - 1); hash[idx]; idx = (idx + 1) & (prof->hash_size - 1));
+      hash[idx] = u + 1;
+    }
+  }
+
+  if(prof->entries == prof->max) {
+    u = prof->max ? 2 * prof->max : 128;
+    if(!(ent = realloc(prof->entry, u * sizeof *ent))) return NULL;
+    prof->entry = ent;
+    prof->max = u;
+  }
+
+  ent = prof->entry + prof->entries++;
+  *ent = *e;
+
+  for(idx = prof_hash(ent) & (prof->hash_size - 1); prof->hash[idx]; idx = (idx + 1) & (prof->hash_size - 1));
+  prof->hash[idx] = prof->entries;
+
+  return ent;
+}
+
+
+unsigned prof_hash(x86emu_prof_entry_t *e)
+{
+  unsigned u, h = e->cs * 0x9e3779b1 + e->frames;
+
+  for(u = 0; u < e->frames; u++) h = (h ^ e->eip[u]) * 0x01000193;
+
+  return h ^ (h >> 16);
+}
+
+
+u32 prof_read(x86emu_t *emu, u32 addr, unsigned len)
+{
+  u32 val = 0;
+
+  while(len--) val = (val << 8) + x86emu_read_byte_noperm(emu, addr + len);
+
+  return val;
+}
+
+
+int prof_cmp(const void *a, const void *b)
+{
+  const x86emu_prof_entry_t *e1 = *(x86emu_prof_entry_t * const *) a, *e2 = *(x86emu_prof_entry_t * const *) b;
+
+  return e1->count < e2->count ? 1 : e1->count > e2->count ? -1 : 0;
+}
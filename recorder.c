@@ -0,0 +1,230 @@
+/****************************************************************************
+*
+* Realmode X86 Emulator Library
+*
+* Copyright (c) 2007-2017 SUSE LINUX GmbH; Author: Steffen Winterfeldt
+*
+*  ========================================================================
+*
+*  Permission to use, copy, modify, distribute, and sell this software and
+*  its documentation for any purpose is hereby granted without fee,
+*  provided that the above copyright notice appear in all copies and that
+*  both that copyright notice and this permission notice appear in
+*  supporting documentation, and that the name of the authors not be used
+*  in advertising or publicity pertaining to distribution of the software
+*  without specific, written prior permission.  The authors makes no
+*  representations about the suitability of this software for any purpose.
+*  It is provided "as is" without express or implied warranty.
+*
+*  THE AUTHORS DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+*  INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+*  EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+*  CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+*  USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+*  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+*  PERFORMANCE OF THIS SOFTWARE.
+*
+*  ========================================================================
+*
+* Description:
+*   Flight recorder: rings of the most recent instructions (with register
+*   state) and memory/io accesses, dumped to the log on demand or when
+*   something went wrong.
+*
+****************************************************************************/
+
+
+#include "include/x86emu_int.h"
+
+static void recorder_dump_access(x86emu_t *emu, recorder_access_t *a);
+
+
+/*
+ * Keep the last 'entries' instructions and accesses; 0 turns the recorder
+ * off.
+ *
+ * flags: X86EMU_RECORDER_*.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+API_SYM int x86emu_set_recorder(x86emu_t *emu, unsigned entries, unsigned flags)
+{
+  struct x86emu_recorder_s *rec;
+  unsigned u;
+
+  if(!emu) return -1;
+
+  emu->priv->recorder = recorder_free(emu->priv->recorder);
+
+  if(!entries) return 0;
+
+  for(u = 1; u < entries && u < (1u << 24); u <<= 1);
+
+  if(!(rec = calloc(1, sizeof *rec))) return -1;
+
+  rec->flags = flags;
+  rec->mask = u - 1;
+  rec->instr = malloc(u * sizeof *rec->instr);
+  rec->access = malloc(u * sizeof *rec->access);
+
+  if(!rec->instr || !rec->access) {
+    recorder_free(rec);
+
+    return -1;
+  }
+
+  emu->priv->recorder = rec;
+
+  return 0;
+}
+
+
+/*
+ * Record current instruction.
+ */
+void recorder_instr(x86emu_t *emu)
+{
+  struct x86emu_recorder_s *rec = emu->priv->recorder;
+  recorder_instr_t *r = rec->instr + (rec->instrs++ & rec->mask);
+
+  r->tsc = emu->x86.R_TSC;
+  r->gen = emu->x86.gen;
+  r->spc = emu->x86.spc;
+  r->spc.IP.I32_reg.e_reg = emu->x86.saved_eip;
+  r->cs = emu->x86.saved_cs;
+  r->len = emu->x86.instr_len;
+  r->code32 = MODE_CODE32 ? 1 : 0;
+  memcpy(r->bytes, emu->x86.instr_buf, sizeof r->bytes);
+}
+
+
+void recorder_access(x86emu_t *emu, u32 addr, u32 val, unsigned type, unsigned err)
+{
+  struct x86emu_recorder_s *rec = emu->priv->recorder;
+  recorder_access_t *a = rec->access + (rec->accesses++ & rec->mask);
+
+  a->tsc = emu->x86.R_TSC;
+  a->addr = addr;
+  a->val = val;
+  a->type = type;
+  a->err = err;
+}
+
+
+/*
+ * Write recorded instructions and accesses to log, oldest first.
+ *
+ * For each instruction, only registers that differ from the previous
+ * entry are shown.
+ */
+void recorder_dump(x86emu_t *emu)
+{
+  static const char *names[] = { "eax", "ebx", "ecx", "edx", "esp", "ebp", "esi", "edi", "eflags" };
+  struct x86emu_recorder_s *rec = emu->priv->recorder;
+  recorder_instr_t *r, *prev = NULL;
+  recorder_access_t *a;
+  u64 i, i_end, j, j_end;
+  u32 reg[9], prev_reg[9];
+  unsigned u, len;
+
+  if(!rec) return;
+
+  x86emu_log(emu, "; - - flight recorder\n");
+
+  i_end = rec->instrs;
+  i = i_end > rec->mask ? i_end - rec->mask - 1 : 0;
+  j_end = rec->accesses;
+  j = j_end > rec->mask ? j_end - rec->mask - 1 : 0;
+
+  for(; i < i_end; i++) {
+    r = rec->instr + (i & rec->mask);
+
+    /* accesses belong to the instruction with the same tsc */
+    for(; j < j_end && (a = rec->access + (j & rec->mask))->tsc < r->tsc; j++) {
+      recorder_dump_access(emu, a);
+    }
+
+    x86emu_log(emu, r->code32 ? "%llx %04x:%08x " : "%llx %04x:%04x ",
+      (unsigned long long) r->tsc, r->cs, r->spc.IP.I32_reg.e_reg
+    );
+    len = r->len > sizeof r->bytes ? sizeof r->bytes : r->len;
+    for(u = 0; u < 12; u++) {
+      if(u < len) {
+        x86emu_log(emu, "%02x", r->bytes[u]);
+      }
+      else {
+        x86emu_log(emu, "  ");
+      }
+    }
+    for(; u < len; u++) x86emu_log(emu, "%02x", r->bytes[u]);
+
+    reg[0] = r->gen.A.I32_reg.e_reg;
+    reg[1] = r->gen.B.I32_reg.e_reg;
+    reg[2] = r->gen.C.I32_reg.e_reg;
+    reg[3] = r->gen.D.I32_reg.e_reg;
+    reg[4] = r->spc.SP.I32_reg.e_reg;
+    reg[5] = r->spc.BP.I32_reg.e_reg;
+    reg[6] = r->spc.SI.I32_reg.e_reg;
+    reg[7] = r->spc.DI.I32_reg.e_reg;
+    reg[8] = r->spc.FLAGS;
+
+    for(u = 0; u < sizeof reg / sizeof *reg; u++) {
+      if(!prev || reg[u] != prev_reg[u]) x86emu_log(emu, " %s=%08x", names[u], reg[u]);
+    }
+    x86emu_log(emu, "\n");
+
+    memcpy(prev_reg, reg, sizeof reg);
+    prev = r;
+
+    for(; j < j_end && (a = rec->access + (j & rec->mask))->tsc == r->tsc; j++) {
+      recorder_dump_access(emu, a);
+    }
+  }
+
+  /* current instruction */
+  for(; j < j_end; j++) recorder_dump_access(emu, rec->access + (j & rec->mask));
+
+  x86emu_log(emu, "; next %04x:%08x\n\n", emu->x86.R_CS, emu->x86.R_EIP);
+}
+
+
+void recorder_dump_access(x86emu_t *emu, recorder_access_t *a)
+{
+  static const char types[] = "rwxio";
+  unsigned bits = a->type & 0xff, t = (a->type >> 8) & 7, n;
+
+  n = bits == X86EMU_MEMIO_16 ? 4 : bits == X86EMU_MEMIO_32 ? 8 : 2;
+
+  x86emu_log(emu, "  %c [%08x] = ", t < 5 ? types[t] : '?', a->addr);
+
+  if(a->err) {
+    x86emu_log(emu, "%.*s\n", n, "????????");
+  }
+  else {
+    x86emu_log(emu, "%0*x\n", n, a->val);
+  }
+}
+
+
+struct x86emu_recorder_s *recorder_clone(struct x86emu_recorder_s *rec)
+{
+  struct x86emu_recorder_s *new_rec;
+
+  new_rec = mem_dup(rec, sizeof *rec);
+  new_rec->instr = mem_dup(rec->instr, (rec->mask + 1) * sizeof *rec->instr);
+  new_rec->access = mem_dup(rec->access, (rec->mask + 1) * sizeof *rec->access);
+
+  return new_rec;
+}
+
+
+struct x86emu_recorder_s *recorder_free(struct x86emu_recorder_s *rec)
+{
+  if(rec) {
+    free(rec->instr);
+    free(rec->access);
+    free(rec);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,33 @@
+[init mode=real srand=39]
+
+idt.base=0x9000
+
+eax=rand
+
+; log port accesses at 0x3000, see x86test.c::io_test()
+io.handler=0x3000
+
+[code start=0x100:0x50]
+
+	; word/dword accesses crossing a 256 port boundary must reach the
+	; handler whole
+
+	mov dx,0x1ff
+	in ax,dx
+	out dx,ax
+
+	mov dx,0x2fe
+	in eax,dx
+	out dx,eax
+
+	mov dx,0x3fd
+	in eax,dx
+	out dx,eax
+
+	mov dx,0xffff
+	in ax,dx
+	out dx,ax
+
+	mov dx,0xfffd
+	in eax,dx
+	out dx,eax
@@ -0,0 +1,22 @@
+[init mode=real srand=40]
+
+idt.base=0x9000
+
+[code start=0x100:0x50]
+
+	; port input decides the code path; a replay has to supply the same values
+
+	mov cx,16
+	mov dx,0x60
+	xor bx,bx
+l_10:
+	in al,dx
+	test al,1
+	jz l_20
+	inc bx
+l_20:
+	add [0x200],al
+	in ax,0x64
+	xor [0x202],ax
+	loop l_10
+
@@ -0,0 +1,34 @@
+[init mode=real srand=41]
+
+idt.base=0x9000
+
+; port 0x80 returns R_TSC / 256, see x86test.c::timer_in()
+io.timer=0x80
+
+[code start=0x100:0x50]
+
+	; polling loops; x86test --poll checks that fast-forwarding them
+	; gives the same result
+
+	mov dx,0x80
+	mov cx,3
+	mov bx,0x200
+l_10:
+	in al,dx
+	test al,4
+	jz l_10
+l_20:
+	in ax,dx
+	test al,4
+	jnz l_20
+l_30:
+	in eax,dx
+	test al,2
+	jz l_30
+l_40:
+	in al,0x80
+	test al,1
+	jnz l_40
+	mov [bx],eax
+	add bx,4
+	loop l_10
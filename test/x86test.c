@@ -47,24 +47,38 @@
 
 typedef struct {
   x86emu_t *emu;
+  unsigned io_log;	/* next io_test() record, see 'io.handler' */
+  unsigned timer:1;	/* timer_port is emulated, see 'io.timer' */
+  unsigned timer_port;
+  unsigned timer_reads;
 } vm_t;
 
 
 void lprintf(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
 void flush_log(x86emu_t *emu, char *buf, unsigned size);
+void flush_br(x86emu_t *emu, char *buf, unsigned size);
 
 void help(void);
 int do_int(x86emu_t *emu, u8 num, unsigned type);
+u32 do_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits);
+u32 io_test_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits);
+void io_test_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits);
+void io_test(x86emu_t *emu, u32 port, u32 val, unsigned bits, unsigned out);
+u32 timer_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits);
+u64 timer_poll(x86emu_t *emu, u32 port, u32 val, unsigned bits);
 char *skip_spaces(char *s);
 vm_t *vm_new(void);
 void vm_free(vm_t *vm);
 int vm_init(vm_t *vm, char *file);
-void vm_run(vm_t *vm);
+void vm_run(vm_t *vm, unsigned flags);
 void vm_dump(vm_t *vm, char *file);
 
 char *build_file_name(char *file, char *suffix);
-int result_cmp(char *file);
+int result_cmp(char *file, char *suffix0, char *suffix1);
 int run_test(char *file);
+int replay_test(char *file, vm_t *rec_vm);
+int poll_test(char *file, vm_t *ref_vm);
+void run_trace(vm_t *vm, char *file);
 
 
 struct option options[] = {
@@ -73,12 +87,20 @@ struct option options[] = {
   { "show",       1, NULL, 1001 },
   { "max",        1, NULL, 1003 },
   { "stderr",     0, NULL, 1004 },
+  { "journal",    0, NULL, 1005 },
+  { "branch-trace", 0, NULL, 1006 },
+  { "binary-trace", 0, NULL, 1007 },
+  { "poll",       0, NULL, 1008 },
   { }
 };
 
 struct {
   unsigned verbose;
   unsigned inst_max;
+  unsigned journal:1;
+  unsigned branch_trace:1;
+  unsigned binary_trace:1;
+  unsigned poll:1;
 
   unsigned trace_flags;
   unsigned dump_flags;
@@ -88,6 +110,8 @@ struct {
   } show;
 
   FILE *log_file;
+  FILE *trace_file;	/* emulator log while running, see run_trace() */
+  FILE *br_file;
 } opt;
 
 
@@ -154,6 +178,22 @@ int main(int argc, char **argv)
         opt.show.print_to_stderr = 1;
         break;
 
+      case 1005:
+        opt.journal = 1;
+        break;
+
+      case 1006:
+        opt.branch_trace = 1;
+        break;
+
+      case 1007:
+        opt.binary_trace = 1;
+        break;
+
+      case 1008:
+        opt.poll = 1;
+        break;
+
       default:
         help();
         return i == 'h' ? 0 : 1;
@@ -191,16 +231,30 @@ void lprintf(const char *format, ...)
 
 void flush_log(x86emu_t *emu, char *buf, unsigned size)
 {
-  if(!buf || !size || !opt.log_file) return;
+  FILE *f = opt.trace_file ? opt.trace_file : opt.log_file;
 
-  fwrite(buf, size, 1, opt.log_file);
+  if(!buf || !size || !f) return;
+
+  fwrite(buf, size, 1, f);
+}
+
+
+void flush_br(x86emu_t *emu, char *buf, unsigned size)
+{
+  if(!buf || !size || !opt.br_file) return;
+
+  fwrite(buf, size, 1, opt.br_file);
 }
 
 
 void help()
 {
   fprintf(stderr,
-    "libx86 Test\nusage: x86test test_file\n"
+    "libx86 Test\nusage: x86test [--journal] test_file\n"
+    "  --journal       record port input, replay it on a new vm and compare the results\n"
+    "  --poll          run again with polling loops fast-forwarded and compare the results\n"
+    "  --branch-trace  write code log to *.trace and branch trace to *.br\n"
+    "  --binary-trace  write code log in binary format to *.btr\n"
   );
 }
 
@@ -215,6 +269,83 @@ int do_int(x86emu_t *emu, u8 num, unsigned type)
 }
 
 
+/*
+ * Port input that differs between runs, to check journal replay.
+ */
+u32 do_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits)
+{
+  static u32 val = 0x12345678;
+
+  val = val * 1103515245 + 12345 + port;
+
+  return val;
+}
+
+
+/*
+ * Port handlers for 'io.handler=addr' in the init file.
+ *
+ * Each access is logged as two dwords at addr: port + (size << 16) +
+ * (out ? 0x1000000 : 0) and the value. Input returns (size << 4) + i in
+ * byte i, so a split access reads a different value.
+ */
+u32 io_test_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits)
+{
+  unsigned u, size = 1 << (bits & 0xff);
+  u32 val = 0;
+
+  for(u = 0; u < size; u++) val += ((size << 4) + u) << (u * 8);
+
+  io_test(emu, port, val, bits, 0);
+
+  return val;
+}
+
+
+void io_test_out(x86emu_t *emu, void *ctx, u32 port, u32 val, unsigned bits)
+{
+  io_test(emu, port, val, bits, 1);
+}
+
+
+void io_test(x86emu_t *emu, u32 port, u32 val, unsigned bits, unsigned out)
+{
+  vm_t *vm = emu->private;
+
+  x86emu_write_dword(emu, vm->io_log, port + ((1 << (bits & 0xff)) << 16) + (out ? 0x1000000 : 0));
+  x86emu_write_dword(emu, vm->io_log + 4, val);
+
+  vm->io_log += 8;
+}
+
+
+/*
+ * Port 'io.timer=port' in the init file: returns R_TSC / 256.
+ */
+u32 timer_in(x86emu_t *emu, void *ctx, u32 port, unsigned bits)
+{
+  vm_t *vm = emu->private;
+
+  vm->timer_reads++;
+
+  return emu->x86.R_TSC >> 8;
+}
+
+
+/*
+ * Poll handler for --poll: the timer port keeps its value up to the next
+ * multiple of 256.
+ */
+u64 timer_poll(x86emu_t *emu, u32 port, u32 val, unsigned bits)
+{
+  vm_t *vm = emu->private;
+
+  if(!vm->timer || port != vm->timer_port) return 0;
+
+  return ((emu->x86.R_TSC >> 8) + 1) << 8;
+}
+
+
 char *skip_spaces(char *s)
 {
   while(isspace(*s)) s++;
@@ -237,6 +368,13 @@ vm_t *vm_new()
 
   vm->emu->log.trace = opt.trace_flags;
 
+  if(opt.journal) x86emu_set_io_handler(vm->emu, 0, X86EMU_IO_PORTS - 1, do_in, NULL, NULL);
+
+  if(opt.branch_trace || opt.binary_trace) {
+    vm->emu->log.trace = X86EMU_TRACE_CODE | X86EMU_TRACE_INTS | (opt.binary_trace ? X86EMU_TRACE_BINARY : 0);
+  }
+  if(opt.branch_trace) x86emu_set_branch_trace(vm->emu, 0x10000, flush_br);
+
   return vm;
 }
 
@@ -363,6 +501,18 @@ int vm_init(vm_t *vm, char *file)
         else if(!memcmp(s, "dr3=", s1 - s)) vm->emu->x86.R_DR3 = u;
         else if(!memcmp(s, "dr6=", s1 - s)) vm->emu->x86.R_DR6 = u;
         else if(!memcmp(s, "dr7=", s1 - s)) vm->emu->x86.R_DR7 = u;
+        else if(!memcmp(s, "io.handler=", s1 - s)) {
+          // the log is written by the host and can't be replayed; --journal uses do_in()
+          if(!opt.journal) {
+            vm->io_log = u;
+            x86emu_set_io_handler(vm->emu, 0, X86EMU_IO_PORTS - 1, io_test_in, io_test_out, NULL);
+          }
+        }
+        else if(!memcmp(s, "io.timer=", s1 - s)) {
+          vm->timer = 1;
+          vm->timer_port = u & 0xffff;
+          x86emu_set_io_handler(vm->emu, vm->timer_port, vm->timer_port, timer_in, NULL, NULL);
+        }
         else break;
 
         s = skip_spaces(s2);
@@ -383,16 +533,14 @@ int vm_init(vm_t *vm, char *file)
 }
 
 
-void vm_run(vm_t *vm)
+void vm_run(vm_t *vm, unsigned flags)
 {
-  unsigned flags;
-
   // x86emu_set_perm(vm->emu, 0x1004, 0x1004, X86EMU_PERM_VALID | X86EMU_PERM_R);
 
   // x86emu_set_io_perm(vm->emu, 0, 0x3ff, X86EMU_PERM_R | X86EMU_PERM_W);
   // iopl(3);
 
-  flags = X86EMU_RUN_LOOP | X86EMU_RUN_NO_CODE;
+  flags |= X86EMU_RUN_LOOP | X86EMU_RUN_NO_CODE;
 
   if(opt.inst_max) {
     vm->emu->max_instr = opt.inst_max;
@@ -414,7 +562,8 @@ void vm_dump(vm_t *vm, char *file)
 
   if(opt.log_file) {
     x86emu_dump(vm->emu,
-      X86EMU_DUMP_MEM | X86EMU_DUMP_REGS | (!file && opt.dump_flags ? opt.dump_flags : 0)
+      X86EMU_DUMP_MEM | X86EMU_DUMP_REGS | (!file && opt.dump_flags ? opt.dump_flags : 0) |
+      (opt.poll ? X86EMU_DUMP_IO : 0)
     );
     x86emu_clear_log(vm->emu, 1);
   }
@@ -450,15 +599,15 @@ char *build_file_name(char *file, char *suffix)
 }
 
 
-int result_cmp(char *file)
+int result_cmp(char *file, char *suffix0, char *suffix1)
 {
   FILE *f0, *f1;
   int err = 1;
   unsigned char *buf0, *buf1;
   int i, l0, l1;
 
-  f0 = fopen(build_file_name(file, ".result"), "r");
-  f1 = fopen(build_file_name(file, ".done"), "r");
+  f0 = fopen(build_file_name(file, suffix0), "r");
+  f1 = fopen(build_file_name(file, suffix1), "r");
 
   if(!f1) err = 2;
 
@@ -506,22 +655,42 @@ int run_test(char *file)
   if(ok) {
     lprintf("%s: starting test\n", file);
 
-    vm_run(vm);
+    if(opt.journal) x86emu_set_journal(vm->emu, X86EMU_JOURNAL_RECORD, NULL, 0);
+
+    if(opt.branch_trace || opt.binary_trace) {
+      run_trace(vm, file);
+    }
+    else {
+      vm_run(vm, 0);
+    }
 
     lprintf("\n- - - - - - - -  final vm state  - - - - - - - -\n");
     vm_dump(vm, NULL);
     lprintf("- - - - - - - - - - - - - - - -\n");
 
-    vm_dump(vm, build_file_name(file, ".result"));
+    vm_dump(vm, build_file_name(file, opt.journal ? ".jrec" : opt.poll ? ".pnorm" : ".result"));
+  }
+
+  if(!ok) {
+    result = 1;
+  }
+  else if(opt.journal) {
+    result = replay_test(file, vm);
+  }
+  else if(opt.poll) {
+    result = poll_test(file, vm);
   }
 
   vm_free(vm);
 
-  if(ok) {
-    result = result_cmp(file);
+  // branch trace is flushed in x86emu_done()
+  if(opt.br_file) {
+    fclose(opt.br_file);
+    opt.br_file = NULL;
   }
-  else {
-    result = 1;
+
+  if(ok && !opt.journal && !opt.poll) {
+    result = result_cmp(file, ".result", ".done");
   }
 
   lprintf("%s: %s\n", file, result == 0 ? "ok" : result == 1 ? "failed" : "unchecked");
@@ -536,3 +705,95 @@ int run_test(char *file)
 }
 
 
+/*
+ * Replay the journal of rec_vm on a new vm and compare the results.
+ */
+int replay_test(char *file, vm_t *rec_vm)
+{
+  vm_t *vm = vm_new();
+  const void *buf;
+  unsigned size, pos;
+  FILE *old_log;
+  int ok;
+
+  old_log = opt.log_file;
+  opt.log_file = NULL;
+  ok = vm_init(vm, file);
+  opt.log_file = old_log;
+
+  buf = x86emu_get_journal(rec_vm->emu, &size, NULL);
+
+  if(!ok || x86emu_set_journal(vm->emu, X86EMU_JOURNAL_REPLAY, buf, size)) {
+    vm_free(vm);
+
+    return 1;
+  }
+
+  vm_run(vm, 0);
+
+  x86emu_get_journal(vm->emu, NULL, &pos);
+  lprintf("journal: %u bytes, %u replayed\n", size, pos);
+
+  vm_dump(vm, build_file_name(file, ".jreplay"));
+
+  vm_free(vm);
+
+  return pos == size ? result_cmp(file, ".jrec", ".jreplay") : 1;
+}
+
+
+/*
+ * Run the test again on a new vm with polling loops fast-forwarded and
+ * compare the results (including R_TSC and i/o statistics) with ref_vm.
+ */
+int poll_test(char *file, vm_t *ref_vm)
+{
+  vm_t *vm = vm_new();
+  FILE *old_log;
+  int ok;
+
+  old_log = opt.log_file;
+  opt.log_file = NULL;
+  ok = vm_init(vm, file);
+  opt.log_file = old_log;
+
+  if(!ok) {
+    vm_free(vm);
+
+    return 1;
+  }
+
+  // a code log would stop the fast-forward
+  vm->emu->log.trace = 0;
+  x86emu_set_poll_handler(vm->emu, timer_poll);
+
+  vm_run(vm, X86EMU_RUN_POLL);
+
+  lprintf("poll: %u timer reads, %u fast-forwarded\n", ref_vm->timer_reads, vm->timer_reads);
+
+  vm_dump(vm, build_file_name(file, ".pskip"));
+
+  vm_free(vm);
+
+  return result_cmp(file, ".pnorm", ".pskip");
+}
+
+
+/*
+ * Run with the code log going to *.trace (*.btr for binary traces) and the
+ * branch trace to *.br, for comparing with what the trace decoders in
+ * ../tools reconstruct (see trace_check).
+ */
+void run_trace(vm_t *vm, char *file)
+{
+  opt.trace_file = fopen(build_file_name(file, opt.binary_trace ? ".btr" : ".trace"), "w");
+  if(opt.branch_trace) opt.br_file = fopen(build_file_name(file, ".br"), "w");
+
+  vm_run(vm, 0);
+
+  if(opt.trace_file) fclose(opt.trace_file);
+  opt.trace_file = NULL;
+
+  // final state dump goes to the regular log
+  vm->emu->log.trace = opt.trace_flags;
+}
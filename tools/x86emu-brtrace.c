@@ -0,0 +1,548 @@
+/*
+ * Reconstruct the instruction trace from a libx86emu branch trace
+ * (x86emu_set_branch_trace()).
+ *
+ * Code is taken from the page and code records in the trace and followed
+ * instruction by instruction. The trace supplies only what the code itself
+ * does not tell: branch decisions, indirect branch targets, and interrupts.
+ *
+ * Instructions are disassembled and classified with x86emu_disasm(), which
+ * uses the same decoder as the emulator that wrote the trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <x86emu.h>
+
+/* as in libx86emu's brtrace.h */
+#define BRTRACE_STACK	64
+
+/* record type of taken/not taken bits */
+#define REC_TNT		0x80
+
+typedef struct {
+  u32 eip;
+  u32 base;
+  u16 cs;
+  unsigned code32:1;
+} cpu_state_t;
+
+void help(void);
+int decode(FILE *f);
+int decode_instr(void);
+void decode_run(u32 rs);
+int peek(void);
+int read_rec(void);
+u64 get_num(void);
+void get_state(cpu_state_t *s);
+int get_bit(void);
+int get_target(unsigned type);
+int positioned(unsigned type);
+unsigned get_code(u32 addr, unsigned char *buf, unsigned len);
+unsigned char *get_page(u32 addr);
+
+
+struct option options[] = {
+  { "help",       0, NULL, 'h'  },
+  { }
+};
+
+
+struct {
+  char *file;
+} opt;
+
+
+/* next record, see peek() */
+struct {
+  unsigned type;	/* X86EMU_BRTRACE_*, REC_TNT, 0: end of trace */
+  unsigned valid:1;
+  u64 pos;		/* positioned records */
+  unsigned tnt;
+  cpu_state_t state;
+  u32 eip;
+  u32 page;		/* page number (PAGE), address (CODE) */
+  u32 port;
+  u32 val;
+  unsigned info;	/* interrupt, input size, code length */
+  unsigned type2;	/* interrupt type */
+} rec;
+
+unsigned char rec_page[X86EMU_PAGE_SIZE];
+
+FILE *trace;
+
+
+/* decoder state */
+struct {
+  cpu_state_t cur;
+  u64 count;		/* instructions */
+  u64 last_pos;
+  unsigned tnt;		/* taken/not taken bits with end marker, 1: empty */
+  u32 stack[BRTRACE_STACK];
+  unsigned sp;
+  unsigned depth;
+  unsigned char **page[1 << 10];
+  unsigned started:1;
+} state;
+
+/* context for x86emu_disasm() */
+x86emu_t *dis_emu;
+
+
+/*
+ * Parse options, then decode trace.
+ */
+int main(int argc, char **argv)
+{
+  FILE *f = stdin;
+  int i;
+
+  opterr = 0;
+
+  while((i = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch(i) {
+      default:
+        help();
+        return i == 'h' ? 0 : 1;
+    }
+  }
+
+  if(argc == optind + 1) {
+    opt.file = argv[optind];
+  }
+  else if(argc != optind) {
+    help();
+    return 1;
+  }
+
+  if(opt.file && !(f = fopen(opt.file, "r"))) {
+    perror(opt.file);
+    return 1;
+  }
+
+  i = decode(f);
+
+  if(f != stdin) fclose(f);
+
+  return i;
+}
+
+
+/*
+ * Display short usage message.
+ */
+void help()
+{
+  printf(
+    "Usage: x86emu-brtrace [OPTIONS] [FILE]\n"
+    "\n"
+    "Reconstruct instruction trace from libx86emu branch trace in FILE (or stdin).\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help              Show this text\n"
+  );
+}
+
+
+/*
+ * Decode trace.
+ *
+ * The first column of the instruction lines is the instruction number in
+ * the trace.
+ */
+int decode(FILE *f)
+{
+  char magic[X86EMU_BRTRACE_MAGIC_LEN];
+  unsigned char *p;
+  unsigned u;
+
+  trace = f;
+  state.tnt = 1;
+
+  if(fread(magic, sizeof magic, 1, f) != 1 || memcmp(magic, X86EMU_BRTRACE_MAGIC, sizeof magic)) {
+    fprintf(stderr, "not a branch trace\n");
+    return 1;
+  }
+
+  for(;;) {
+    /* records for the current position, if no taken/not taken bits are pending */
+    while(state.tnt <= 1 && positioned(peek())) {
+      if(rec.pos != state.count) break;
+
+      switch(rec.type) {
+        case X86EMU_BRTRACE_JUMP:
+          state.cur = rec.state;
+          state.started = 1;
+          break;
+
+        case X86EMU_BRTRACE_INTR:
+          state.cur = rec.state;
+          break;
+
+        case X86EMU_BRTRACE_PAGE:
+          if(!(p = get_page(rec.page << X86EMU_PAGE_BITS))) return 1;
+          memcpy(p, rec_page, X86EMU_PAGE_SIZE);
+          break;
+
+        case X86EMU_BRTRACE_CODE:
+          for(u = 0; u < rec.info; u++) {
+            if(!(p = get_page(rec.page + u))) return 1;
+            p[(rec.page + u) & (X86EMU_PAGE_SIZE - 1)] = rec_page[u];
+          }
+          break;
+
+        case X86EMU_BRTRACE_INPUT:
+          u = 2 << (rec.info & 3);
+          if(rec.info & 0x80) {
+            printf("i [%08x] = %.*s\n", rec.port, u, "????????");
+          }
+          else {
+            printf("i [%08x] = %0*x\n", rec.port, u, rec.val);
+          }
+          break;
+
+        case X86EMU_BRTRACE_STOP:
+          decode_run(rec.val);
+          break;
+      }
+
+      rec.valid = 0;
+    }
+
+    if(state.tnt <= 1) {
+      if(!peek()) break;
+      if(positioned(rec.type) && rec.pos < state.count) {
+        fprintf(stderr, "trace out of sync at instruction %llx\n", (unsigned long long) state.count);
+        return 1;
+      }
+    }
+
+    if(!state.started) {
+      fprintf(stderr, "no start address\n");
+      return 1;
+    }
+
+    if(!decode_instr()) return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Print current instruction and follow it to the next one.
+ *
+ * Return 0 on error.
+ */
+int decode_instr()
+{
+  cpu_state_t *cur = &state.cur;
+  unsigned char bytes[16];
+  unsigned u, len, taken, jump;
+  u32 ret;
+  x86emu_disasm_t instr;
+
+  if(!(len = get_code(cur->base + cur->eip, bytes, sizeof bytes))) {
+    fprintf(stderr, "no code at %04x:%08x\n", cur->cs, cur->eip);
+    return 0;
+  }
+
+  if(!dis_emu) dis_emu = x86emu_new(0, 0);
+
+  if(x86emu_disasm(dis_emu, cur->eip, cur->code32, bytes, len, &instr)) {
+    fprintf(stderr, "failed to decode instruction at %04x:%08x\n", cur->cs, cur->eip);
+    return 0;
+  }
+
+  len = instr.len;
+
+  state.count++;
+
+  /* interrupted, or continues elsewhere: handled in decode() */
+  jump = state.tnt <= 1 && positioned(peek()) && rec.pos == state.count &&
+    (rec.type == X86EMU_BRTRACE_JUMP || rec.type == X86EMU_BRTRACE_INTR);
+
+  /* like the emulator log: interrupt first */
+  if(jump && rec.type == X86EMU_BRTRACE_INTR) {
+    printf("* %s %02x\n", rec.type2 == INTR_TYPE_FAULT ? "fault" : rec.type2 == INTR_TYPE_HW ? "irq" : "int", rec.info);
+  }
+
+  printf("%llx", (unsigned long long) state.count - 1);
+  printf(cur->code32 ? " %04x:%08x " : " %04x:%04x ", cur->cs, cur->eip);
+  for(u = 0; u < len; u++) printf("%02x", bytes[u]);
+  for(; u < 12; u++) printf("  ");
+  printf(" %s\n", instr.text);
+
+  if(jump) return 1;
+
+  ret = instr.next;
+
+  cur->eip += len;
+
+  switch(instr.branch) {
+    case X86EMU_BRANCH_COND:
+      if((taken = get_bit()) > 1) return 0;
+      if(taken) cur->eip = instr.target;
+      break;
+
+    case X86EMU_BRANCH_CALL:
+      state.stack[state.sp++ % BRTRACE_STACK] = ret;
+      if(state.depth < BRTRACE_STACK) state.depth++;
+      /* fall through */
+
+    case X86EMU_BRANCH_JUMP:
+      cur->eip = instr.target;
+      break;
+
+    case X86EMU_BRANCH_RET:
+      if(state.depth) {
+        state.depth--;
+        ret = state.stack[--state.sp % BRTRACE_STACK];
+        if((taken = get_bit()) > 1) return 0;
+        if(taken) {
+          cur->eip = ret;
+          break;
+        }
+      }
+      return get_target(X86EMU_BRTRACE_TARGET);
+
+    case X86EMU_BRANCH_ICALL:
+      state.stack[state.sp++ % BRTRACE_STACK] = ret;
+      if(state.depth < BRTRACE_STACK) state.depth++;
+      /* fall through */
+
+    case X86EMU_BRANCH_IJUMP:
+      return get_target(X86EMU_BRTRACE_TARGET);
+
+    case X86EMU_BRANCH_FAR:
+      return get_target(X86EMU_BRTRACE_FAR);
+  }
+
+  return 1;
+}
+
+
+/*
+ * Print x86emu_run() result.
+ */
+void decode_run(u32 rs)
+{
+  if((rs & X86EMU_RUN_TIMEOUT)) printf("* timeout\n");
+  if((rs & X86EMU_RUN_MAX_INSTR)) printf("* too many instructions\n");
+  if((rs & X86EMU_RUN_NO_EXEC)) printf("* memory not executable\n");
+  if((rs & X86EMU_RUN_NO_CODE)) printf("* no proper code\n");
+  if((rs & X86EMU_RUN_LOOP)) printf("* infinite loop\n");
+  if((rs & X86EMU_RUN_JOURNAL)) printf("* journal mismatch\n");
+}
+
+
+/*
+ * Get type of next record (0: end of trace).
+ */
+int peek()
+{
+  if(!rec.valid) {
+    rec.type = read_rec();
+    rec.valid = 1;
+  }
+
+  return rec.type;
+}
+
+
+/*
+ * Read next record.
+ */
+int read_rec()
+{
+  int c;
+
+  if((c = getc(trace)) == EOF) return 0;
+
+  if(c & 0x80) {
+    rec.tnt = c & 0x7f;
+
+    return REC_TNT;
+  }
+
+  if(positioned(c)) {
+    rec.pos = state.last_pos += get_num();
+  }
+
+  switch(c) {
+    case X86EMU_BRTRACE_TARGET:
+      rec.eip = get_num();
+      break;
+
+    case X86EMU_BRTRACE_FAR:
+    case X86EMU_BRTRACE_JUMP:
+      get_state(&rec.state);
+      break;
+
+    case X86EMU_BRTRACE_INTR:
+      rec.info = get_num();
+      rec.type2 = get_num();
+      get_state(&rec.state);
+      break;
+
+    case X86EMU_BRTRACE_PAGE:
+      rec.page = get_num();
+      if(rec.page >= 1 << 20 || fread(rec_page, sizeof rec_page, 1, trace) != 1) return 0;
+      break;
+
+    case X86EMU_BRTRACE_CODE:
+      rec.page = get_num();
+      rec.info = get_num();
+      if(rec.info > 16 || fread(rec_page, rec.info, 1, trace) != 1) return 0;
+      break;
+
+    case X86EMU_BRTRACE_INPUT:
+      rec.port = get_num();
+      rec.info = getc(trace);
+      rec.val = get_num();
+      break;
+
+    case X86EMU_BRTRACE_STOP:
+      rec.val = get_num();
+      break;
+
+    default:
+      fprintf(stderr, "unknown record type 0x%02x\n", c);
+      return 0;
+  }
+
+  return c;
+}
+
+
+/*
+ * Read LEB128 encoded number.
+ */
+u64 get_num()
+{
+  u64 val = 0;
+  unsigned shift = 0;
+  int c;
+
+  while((c = getc(trace)) != EOF) {
+    if(shift < 64) val += (u64) (c & 0x7f) << shift;
+    shift += 7;
+    if(!(c & 0x80)) break;
+  }
+
+  return val;
+}
+
+
+void get_state(cpu_state_t *s)
+{
+  s->cs = get_num();
+  s->base = get_num();
+  s->code32 = get_num() ? 1 : 0;
+  s->eip = get_num();
+}
+
+
+/*
+ * Get next taken/not taken bit.
+ *
+ * Returns 2 on error.
+ */
+int get_bit()
+{
+  unsigned n, bit;
+
+  if(state.tnt <= 1) {
+    if(peek() != REC_TNT) {
+      fprintf(stderr, "trace out of sync at instruction %llx: branch bit missing\n", (unsigned long long) state.count);
+      return 2;
+    }
+    state.tnt = rec.tnt;
+    rec.valid = 0;
+  }
+
+  for(n = 6; n && !(state.tnt & (1 << n)); n--);
+
+  bit = (state.tnt >> (n - 1)) & 1;
+  state.tnt = (state.tnt & ((1 << (n - 1)) - 1)) + (1 << (n - 1));
+
+  return bit;
+}
+
+
+/*
+ * Continue at branch target from next record.
+ *
+ * Return 0 on error.
+ */
+int get_target(unsigned type)
+{
+  if(state.tnt > 1 || peek() != type) {
+    fprintf(stderr, "trace out of sync at instruction %llx: branch target missing\n", (unsigned long long) state.count);
+    return 0;
+  }
+
+  if(type == X86EMU_BRTRACE_FAR) {
+    state.cur = rec.state;
+  }
+  else {
+    state.cur.eip = rec.eip;
+  }
+
+  rec.valid = 0;
+
+  return 1;
+}
+
+
+/*
+ * Record types that start with an instruction count.
+ */
+int positioned(unsigned type)
+{
+  return type >= X86EMU_BRTRACE_JUMP && type <= X86EMU_BRTRACE_CODE;
+}
+
+
+/*
+ * Copy len code bytes at addr to buf.
+ *
+ * Returns number of bytes available.
+ */
+unsigned get_code(u32 addr, unsigned char *buf, unsigned len)
+{
+  unsigned u;
+  unsigned char **dir, *page;
+
+  for(u = 0; u < len; u++, addr++) {
+    dir = state.page[addr >> (X86EMU_PAGE_BITS + 10)];
+    page = dir ? dir[(addr >> X86EMU_PAGE_BITS) & 0x3ff] : NULL;
+    if(!page) break;
+    buf[u] = page[addr & (X86EMU_PAGE_SIZE - 1)];
+  }
+
+  return u;
+}
+
+
+/*
+ * Get code page with addr; allocate it if necessary.
+ *
+ * Bytes not in the trace are 0.
+ */
+unsigned char *get_page(u32 addr)
+{
+  unsigned char ***dir = state.page + (addr >> (X86EMU_PAGE_BITS + 10)), **page;
+
+  if(!*dir && !(*dir = calloc(1 << 10, sizeof **dir))) return NULL;
+
+  page = *dir + ((addr >> X86EMU_PAGE_BITS) & 0x3ff);
+
+  if(!*page && !(*page = calloc(1, X86EMU_PAGE_SIZE))) return NULL;
+
+  return *page;
+}
+
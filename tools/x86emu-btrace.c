@@ -0,0 +1,354 @@
+/*
+ * Decode a binary libx86emu trace (X86EMU_TRACE_BINARY) into the usual
+ * text log format.
+ *
+ * The trace does not contain disassembled code. It is recreated with
+ * x86emu_disasm().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <x86emu.h>
+
+void help(void);
+int decode(FILE *f);
+void decode_code(void);
+void decode_descr(u32 dl, u32 dh);
+void decode_run(u32 rs);
+char *disasm(void);
+
+
+struct option options[] = {
+  { "help",       0, NULL, 'h'  },
+  { "no-disasm",  0, NULL, 'n'  },
+  { }
+};
+
+
+struct {
+  unsigned no_disasm:1;
+  char *file;
+} opt;
+
+
+/* decoder state */
+struct {
+  u32 addr[3];		/* indexed by X86EMU_BTRACE_ADDR_* */
+  u16 cs;
+  u64 tsc;
+  u64 time;
+  unsigned has_time:1;
+  u32 reg[16];		/* see X86EMU_BTRACE_REG */
+  u32 descr;		/* low descriptor dword */
+  struct {
+    u32 eip;
+    unsigned code32:1;
+    unsigned len;	/* instruction length */
+    unsigned got;	/* bytes received so far */
+    unsigned char bytes[32];
+  } code;
+} state;
+
+
+/* context for x86emu_disasm() */
+x86emu_t *dis_emu;
+
+
+/*
+ * Parse options, then decode trace.
+ */
+int main(int argc, char **argv)
+{
+  FILE *f = stdin;
+  int i;
+
+  opterr = 0;
+
+  while((i = getopt_long(argc, argv, "hn", options, NULL)) != -1) {
+    switch(i) {
+      case 'n':
+        opt.no_disasm = 1;
+        break;
+
+      default:
+        help();
+        return i == 'h' ? 0 : 1;
+    }
+  }
+
+  if(argc == optind + 1) {
+    opt.file = argv[optind];
+  }
+  else if(argc != optind) {
+    help();
+    return 1;
+  }
+
+  if(opt.file && !(f = fopen(opt.file, "r"))) {
+    perror(opt.file);
+    return 1;
+  }
+
+  i = decode(f);
+
+  if(f != stdin) fclose(f);
+
+  return i;
+}
+
+
+/*
+ * Display short usage message.
+ */
+void help()
+{
+  printf(
+    "Usage: x86emu-btrace [OPTIONS] [FILE]\n"
+    "\n"
+    "Convert binary libx86emu trace in FILE (or stdin) to text.\n"
+    "\n"
+    "Options:\n"
+    "  -n, --no-disasm         Don't disassemble code (faster).\n"
+    "  -h, --help              Show this text\n"
+  );
+}
+
+
+/*
+ * Decode trace records.
+ */
+int decode(FILE *f)
+{
+  unsigned char r[X86EMU_BTRACE_REC_SIZE];
+  unsigned info, u;
+  s16 delta;
+  u32 val;
+
+  while(fread(r, sizeof r, 1, f) == 1) {
+    info = r[1];
+    delta = r[2] + (r[3] << 8);
+    val = r[4] + (r[5] << 8) + (r[6] << 16) + ((u32) r[7] << 24);
+
+    switch(r[0]) {
+      case X86EMU_BTRACE_CODE:
+        state.code.eip = state.addr[X86EMU_BTRACE_ADDR_EIP] += delta;
+        state.code.code32 = info >> 7;
+        state.code.len = info & 0x7f;
+        if(state.code.len > sizeof state.code.bytes) state.code.len = sizeof state.code.bytes;
+        for(u = 0; u < 4; u++) state.code.bytes[u] = val >> (u * 8);
+        state.code.got = state.code.len > 4 ? 4 : state.code.len;
+        state.tsc++;
+        if(state.code.got == state.code.len) decode_code();
+        break;
+
+      case X86EMU_BTRACE_BYTES:
+        for(u = 0; u < info && u < 6 && state.code.got < state.code.len; u++) {
+          state.code.bytes[state.code.got++] = r[2 + u];
+        }
+        if(state.code.got == state.code.len) decode_code();
+        break;
+
+      case X86EMU_BTRACE_MEMIO:
+        state.addr[(info & 7) >= 3 ? X86EMU_BTRACE_ADDR_IO : X86EMU_BTRACE_ADDR_MEM] += delta;
+        printf("%c [%08x] = ",
+          "rwxio??"[info & 7],
+          state.addr[(info & 7) >= 3 ? X86EMU_BTRACE_ADDR_IO : X86EMU_BTRACE_ADDR_MEM]
+        );
+        u = 2 << ((info >> 4) & 3);
+        if(info & 0x80) {
+          printf("%.*s\n", u, "????????");
+        }
+        else {
+          printf("%0*x\n", u, val);
+        }
+        break;
+
+      case X86EMU_BTRACE_ADDR:
+        if(info < 3) state.addr[info] = val;
+        break;
+
+      case X86EMU_BTRACE_CS:
+        state.cs = val;
+        break;
+
+      case X86EMU_BTRACE_TSC:
+        state.tsc = ((u64) (u16) delta << 32) + val - 1;
+        break;
+
+      case X86EMU_BTRACE_TIME:
+        state.time = ((u64) (u16) delta << 32) + val;
+        state.has_time = 1;
+        break;
+
+      case X86EMU_BTRACE_INTR:
+        printf("* %s %02x\n", info == INTR_TYPE_FAULT ? "fault" : info == INTR_TYPE_HW ? "irq" : "int", val & 0xff);
+        break;
+
+      case X86EMU_BTRACE_REG:
+        if(info < 16) state.reg[info] = val;
+        if(info != 15) break;
+        printf(
+          "\neax %08x, ebx %08x, ecx %08x, edx %08x"
+          "\nesi %08x, edi %08x, ebp %08x, esp %08x"
+          "\ncs %04x, ss %04x, ds %04x, es %04x, fs %04x, gs %04x"
+          "\neip %08x, eflags %08x",
+          state.reg[0], state.reg[1], state.reg[2], state.reg[3],
+          state.reg[4], state.reg[5], state.reg[6], state.reg[7],
+          state.reg[8], state.reg[9], state.reg[10], state.reg[11], state.reg[12], state.reg[13],
+          state.reg[14], state.reg[15]
+        );
+        if(val & F_OF) printf(" of");
+        if(val & F_DF) printf(" df");
+        if(val & F_IF) printf(" if");
+        if(val & F_SF) printf(" sf");
+        if(val & F_ZF) printf(" zf");
+        if(val & F_AF) printf(" af");
+        if(val & F_PF) printf(" pf");
+        if(val & F_CF) printf(" cf");
+        printf("\n");
+        break;
+
+      case X86EMU_BTRACE_ACC:
+        printf("a [%s%cs:%08x]\n",
+          (info & 0xf) == 1 ? "byte " : (info & 0xf) == 2 ? "word " : (info & 0xf) == 4 ? "dword " : "",
+          "ecsdfg?"[(info >> 4) > 6 ? 6 : info >> 4],
+          val
+        );
+        break;
+
+      case X86EMU_BTRACE_DESCR:
+        if(info == 0) {
+          state.descr = val;
+        }
+        else {
+          decode_descr(state.descr, val);
+        }
+        break;
+
+      case X86EMU_BTRACE_TEXT:
+        fwrite(r + 2, info > 6 ? 6 : info, 1, stdout);
+        break;
+
+      case X86EMU_BTRACE_RUN:
+        decode_run(val);
+        break;
+
+      default:
+        fprintf(stderr, "unknown record type 0x%02x\n", r[0]);
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * Print instruction line.
+ */
+void decode_code()
+{
+  unsigned u;
+  char *s;
+
+  printf("%llx", (unsigned long long) state.tsc);
+  if(state.has_time) printf(" +%llx", (unsigned long long) state.time);
+  state.has_time = 0;
+
+  printf(state.code.code32 ? " %04x:%08x " : " %04x:%04x ", state.cs, state.code.eip);
+
+  for(u = 0; u < state.code.len; u++) printf("%02x", state.code.bytes[u]);
+  for(; u < 12; u++) printf("  ");
+
+  printf(" %s\n", (s = disasm()) ? s : "");
+}
+
+
+/*
+ * Print descriptor, as decode_descriptor() does.
+ */
+void decode_descr(u32 dl, u32 dh)
+{
+  unsigned acc, type, gate;
+  u32 base, limit;
+
+  acc = ((dh >> 8) & 0xff) + ((dh >> 12) & 0xf00);
+  base = ((dl >> 16) & 0xffff) + ((dh & 0xff) << 16) + (dh & 0xff000000);
+  limit = (dl & 0xffff) + (dh & 0xf0000);
+  if(ACC_G(acc)) limit = (limit << 12) + 0xfff;
+
+  type = ACC_S(acc) ? 0 : acc & 7;
+  gate = !ACC_S(acc) && type >= 4;
+
+  printf("d [%08x %08x] =", dh, dl);
+
+  if(ACC_S(acc)) {
+    printf(" base=%08x limit=%08x", base, limit);
+  }
+  else {
+    printf(" sel=%04x ofs=%08x wcnt=%02x",
+      gate ? dl >> 16 : 0,
+      gate ? (dl & 0xffff) + (dh & 0xffff0000) : 0,
+      gate ? dh & 0x1f : 0
+    );
+  }
+
+  printf(" dpl=%x", ACC_DPL(acc));
+
+  if(ACC_P(acc)) printf(" p");
+  if(ACC_S(acc)) {
+    if(ACC_A(acc)) printf(" a");
+    if(ACC_E(acc) ? ACC_R(acc) : 1) printf(" r");
+    if(!ACC_E(acc) && ACC_W(acc)) printf(" w");
+    if(ACC_E(acc)) printf(" x");
+    if(ACC_E(acc) && ACC_C(acc)) printf(" c");
+    if(!ACC_E(acc) && ACC_ED(acc)) printf(" ed");
+  }
+  if(ACC_G(acc)) printf(" g");
+  if(ACC_S(acc) ? ACC_D(acc) : acc & 8) printf(" 32");
+  if(!ACC_S(acc)) {
+    if(type == 2) printf(" ldt");
+    if(type == 1 || type == 3) printf(" tss");
+    if(type == 3) printf(" busy");
+    if(type == 4) printf(" callgate");
+    if(type == 6 || type == 7) printf(" intgate");
+    if(type == 5) printf(" taskgate");
+    if(type == 7) printf(" trap");
+    if(type == 0) printf(" invalid");
+  }
+
+  printf("\n");
+}
+
+
+/*
+ * Print x86emu_run() result.
+ */
+void decode_run(u32 rs)
+{
+  if((rs & X86EMU_RUN_TIMEOUT)) printf("* timeout\n");
+  if((rs & X86EMU_RUN_MAX_INSTR)) printf("* too many instructions\n");
+  if((rs & X86EMU_RUN_NO_EXEC)) printf("* memory not executable\n");
+  if((rs & X86EMU_RUN_NO_CODE)) printf("* no proper code\n");
+  if((rs & X86EMU_RUN_LOOP)) printf("* infinite loop\n");
+  if((rs & X86EMU_RUN_JOURNAL)) printf("* journal mismatch\n");
+}
+
+
+/*
+ * Disassemble current instruction.
+ */
+char *disasm()
+{
+  static x86emu_disasm_t instr;
+
+  if(opt.no_disasm) return NULL;
+
+  if(!dis_emu && !(dis_emu = x86emu_new(0, 0))) return NULL;
+
+  if(x86emu_disasm(dis_emu, state.code.eip, state.code.code32, state.code.bytes, state.code.len, &instr)) return NULL;
+
+  return instr.text;
+}